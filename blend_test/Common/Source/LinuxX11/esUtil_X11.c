@@ -20,8 +20,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
-#include <sys/time.h>
 #include "esUtil.h"
+#include "esUtil_win.h"
 
 #include  <X11/Xlib.h>
 #include  <X11/Xatom.h>
@@ -49,7 +49,7 @@ static Atom s_wmDeleteMessage;
 //
 //      This function initialized the native X11 display and window for EGL
 //
-EGLBoolean WinCreate(ESContext *esContext, const char *title)
+GLboolean WinCreate(ESContext *esContext, const char *title)
 {
     Window root;
     XSetWindowAttributes swa;
@@ -159,24 +159,9 @@ GLboolean userInterrupt(ESContext *esContext)
 //
 void WinLoop ( ESContext *esContext )
 {
-    struct timeval t1, t2;
-    struct timezone tz;
-    float deltatime;
-
-    gettimeofday ( &t1 , &tz );
-
     while(userInterrupt(esContext) == GL_FALSE)
     {
-        gettimeofday(&t2, &tz);
-        deltatime = (float)(t2.tv_sec - t1.tv_sec + (t2.tv_usec - t1.tv_usec) * 1e-6);
-        t1 = t2;
-
-        if (esContext->updateFunc != NULL)
-            esContext->updateFunc(esContext, deltatime);
-        if (esContext->drawFunc != NULL)
-            esContext->drawFunc(esContext);
-
-        eglSwapBuffers(esContext->eglDisplay, esContext->eglSurface);        
+        RunFrame(esContext);
     }
 }
 
@@ -201,11 +186,20 @@ int main ( int argc, char *argv[] )
    if ( esMain ( &esContext ) != GL_TRUE )
       return 1;   
  
-   WinLoop ( &esContext );
+   if ( BenchmarkRequested () )
+      BenchmarkLoop ( &esContext );
+   else if ( esContext.headless )
+      HeadlessLoop ( &esContext );
+   else
+      WinLoop ( &esContext );
+
+   FrameStatesDestroy ( &esContext );
 
    if ( esContext.shutdownFunc != NULL )
 	   esContext.shutdownFunc ( &esContext );
 
+   esShutdownJobPool ();
+
    if ( esContext.userData != NULL )
 	   free ( esContext.userData );
 
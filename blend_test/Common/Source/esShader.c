@@ -38,7 +38,77 @@
 //  Includes
 //
 #include "esUtil.h"
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+///
+//  Macros
+//
+#define ES_PROGRAM_CACHE_MAGIC        0x42505345   // "ESPB"
+#define ES_PROGRAM_CACHE_VERSION      1
+#define ES_PROGRAM_CACHE_DIR_MAX      480          // leaves room for the file name in a path
+#define ES_PROGRAM_CACHE_PATH_MAX     512
+#define ES_PROGRAM_CACHE_BINARY_MAX   ( 16 * 1024 * 1024 )
+#define ES_PROGRAM_REGISTRY_MAX       32
+#define ES_PROGRAM_UNIFORM_MAX        16           // cached uniform locations per program
+#define ES_UNIFORM_NAME_MAX           64
+#define ES_PENDING_PROGRAM_MAX        32           // programs submitted by esLoadProgramAsync and not finished yet
+#define ES_SHADER_VERSION_STR         "#version 300 es\n"
+
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR      0x91B1
+#endif
+
+///
+//  Types
+//
+typedef struct
+{
+   unsigned int magic;
+   unsigned int version;
+   unsigned int key[2];          // hash of the sources and the driver, also the file name
+   GLenum       binaryFormat;
+   GLint        binaryLength;    // followed by binaryLength bytes of glGetProgramBinary output
+} ESProgramCacheHeader;
+
+typedef struct
+{
+   char  name[ES_UNIFORM_NAME_MAX];
+   GLint location;
+} ESUniformEntry;
+
+typedef struct
+{
+   GLuint          programObject;   // 0 for a free entry
+   int             refCount;
+   unsigned int    key[2];          // hash of the source pair
+   char           *vertShaderSrc;   // copies, a hash match is confirmed by comparing them
+   char           *fragShaderSrc;
+   GLboolean       linked;          // GL_FALSE once esFinishProgram found it broken
+   ESUniformEntry  uniforms[ES_PROGRAM_UNIFORM_MAX];
+   int             numUniforms;
+} ESProgramEntry;
+
+typedef struct
+{
+   GLuint       programObject;   // 0 for a free entry
+   GLuint       shaders[2];      // vertex and fragment shader, deleted once the program is finished
+   GLboolean    cacheBinary;     // store the binary in the program cache once linked
+   unsigned int key[2];          // program cache key
+} ESPendingProgram;
+
+typedef void ( GL_APIENTRYP ESMaxShaderCompilerThreadsProc ) ( GLuint count );
+
+///
+//  Globals
+//
+static GLboolean s_programCacheDirSet = GL_FALSE;
+static char      s_programCacheDir[ES_PROGRAM_CACHE_DIR_MAX] = "";
+static ESProgramEntry s_programs[ES_PROGRAM_REGISTRY_MAX];
+static ESPendingProgram s_pendingPrograms[ES_PENDING_PROGRAM_MAX];
+static GLboolean s_parallelCompileChecked = GL_FALSE;
+static GLboolean s_parallelCompile = GL_FALSE;   // GL_KHR_parallel_shader_compile
 
 //////////////////////////////////////////////////////////////////
 //
@@ -46,25 +116,307 @@
 //
 //
 
+///
+//  ProgramCacheDir()
+//
+//    Directory of the program binary cache, NULL when the cache is off.
+//    Unless esSetProgramCacheDir was called it is $ES_PROGRAM_CACHE, or the working directory.
+//
+static const char *ProgramCacheDir ( void )
+{
+   GLint numFormats = 0;
 
+   if ( !s_programCacheDirSet )
+   {
+      const char *env = NULL;
 
-//////////////////////////////////////////////////////////////////
+#ifndef ANDROID
+      env = getenv ( "ES_PROGRAM_CACHE" );
+#endif
+      esSetProgramCacheDir ( ( env != NULL ) ? env : "." );
+   }
+
+   if ( s_programCacheDir[0] == '\0' )
+   {
+      return NULL;
+   }
+
+   // without any binary format glProgramBinary can never succeed
+   glGetIntegerv ( GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats );
+   return ( numFormats > 0 ) ? s_programCacheDir : NULL;
+}
+
+///
+//  HashString()
 //
-//  Public Functions
+//    64 bit FNV-1a of a string including its terminator, so that "ab" + "c" and "a" + "bc" differ
 //
+static void HashString ( unsigned int key[2], const char *str )
+{
+   unsigned long long hash = ( ( unsigned long long ) key[1] << 32 ) | key[0];
+
+   if ( str == NULL )
+   {
+      str = "";
+   }
+
+   do
+   {
+      hash ^= ( unsigned char ) *str;
+      hash *= 0x100000001b3ULL;
+   } while ( *str++ != '\0' );
+
+   key[0] = ( unsigned int ) hash;
+   key[1] = ( unsigned int ) ( hash >> 32 );
+}
+
+///
+//  SourcePairKey()
 //
+static void SourcePairKey ( unsigned int key[2], const char *vertShaderSrc, const char *fragShaderSrc )
+{
+   key[0] = 0x84222325;   // FNV-1a 64 bit offset basis
+   key[1] = 0xcbf29ce4;
 
+   HashString ( key, vertShaderSrc );
+   HashString ( key, fragShaderSrc );
+}
+
+///
+//  CopyString()
 //
+static char *CopyString ( const char *str )
+{
+   char *copy = malloc ( strlen ( str ) + 1 );
+
+   if ( copy != NULL )
+   {
+      strcpy ( copy, str );
+   }
+   return copy;
+}
+
 ///
-/// \brief Load a shader, check for compile errors, print error messages to output log
-/// \param type Type of shader (GL_VERTEX_SHADER or GL_FRAGMENT_SHADER)
-/// \param shaderSrc Shader source string
-/// \return A new shader object on success, 0 on failure
+//  FindProgramEntry()
 //
-GLuint ESUTIL_API esLoadShader ( GLenum type, const char *shaderSrc )
+//    Registry entry of a program, NULL if it was not created by esAcquireProgram
+//
+static ESProgramEntry *FindProgramEntry ( GLuint programObject )
+{
+   int i;
+
+   for ( i = 0; programObject != 0 && i < ES_PROGRAM_REGISTRY_MAX; i++ )
+   {
+      if ( s_programs[i].programObject == programObject )
+      {
+         return &s_programs[i];
+      }
+   }
+   return NULL;
+}
+
+///
+//  ProgramCacheKey()
+//
+//    Key of a program: a binary is only valid for the same sources on the same driver
+//
+static void ProgramCacheKey ( unsigned int key[2], const char *vertShaderSrc, const char *fragShaderSrc )
+{
+   SourcePairKey ( key, vertShaderSrc, fragShaderSrc );
+   HashString ( key, ( const char * ) glGetString ( GL_VENDOR ) );
+   HashString ( key, ( const char * ) glGetString ( GL_RENDERER ) );
+   HashString ( key, ( const char * ) glGetString ( GL_VERSION ) );
+}
+
+///
+//  ProgramCachePath()
+//
+static void ProgramCachePath ( char path[ES_PROGRAM_CACHE_PATH_MAX], const char *dir, const unsigned int key[2] )
+{
+   sprintf ( path, "%s/%08x%08x.esprog", dir, key[1], key[0] );
+}
+
+///
+//  LoadCachedProgram()
+//
+//    Create a program from the cached binary of key, 0 if there is none or the driver refuses it
+//
+static GLuint LoadCachedProgram ( const char *dir, const unsigned int key[2] )
+{
+   char path[ES_PROGRAM_CACHE_PATH_MAX];
+   ESProgramCacheHeader header;
+   FILE *file;
+   void *binary = NULL;
+   GLuint programObject = 0;
+   GLint linked = 0;
+
+   ProgramCachePath ( path, dir, key );
+   file = fopen ( path, "rb" );
+   if ( file == NULL )
+   {
+      return 0;
+   }
+
+   if ( fread ( &header, sizeof ( header ), 1, file ) == 1 &&
+         header.magic == ES_PROGRAM_CACHE_MAGIC && header.version == ES_PROGRAM_CACHE_VERSION &&
+         header.key[0] == key[0] && header.key[1] == key[1] &&
+         header.binaryLength > 0 && header.binaryLength <= ES_PROGRAM_CACHE_BINARY_MAX )
+   {
+      binary = malloc ( header.binaryLength );
+      if ( binary != NULL && fread ( binary, header.binaryLength, 1, file ) != 1 )
+      {
+         free ( binary );
+         binary = NULL;
+      }
+   }
+   fclose ( file );
+
+   if ( binary == NULL )
+   {
+      esLogMessage ( "Program cache: %s is damaged, recompiling\n", path );
+      return 0;
+   }
+
+   programObject = glCreateProgram ( );
+   if ( programObject != 0 )
+   {
+      glProgramBinary ( programObject, header.binaryFormat, binary, header.binaryLength );
+      glGetProgramiv ( programObject, GL_LINK_STATUS, &linked );
+
+      if ( !linked )
+      {
+         // the driver was updated without changing its version strings, or dropped the format
+         esLogMessage ( "Program cache: %s was rejected by the driver, recompiling\n", path );
+         glDeleteProgram ( programObject );
+         programObject = 0;
+
+         // a format the driver does not know is reported as GL_INVALID_ENUM
+         while ( glGetError ( ) != GL_NO_ERROR );
+      }
+   }
+
+   free ( binary );
+   return programObject;
+}
+
+///
+//  SaveCachedProgram()
+//
+//    Store the binary of a linked program, written to a temporary file first so that
+//    an interrupted write never leaves a damaged cache entry behind
+//
+static void SaveCachedProgram ( const char *dir, const unsigned int key[2], GLuint programObject )
+{
+   char path[ES_PROGRAM_CACHE_PATH_MAX];
+   char tempPath[ES_PROGRAM_CACHE_PATH_MAX + 4];
+   ESProgramCacheHeader header;
+   FILE *file;
+   void *binary;
+   GLboolean written = GL_FALSE;
+
+   memset ( &header, 0, sizeof ( header ) );
+   glGetProgramiv ( programObject, GL_PROGRAM_BINARY_LENGTH, &header.binaryLength );
+   if ( header.binaryLength <= 0 || header.binaryLength > ES_PROGRAM_CACHE_BINARY_MAX )
+   {
+      return;
+   }
+
+   binary = malloc ( header.binaryLength );
+   if ( binary == NULL )
+   {
+      return;
+   }
+   glGetProgramBinary ( programObject, header.binaryLength, &header.binaryLength, &header.binaryFormat, binary );
+
+   header.magic = ES_PROGRAM_CACHE_MAGIC;
+   header.version = ES_PROGRAM_CACHE_VERSION;
+   header.key[0] = key[0];
+   header.key[1] = key[1];
+
+   ProgramCachePath ( path, dir, key );
+   sprintf ( tempPath, "%s.tmp", path );
+
+   file = fopen ( tempPath, "wb" );
+   if ( file != NULL )
+   {
+      written = ( header.binaryLength > 0 &&
+                  fwrite ( &header, sizeof ( header ), 1, file ) == 1 &&
+                  fwrite ( binary, header.binaryLength, 1, file ) == 1 ) ? GL_TRUE : GL_FALSE;
+      if ( fclose ( file ) != 0 )
+      {
+         written = GL_FALSE;
+      }
+
+      // rename does not replace an existing file on Windows
+      remove ( path );
+      if ( !written || rename ( tempPath, path ) != 0 )
+      {
+         esLogMessage ( "Program cache: can not write %s\n", path );
+         remove ( tempPath );
+      }
+   }
+
+   free ( binary );
+}
+
+///
+//  HasGLExtension()
+//
+//    Check whether the extension is in the extension list of the current context
+//
+static GLboolean HasGLExtension ( const char *name )
+{
+   GLint numExtensions = 0;
+   GLint i;
+
+   glGetIntegerv ( GL_NUM_EXTENSIONS, &numExtensions );
+   for ( i = 0; i < numExtensions; i++ )
+   {
+      const char *extension = ( const char * ) glGetStringi ( GL_EXTENSIONS, i );
+
+      if ( extension != NULL && strcmp ( extension, name ) == 0 )
+      {
+         return GL_TRUE;
+      }
+   }
+   return GL_FALSE;
+}
+
+///
+//  CheckParallelCompile()
+//
+//    Look for GL_KHR_parallel_shader_compile once, and let the driver use as many
+//    compiler threads as it likes
+//
+static void CheckParallelCompile ( void )
+{
+   ESMaxShaderCompilerThreadsProc maxShaderCompilerThreads;
+
+   if ( s_parallelCompileChecked )
+   {
+      return;
+   }
+   s_parallelCompileChecked = GL_TRUE;
+
+   s_parallelCompile = HasGLExtension ( "GL_KHR_parallel_shader_compile" );
+   if ( s_parallelCompile )
+   {
+      maxShaderCompilerThreads = ( ESMaxShaderCompilerThreadsProc ) eglGetProcAddress ( "glMaxShaderCompilerThreadsKHR" );
+      if ( maxShaderCompilerThreads != NULL )
+      {
+         maxShaderCompilerThreads ( 0xFFFFFFFF );
+      }
+   }
+}
+
+///
+//  SubmitShader()
+//
+//    Create and compile a shader without waiting for the compiler
+//
+static GLuint SubmitShader ( GLenum type, const char *shaderSrc )
 {
    GLuint shader;
-   GLint compiled;
 
    // Create the shader object
    shader = glCreateShader ( type );
@@ -80,6 +432,18 @@ GLuint ESUTIL_API esLoadShader ( GLenum type, const char *shaderSrc )
    // Compile the shader
    glCompileShader ( shader );
 
+   return shader;
+}
+
+///
+//  ShaderCompiled()
+//
+//    Wait for the compile status of a shader, print the error messages to the log
+//
+static GLboolean ShaderCompiled ( GLuint shader )
+{
+   GLint compiled;
+
    // Check the compile status
    glGetShaderiv ( shader, GL_COMPILE_STATUS, &compiled );
 
@@ -99,86 +463,553 @@ GLuint ESUTIL_API esLoadShader ( GLenum type, const char *shaderSrc )
          free ( infoLog );
       }
 
+      return GL_FALSE;
+   }
+
+   return GL_TRUE;
+}
+
+///
+//  SubmitProgram()
+//
+//    Compile and link a program without querying any status, so that the driver can
+//    work on it in the background.  shaders receives the vertex and fragment shader.
+//
+static GLuint SubmitProgram ( const char *vertShaderSrc, const char *fragShaderSrc, GLboolean retrievable, GLuint shaders[2] )
+{
+   GLuint programObject;
+
+   // Load the vertex/fragment shaders
+   shaders[0] = SubmitShader ( GL_VERTEX_SHADER, vertShaderSrc );
+   shaders[1] = SubmitShader ( GL_FRAGMENT_SHADER, fragShaderSrc );
+
+   // Create the program object
+   programObject = ( shaders[0] != 0 && shaders[1] != 0 ) ? glCreateProgram ( ) : 0;
+
+   if ( programObject == 0 )
+   {
+      glDeleteShader ( shaders[0] );
+      glDeleteShader ( shaders[1] );
+      return 0;
+   }
+
+   glAttachShader ( programObject, shaders[0] );
+   glAttachShader ( programObject, shaders[1] );
+
+   if ( retrievable )
+   {
+      glProgramParameteri ( programObject, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE );
+   }
+
+   // Link the program
+   glLinkProgram ( programObject );
+
+   return programObject;
+}
+
+///
+//  FinishProgram()
+//
+//    Wait for a submitted program, print compile and link errors to the log.
+//    The shaders are deleted, the program is left to the caller.
+//
+static GLboolean FinishProgram ( GLuint programObject, const GLuint shaders[2] )
+{
+   GLint linked = GL_FALSE;
+
+   if ( ShaderCompiled ( shaders[0] ) && ShaderCompiled ( shaders[1] ) )
+   {
+      // Check the link status
+      glGetProgramiv ( programObject, GL_LINK_STATUS, &linked );
+
+      if ( !linked )
+      {
+         GLint infoLen = 0;
+
+         glGetProgramiv ( programObject, GL_INFO_LOG_LENGTH, &infoLen );
+
+         if ( infoLen > 1 )
+         {
+            char *infoLog = malloc ( sizeof ( char ) * infoLen );
+
+            glGetProgramInfoLog ( programObject, infoLen, NULL, infoLog );
+            esLogMessage ( "Error linking program:\n%s\n", infoLog );
+
+            free ( infoLog );
+         }
+      }
+   }
+
+   // Free up no longer needed shader resources
+   glDeleteShader ( shaders[0] );
+   glDeleteShader ( shaders[1] );
+
+   return linked ? GL_TRUE : GL_FALSE;
+}
+
+///
+//  CompileProgram()
+//
+//    Compile and link a program from source, with its binary retrievable for the cache
+//
+static GLuint CompileProgram ( const char *vertShaderSrc, const char *fragShaderSrc, GLboolean retrievable )
+{
+   GLuint shaders[2];
+   GLuint programObject = SubmitProgram ( vertShaderSrc, fragShaderSrc, retrievable, shaders );
+
+   if ( programObject == 0 )
+   {
+      return 0;
+   }
+
+   if ( !FinishProgram ( programObject, shaders ) )
+   {
+      glDeleteProgram ( programObject );
+      return 0;
+   }
+
+   return programObject;
+}
+
+///
+//  FindPendingProgram()
+//
+static ESPendingProgram *FindPendingProgram ( GLuint programObject )
+{
+   int i;
+
+   for ( i = 0; programObject != 0 && i < ES_PENDING_PROGRAM_MAX; i++ )
+   {
+      if ( s_pendingPrograms[i].programObject == programObject )
+      {
+         return &s_pendingPrograms[i];
+      }
+   }
+   return NULL;
+}
+
+///
+//  ForgetPendingProgram()
+//
+//    A program deleted before it was finished, free its shaders and its pending entry
+//
+static void ForgetPendingProgram ( GLuint programObject )
+{
+   ESPendingProgram *pending = FindPendingProgram ( programObject );
+
+   if ( pending != NULL )
+   {
+      glDeleteShader ( pending->shaders[0] );
+      glDeleteShader ( pending->shaders[1] );
+      memset ( pending, 0, sizeof ( ESPendingProgram ) );
+   }
+}
+
+//////////////////////////////////////////////////////////////////
+//
+//  Public Functions
+//
+//
+
+//
+///
+/// \brief Load a shader, check for compile errors, print error messages to output log
+/// \param type Type of shader (GL_VERTEX_SHADER or GL_FRAGMENT_SHADER)
+/// \param shaderSrc Shader source string
+/// \return A new shader object on success, 0 on failure
+//
+GLuint ESUTIL_API esLoadShader ( GLenum type, const char *shaderSrc )
+{
+   GLuint shader = SubmitShader ( type, shaderSrc );
+
+   if ( shader != 0 && !ShaderCompiled ( shader ) )
+   {
       glDeleteShader ( shader );
       return 0;
    }
 
    return shader;
-
 }
 
+//
+///
+/// \brief Set the directory of the program binary cache
+/// \param dir Existing directory, NULL or "" turns the cache off
+//
+void ESUTIL_API esSetProgramCacheDir ( const char *dir )
+{
+   s_programCacheDirSet = GL_TRUE;
+   s_programCacheDir[0] = '\0';
+
+   if ( dir != NULL && strlen ( dir ) < ES_PROGRAM_CACHE_DIR_MAX )
+   {
+      strcpy ( s_programCacheDir, dir );
+   }
+   else if ( dir != NULL )
+   {
+      esLogMessage ( "Program cache: directory name too long, cache off\n" );
+   }
+}
 
 //
 ///
 /// \brief Load a vertex and fragment shader, create a program object, link program.
-//         Errors output to log.
+//         Errors output to log.  The linked program is kept in the program binary cache,
+//         the next load with the same sources on the same driver skips compiling.
 /// \param vertShaderSrc Vertex shader source code
 /// \param fragShaderSrc Fragment shader source code
 /// \return A new program object linked with the vertex/fragment shader pair, 0 on failure
 //
 GLuint ESUTIL_API esLoadProgram ( const char *vertShaderSrc, const char *fragShaderSrc )
 {
-   GLuint vertexShader;
-   GLuint fragmentShader;
+   const char *cacheDir = ProgramCacheDir ( );
+   unsigned int key[2];
    GLuint programObject;
-   GLint linked;
 
-   // Load the vertex/fragment shaders
-   vertexShader = esLoadShader ( GL_VERTEX_SHADER, vertShaderSrc );
-
-   if ( vertexShader == 0 )
+   if ( cacheDir == NULL )
    {
-      return 0;
+      return CompileProgram ( vertShaderSrc, fragShaderSrc, GL_FALSE );
    }
 
-   fragmentShader = esLoadShader ( GL_FRAGMENT_SHADER, fragShaderSrc );
+   ProgramCacheKey ( key, vertShaderSrc, fragShaderSrc );
+   programObject = LoadCachedProgram ( cacheDir, key );
+   if ( programObject != 0 )
+   {
+      return programObject;
+   }
 
-   if ( fragmentShader == 0 )
+   programObject = CompileProgram ( vertShaderSrc, fragShaderSrc, GL_TRUE );
+   if ( programObject != 0 )
    {
-      glDeleteShader ( vertexShader );
-      return 0;
+      SaveCachedProgram ( cacheDir, key, programObject );
    }
 
-   // Create the program object
-   programObject = glCreateProgram ( );
+   return programObject;
+}
 
-   if ( programObject == 0 )
+//
+///
+/// \brief Start loading a program without waiting for the compiler.  The shaders are compiled and
+///        linked by the driver in the background where GL_KHR_parallel_shader_compile is supported,
+///        so that several programs and the rest of the loading overlap.  A program in the program
+///        binary cache is restored at once.
+/// \param vertShaderSrc Vertex shader source code
+/// \param fragShaderSrc Fragment shader source code
+/// \return The program object, 0 on failure.  Call esFinishProgram before its first use.
+//
+GLuint ESUTIL_API esLoadProgramAsync ( const char *vertShaderSrc, const char *fragShaderSrc )
+{
+   const char *cacheDir = ProgramCacheDir ( );
+   ESPendingProgram *pending = NULL;
+   unsigned int key[2] = { 0, 0 };
+   GLuint programObject;
+   int i;
+
+   CheckParallelCompile ( );
+
+   if ( cacheDir != NULL )
    {
-      return 0;
+      ProgramCacheKey ( key, vertShaderSrc, fragShaderSrc );
+      programObject = LoadCachedProgram ( cacheDir, key );
+      if ( programObject != 0 )
+      {
+         return programObject;
+      }
    }
 
-   glAttachShader ( programObject, vertexShader );
-   glAttachShader ( programObject, fragmentShader );
+   for ( i = 0; i < ES_PENDING_PROGRAM_MAX && pending == NULL; i++ )
+   {
+      if ( s_pendingPrograms[i].programObject == 0 )
+      {
+         pending = &s_pendingPrograms[i];
+      }
+   }
+   if ( pending == NULL )
+   {
+      // too many programs in flight, this one is loaded right away
+      return esLoadProgram ( vertShaderSrc, fragShaderSrc );
+   }
 
-   // Link the program
-   glLinkProgram ( programObject );
+   programObject = SubmitProgram ( vertShaderSrc, fragShaderSrc, cacheDir != NULL, pending->shaders );
+   if ( programObject != 0 )
+   {
+      pending->programObject = programObject;
+      pending->cacheBinary = ( cacheDir != NULL ) ? GL_TRUE : GL_FALSE;
+      pending->key[0] = key[0];
+      pending->key[1] = key[1];
+   }
 
-   // Check the link status
-   glGetProgramiv ( programObject, GL_LINK_STATUS, &linked );
+   return programObject;
+}
 
-   if ( !linked )
+//
+///
+/// \brief Check without blocking whether a program of esLoadProgramAsync is compiled and linked.
+///        Without GL_KHR_parallel_shader_compile the driver can not tell, it is always GL_TRUE.
+/// \param programObject Program object
+/// \return GL_TRUE if esFinishProgram does not wait for the driver
+//
+GLboolean ESUTIL_API esProgramReady ( GLuint programObject )
+{
+   ESPendingProgram *pending = FindPendingProgram ( programObject );
+   GLint completed = GL_TRUE;
+
+   if ( pending != NULL && s_parallelCompile )
    {
-      GLint infoLen = 0;
+      glGetProgramiv ( programObject, GL_COMPLETION_STATUS_KHR, &completed );
+   }
 
-      glGetProgramiv ( programObject, GL_INFO_LOG_LENGTH, &infoLen );
+   return completed ? GL_TRUE : GL_FALSE;
+}
 
-      if ( infoLen > 1 )
+//
+///
+/// \brief Wait for a program of esLoadProgramAsync or esAcquireProgram, print compile and link errors
+///        to the log.  Finishing a program again, or one that was loaded at once, only returns its status.
+/// \param programObject Program object
+/// \return GL_TRUE if the program is linked.  GL_FALSE if it failed, it is deleted then, except a
+///         registry program which is deleted by its last esReleaseProgram.
+//
+GLboolean ESUTIL_API esFinishProgram ( GLuint programObject )
+{
+   ESPendingProgram *pending = FindPendingProgram ( programObject );
+   ESProgramEntry *entry = FindProgramEntry ( programObject );
+   GLboolean linked;
+
+   if ( pending == NULL )
+   {
+      if ( entry != NULL )
       {
-         char *infoLog = malloc ( sizeof ( char ) * infoLen );
+         return entry->linked;
+      }
+      return ( programObject != 0 && glIsProgram ( programObject ) ) ? GL_TRUE : GL_FALSE;
+   }
 
-         glGetProgramInfoLog ( programObject, infoLen, NULL, infoLog );
-         esLogMessage ( "Error linking program:\n%s\n", infoLog );
+   linked = FinishProgram ( programObject, pending->shaders );
+   if ( linked && pending->cacheBinary )
+   {
+      SaveCachedProgram ( ProgramCacheDir ( ), pending->key, programObject );
+   }
+   memset ( pending, 0, sizeof ( ESPendingProgram ) );
 
-         free ( infoLog );
+   if ( entry != NULL )
+   {
+      // every user of the shared program gets the same answer
+      entry->linked = linked;
+   }
+   else if ( !linked )
+   {
+      glDeleteProgram ( programObject );
+   }
+
+   return linked;
+}
+
+//
+///
+/// \brief Get a program from the program registry: sources that were already linked give the same
+///        program object with its reference count increased instead of a new program.
+///        The sources are compared, not the pointers.  A new program is loaded like with
+///        esLoadProgramAsync, call esFinishProgram before its first use.
+/// \param vertShaderSrc Vertex shader source code
+/// \param fragShaderSrc Fragment shader source code
+/// \return The shared program object, 0 on failure.  Give it back with esReleaseProgram.
+//
+GLuint ESUTIL_API esAcquireProgram ( const char *vertShaderSrc, const char *fragShaderSrc )
+{
+   ESProgramEntry *entry = NULL;
+   unsigned int key[2];
+   int i;
+
+   SourcePairKey ( key, vertShaderSrc, fragShaderSrc );
+
+   for ( i = 0; i < ES_PROGRAM_REGISTRY_MAX; i++ )
+   {
+      ESProgramEntry *pEntry = &s_programs[i];
+
+      if ( pEntry->programObject == 0 )
+      {
+         if ( entry == NULL )
+         {
+            entry = pEntry;
+         }
+      }
+      else if ( pEntry->key[0] == key[0] && pEntry->key[1] == key[1] &&
+                strcmp ( pEntry->vertShaderSrc, vertShaderSrc ) == 0 &&
+                strcmp ( pEntry->fragShaderSrc, fragShaderSrc ) == 0 )
+      {
+         pEntry->refCount++;
+         return pEntry->programObject;
       }
+   }
 
-      glDeleteProgram ( programObject );
+   if ( entry == NULL )
+   {
+      // registry full, the program works but is not shared
+      esLogMessage ( "esAcquireProgram: more than %d programs, not shared\n", ES_PROGRAM_REGISTRY_MAX );
+      return esLoadProgramAsync ( vertShaderSrc, fragShaderSrc );
+   }
+
+   entry->vertShaderSrc = CopyString ( vertShaderSrc );
+   entry->fragShaderSrc = CopyString ( fragShaderSrc );
+   if ( entry->vertShaderSrc == NULL || entry->fragShaderSrc == NULL )
+   {
+      free ( entry->vertShaderSrc );
+      free ( entry->fragShaderSrc );
+      memset ( entry, 0, sizeof ( ESProgramEntry ) );
+      return esLoadProgramAsync ( vertShaderSrc, fragShaderSrc );
+   }
+
+   entry->programObject = esLoadProgramAsync ( vertShaderSrc, fragShaderSrc );
+   if ( entry->programObject == 0 )
+   {
+      free ( entry->vertShaderSrc );
+      free ( entry->fragShaderSrc );
+      memset ( entry, 0, sizeof ( ESProgramEntry ) );
       return 0;
    }
 
-   // Free up no longer needed shader resources
-   glDeleteShader ( vertexShader );
-   glDeleteShader ( fragmentShader );
+   entry->refCount = 1;
+   entry->key[0] = key[0];
+   entry->key[1] = key[1];
+   entry->linked = GL_TRUE;
+   entry->numUniforms = 0;
+
+   return entry->programObject;
+}
+
+//
+///
+/// \brief Give back a program of esAcquireProgram, it is deleted with its last reference.
+///        A program not from the registry is deleted at once.
+/// \param programObject Program object
+//
+void ESUTIL_API esReleaseProgram ( GLuint programObject )
+{
+   ESProgramEntry *entry = FindProgramEntry ( programObject );
+
+   if ( entry != NULL && --entry->refCount > 0 )
+   {
+      return;
+   }
+
+   ForgetPendingProgram ( programObject );
+   esStateForgetProgram ( programObject );
+   glDeleteProgram ( programObject );
+
+   if ( entry != NULL )
+   {
+      free ( entry->vertShaderSrc );
+      free ( entry->fragShaderSrc );
+      memset ( entry, 0, sizeof ( ESProgramEntry ) );
+   }
+}
+
+//
+///
+/// \brief glGetUniformLocation with the locations of registry programs cached, every user of a
+///        shared program looks its uniforms up without a driver call after the first one
+/// \param programObject Program object
+/// \param name Uniform name
+/// \return Uniform location, -1 if the program has no such active uniform
+//
+GLint ESUTIL_API esGetUniformLocation ( GLuint programObject, const char *name )
+{
+   ESProgramEntry *entry = FindProgramEntry ( programObject );
+   GLint location;
+   int i;
+
+   if ( entry == NULL || strlen ( name ) >= ES_UNIFORM_NAME_MAX )
+   {
+      return glGetUniformLocation ( programObject, name );
+   }
 
+   for ( i = 0; i < entry->numUniforms; i++ )
+   {
+      if ( strcmp ( entry->uniforms[i].name, name ) == 0 )
+      {
+         return entry->uniforms[i].location;
+      }
+   }
+
+   location = glGetUniformLocation ( programObject, name );
+   if ( entry->numUniforms < ES_PROGRAM_UNIFORM_MAX )
+   {
+      strcpy ( entry->uniforms[entry->numUniforms].name, name );
+      entry->uniforms[entry->numUniforms].location = location;
+      entry->numUniforms++;
+   }
+
+   return location;
+}
+
+//
+///
+/// \brief Compose a shader source: the version line, a #define line for each feature, then the chunks.
+///        Chunks are shared pieces of GLSL without a version line, they select code with #ifdef.
+/// \param chunks NULL terminated list of source chunks
+/// \param defines NULL terminated list of defines like "GRASS" or "LIGHT_NUM 4", may be NULL
+/// \return The source, free it with free(), NULL if out of memory
+//
+char *ESUTIL_API esComposeShader ( const char *const *chunks, const char *const *defines )
+{
+   size_t length = strlen ( ES_SHADER_VERSION_STR ) + 1;
+   char *source;
+   char *pos;
+   int i;
+
+   for ( i = 0; defines != NULL && defines[i] != NULL; i++ )
+   {
+      length += strlen ( "#define \n" ) + strlen ( defines[i] );
+   }
+   for ( i = 0; chunks[i] != NULL; i++ )
+   {
+      length += strlen ( chunks[i] );
+   }
+
+   source = malloc ( length );
+   if ( source == NULL )
+   {
+      return NULL;
+   }
+
+   pos = source + sprintf ( source, "%s", ES_SHADER_VERSION_STR );
+   for ( i = 0; defines != NULL && defines[i] != NULL; i++ )
+   {
+      pos += sprintf ( pos, "#define %s\n", defines[i] );
+   }
+   for ( i = 0; chunks[i] != NULL; i++ )
+   {
+      strcpy ( pos, chunks[i] );
+      pos += strlen ( chunks[i] );
+   }
+
+   return source;
+}
+
+//
+///
+/// \brief Get the program of a shader variant from the program registry.  Both sources are composed
+///        with esComposeShader from the same defines, a variant is compiled the first time it is asked for
+///        and shared afterwards.  Call esFinishProgram before its first use, give it back with esReleaseProgram.
+/// \param vertChunks NULL terminated list of vertex shader chunks
+/// \param fragChunks NULL terminated list of fragment shader chunks
+/// \param defines NULL terminated list of defines selecting the variant, may be NULL
+/// \return The shared program object, 0 on failure
+//
+GLuint ESUTIL_API esAcquireProgramVariant ( const char *const *vertChunks, const char *const *fragChunks,
+                                            const char *const *defines )
+{
+   char *vertShaderSrc = esComposeShader ( vertChunks, defines );
+   char *fragShaderSrc = esComposeShader ( fragChunks, defines );
+   GLuint programObject = 0;
+
+   if ( vertShaderSrc != NULL && fragShaderSrc != NULL )
+   {
+      programObject = esAcquireProgram ( vertShaderSrc, fragShaderSrc );
+   }
+
+   free ( vertShaderSrc );
+   free ( fragShaderSrc );
    return programObject;
-}
\ No newline at end of file
+}
@@ -0,0 +1,812 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2013 Dan Ginsburg, Budirijanto Purnomo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+//
+// Book:      OpenGL(R) ES 3.0 Programming Guide, 2nd Edition
+// Authors:   Dan Ginsburg, Budirijanto Purnomo, Dave Shreiner, Aaftab Munshi
+// ISBN-10:   0-321-93388-5
+// ISBN-13:   978-0-321-93388-1
+// Publisher: Addison-Wesley Professional
+// URLs:      http://www.opengles-book.com
+//            http://my.safaribooksonline.com/book/animation-and-3d/9780133440133
+//
+//
+// ESTexture.c
+//
+//    Image decoding, the texture container of the esTexConv tool and a
+//    texture loader that decodes on the job pool while the GL thread keeps
+//    running, then uploads under a time budget.
+//
+
+///
+//  Includes
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esUtil.h"
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+///
+//  Types
+//
+typedef struct ESTextureJob
+{
+   struct ESTextureJob *next;       // link in the decoded and ready lists
+   ESTextureLoader     *loader;
+   ESTextureRequest    *request;
+   GLuint               texture;
+   GLboolean            mipmap;
+   char                *fileName;
+   ESImage              image;
+   ESTextureFile        container;    // read instead of the image when it is mapped
+} ESTextureJob;
+
+struct ESTextureLoader
+{
+   ESJobPool         *pool;
+   ESJobGroup         group;
+
+   // jobs pushed by the workers once decoded, newest first, the GL thread takes the whole list
+   void *volatile     decoded;
+
+   // decoded jobs waiting for the upload in decode order, GL thread only
+   ESTextureJob      *readyHead;
+   ESTextureJob      *readyTail;
+   int                pending;      // requested and not uploaded yet
+};
+
+typedef struct
+{
+   const char        *fileName;
+   int                forceChannels;
+   ESImage           *image;
+} ESImageJob;
+
+//////////////////////////////////////////////////////////////////
+//
+//  Private Functions
+//
+//
+
+///
+//  DecodeImage()
+//
+//    stb_image keeps no state between calls apart from the failure
+//    reason, so several workers can decode at the same time.  The file
+//    is decoded from its mapping, without reading it through stdio.
+//
+static GLboolean DecodeImage ( const char *fileName, int forceChannels, ESImage *image )
+{
+   ESFileMap map;
+   int channels = 0;
+
+   if ( !esFileMap ( NULL, fileName, &map ) )
+   {
+      return GL_FALSE;
+   }
+
+   image->pixels = ( map.size <= 0x7fffffff ) ?
+                   stbi_load_from_memory ( map.data, ( int ) map.size, &image->width, &image->height, &channels, forceChannels ) : NULL;
+   esFileUnmap ( &map );
+
+   if ( image->pixels == NULL )
+   {
+      return GL_FALSE;
+   }
+
+   image->channels = ( forceChannels != 0 ) ? forceChannels : channels;
+   return GL_TRUE;
+}
+
+///
+//  DecodeImageJob()
+//
+static void DecodeImageJob ( void *arg )
+{
+   ESImageJob *job = ( ESImageJob * ) arg;
+
+   esImageLoad ( job->fileName, job->forceChannels, job->image );
+}
+
+///
+//  FormatChannels()
+//
+//    Channels of the uncompressed formats a texture container may hold, 0 for any other
+//
+static int FormatChannels ( GLenum format, GLenum type )
+{
+   if ( type != GL_UNSIGNED_BYTE )
+   {
+      return 0;
+   }
+
+   switch ( format )
+   {
+      case GL_RED:
+         return 1;
+      case GL_RG:
+         return 2;
+      case GL_RGB:
+         return 3;
+      case GL_RGBA:
+         return 4;
+      default:
+         return 0;
+   }
+}
+
+///
+//  CompressedBlockBytes()
+//
+//    Bytes of a 4x4 block of the ETC2 and EAC formats every ES 3.0 device
+//    decodes, 0 for any other format
+//
+static int CompressedBlockBytes ( GLenum internalFormat, int *channels )
+{
+   switch ( internalFormat )
+   {
+      case GL_COMPRESSED_R11_EAC:
+      case GL_COMPRESSED_SIGNED_R11_EAC:
+         *channels = 1;
+         return 8;
+      case GL_COMPRESSED_RG11_EAC:
+      case GL_COMPRESSED_SIGNED_RG11_EAC:
+         *channels = 2;
+         return 16;
+      case GL_COMPRESSED_RGB8_ETC2:
+      case GL_COMPRESSED_SRGB8_ETC2:
+         *channels = 3;
+         return 8;
+      case GL_COMPRESSED_RGB8_PUNCHTHROUGH_ALPHA1_ETC2:
+      case GL_COMPRESSED_SRGB8_PUNCHTHROUGH_ALPHA1_ETC2:
+         *channels = 4;
+         return 8;
+      case GL_COMPRESSED_RGBA8_ETC2_EAC:
+      case GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC:
+         *channels = 4;
+         return 16;
+      default:
+         *channels = 0;
+         return 0;
+   }
+}
+
+///
+//  HeaderChannels()
+//
+//    Channels of the texture in a container, 0 if its format is not supported,
+//    a compressed texture has neither format nor type
+//
+static int HeaderChannels ( const ESTextureFileHeader *header )
+{
+   int channels = 0;
+
+   if ( header->format == 0 && header->type == 0 )
+   {
+      CompressedBlockBytes ( header->internalFormat, &channels );
+      return channels;
+   }
+
+   return FormatChannels ( header->format, header->type );
+}
+
+///
+//  LevelSize()
+//
+//    Bytes of a level of the texture in a container, in 64 bits so that
+//    no header makes it wrap
+//
+static unsigned long long LevelSize ( const ESTextureFileHeader *header, unsigned int width, unsigned int height )
+{
+   int channels = 0;
+   int blockBytes;
+
+   if ( header->format != 0 || header->type != 0 )
+   {
+      return ( unsigned long long ) width * height * FormatChannels ( header->format, header->type );
+   }
+
+   blockBytes = CompressedBlockBytes ( header->internalFormat, &channels );
+   return ( unsigned long long ) ( ( width + 3 ) / 4 ) * ( ( height + 3 ) / 4 ) * blockBytes;
+}
+
+///
+//  MaxLevelCount()
+//
+//    Levels of a full mipmap chain, down to 1x1
+//
+static unsigned int MaxLevelCount ( unsigned int width, unsigned int height )
+{
+   unsigned int size = ( width > height ) ? width : height;
+   unsigned int count = 1;
+
+   while ( size > 1 )
+   {
+      size /= 2;
+      count++;
+   }
+
+   return count;
+}
+
+///
+//  ContainerFileName()
+//
+//    Name of the texture container that replaces an image file, the
+//    extension is appended so that "a.png" and "a.jpg" do not collide
+//
+static char *ContainerFileName ( const char *fileName )
+{
+   size_t length = strlen ( fileName );
+   char *name = ( char * ) malloc ( length + sizeof ( ES_TEXTURE_FILE_EXT ) );
+
+   if ( name != NULL )
+   {
+      memcpy ( name, fileName, length );
+      strcpy ( name + length, ES_TEXTURE_FILE_EXT );
+   }
+
+   return name;
+}
+
+///
+//  DecodeTextureJob()
+//
+//    Runs on a worker, the decoded job is pushed without a lock so
+//    that the GL thread never waits for a worker
+//
+static void DecodeTextureJob ( void *arg )
+{
+   ESTextureJob *job = ( ESTextureJob * ) arg;
+   ESTextureLoader *loader = job->loader;
+   char *containerName = ContainerFileName ( job->fileName );
+   void *head = NULL;
+   void *prev;
+
+   // a converted container needs no decode, the image is the fallback
+   if ( containerName == NULL || !esTextureFileLoad ( containerName, &job->container ) )
+   {
+      DecodeImage ( job->fileName, 0, &job->image );
+   }
+   free ( containerName );
+
+   for ( ;; )
+   {
+      job->next = ( ESTextureJob * ) head;
+      prev = esAtomicCompareExchangePointer ( &loader->decoded, head, job );
+
+      if ( prev == head )
+      {
+         break;
+      }
+
+      head = prev;
+   }
+}
+
+///
+//  TakeDecoded()
+//
+//    Move the jobs decoded so far to the end of the ready list, oldest first
+//
+static void TakeDecoded ( ESTextureLoader *loader )
+{
+   ESTextureJob *job = ( ESTextureJob * ) esAtomicExchangePointer ( &loader->decoded, NULL );
+   ESTextureJob *oldest = NULL;
+
+   while ( job != NULL )
+   {
+      ESTextureJob *next = job->next;
+
+      job->next = oldest;
+      oldest = job;
+      job = next;
+   }
+
+   if ( oldest == NULL )
+   {
+      return;
+   }
+
+   if ( loader->readyTail != NULL )
+   {
+      loader->readyTail->next = oldest;
+   }
+   else
+   {
+      loader->readyHead = oldest;
+   }
+
+   while ( oldest->next != NULL )
+   {
+      oldest = oldest->next;
+   }
+
+   loader->readyTail = oldest;
+}
+
+///
+//  FreeTextureJob()
+//
+static void FreeTextureJob ( ESTextureJob *job )
+{
+   esImageFree ( &job->image );
+   esTextureFileFree ( &job->container );
+   free ( job->fileName );
+   free ( job );
+}
+
+///
+//  UploadTexture()
+//
+static void UploadTexture ( ESTextureJob *job )
+{
+   ESTextureRequest *request = job->request;
+   ESImage *image = &job->image;
+   GLenum format;
+
+   if ( job->container.map.data != NULL )
+   {
+      const ESTextureFileHeader *header = &job->container.header;
+
+      esStateEditTexture ( 0, GL_TEXTURE_2D, job->texture );
+      glTexParameteri ( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, ( HeaderChannels ( header ) == 4 ) ? GL_CLAMP_TO_EDGE : GL_REPEAT );
+      glTexParameteri ( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, ( HeaderChannels ( header ) == 4 ) ? GL_CLAMP_TO_EDGE : GL_REPEAT );
+      glTexParameteri ( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
+      glTexParameteri ( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+
+      if ( esTextureFileUpload ( &job->container ) )
+      {
+         // compressed levels cannot be generated, the converter stores them
+         if ( job->mipmap && header->levelCount == 1 && header->format != 0 )
+         {
+            glGenerateMipmap ( GL_TEXTURE_2D );
+         }
+
+         request->width = header->width;
+         request->height = header->height;
+         request->channels = HeaderChannels ( header );
+         request->premultiplied = ( header->flags & ES_TEXTURE_FILE_PREMULTIPLIED ) ? GL_TRUE : GL_FALSE;
+         esLogMessage ( "%s: %u levels from the container\n", job->fileName, header->levelCount );
+      }
+      else
+      {
+         esLogMessage ( "Failed to upload texture: %s\n", job->fileName );
+         request->failed = GL_TRUE;
+      }
+
+      request->ready = GL_TRUE;
+      FreeTextureJob ( job );
+      return;
+   }
+
+   if ( image->pixels == NULL )
+   {
+      esLogMessage ( "Failed to load texture: %s\n", job->fileName );
+      request->failed = GL_TRUE;
+      request->ready = GL_TRUE;
+      FreeTextureJob ( job );
+      return;
+   }
+
+   switch ( image->channels )
+   {
+      case 1:
+         format = GL_RED;
+         break;
+      case 2:
+         format = GL_RG;
+         break;
+      case 4:
+         format = GL_RGBA;
+         break;
+      default:
+         format = GL_RGB;
+         break;
+   }
+
+   // through the state tracker, the binding it knows for unit 0 stays right
+   esStateEditTexture ( 0, GL_TEXTURE_2D, job->texture );
+   glTexParameteri ( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, ( format == GL_RGBA ) ? GL_CLAMP_TO_EDGE : GL_REPEAT );
+   glTexParameteri ( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, ( format == GL_RGBA ) ? GL_CLAMP_TO_EDGE : GL_REPEAT );
+   glTexParameteri ( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
+   glTexParameteri ( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+   glTexImage2D ( GL_TEXTURE_2D, 0, format, image->width, image->height, 0, format, GL_UNSIGNED_BYTE, image->pixels );
+
+   if ( job->mipmap )
+   {
+      glGenerateMipmap ( GL_TEXTURE_2D );
+   }
+
+   esLogMessage ( "%s: nrChannels = %d\n", job->fileName, image->channels );
+
+   request->width = image->width;
+   request->height = image->height;
+   request->channels = image->channels;
+   request->ready = GL_TRUE;
+   FreeTextureJob ( job );
+}
+
+//////////////////////////////////////////////////////////////////
+//
+//  Public Functions
+//
+//
+
+///
+//  esImageLoad()
+//
+//    The first level of a converted container is taken instead of the
+//    file when its channels fit, there is nothing to decode then
+//
+GLboolean ESUTIL_API esImageLoad ( const char *fileName, int forceChannels, ESImage *image )
+{
+   char *containerName = ContainerFileName ( fileName );
+   ESTextureFile container;
+   int channels = 0;
+
+   memset ( image, 0, sizeof ( ESImage ) );
+
+   if ( containerName != NULL && esTextureFileLoad ( containerName, &container ) )
+   {
+      const ESTextureFileHeader *header = &container.header;
+
+      channels = FormatChannels ( header->format, header->type );
+
+      // compressed or premultiplied pixels are not what a decoded image holds
+      if ( channels != 0 && ( forceChannels == 0 || forceChannels == channels ) && !( header->flags & ES_TEXTURE_FILE_PREMULTIPLIED ) )
+      {
+         // malloc like stb_image, esImageFree frees both
+         image->pixels = ( unsigned char * ) malloc ( header->levels[0].size );
+      }
+
+      if ( image->pixels != NULL )
+      {
+         memcpy ( image->pixels, container.map.data + header->levels[0].offset, header->levels[0].size );
+         image->width = header->width;
+         image->height = header->height;
+         image->channels = channels;
+      }
+
+      esTextureFileFree ( &container );
+   }
+
+   free ( containerName );
+
+   return ( image->pixels != NULL ) ? GL_TRUE : DecodeImage ( fileName, forceChannels, image );
+}
+
+///
+//  esImageLoadBatch()
+//
+void ESUTIL_API esImageLoadBatch ( ESJobPool *pool, const char *const *fileNames, int count, int forceChannels, ESImage *images )
+{
+   ESImageJob *jobs = ( ESImageJob * ) malloc ( count * sizeof ( ESImageJob ) );
+   ESJobGroup group;
+   int i;
+
+   memset ( &group, 0, sizeof ( ESJobGroup ) );
+
+   for ( i = 0; i < count; i++ )
+   {
+      jobs[i].fileName = fileNames[i];
+      jobs[i].forceChannels = forceChannels;
+      jobs[i].image = &images[i];
+
+      if ( pool != NULL && jobs != NULL )
+      {
+         esJobPoolSubmit ( pool, &group, DecodeImageJob, &jobs[i] );
+      }
+      else
+      {
+         esImageLoad ( fileNames[i], forceChannels, &images[i] );
+      }
+   }
+
+   if ( pool != NULL && jobs != NULL )
+   {
+      esJobPoolWait ( pool, &group );
+   }
+
+   free ( jobs );
+}
+
+///
+//  esImageFree()
+//
+void ESUTIL_API esImageFree ( ESImage *image )
+{
+   if ( image->pixels != NULL )
+   {
+      stbi_image_free ( image->pixels );
+      image->pixels = NULL;
+   }
+}
+
+///
+//  esTextureFileLoad()
+//
+GLboolean ESUTIL_API esTextureFileLoad ( const char *fileName, ESTextureFile *file )
+{
+   ESTextureFileHeader *header = &file->header;
+   size_t size;
+   unsigned int width, height, channels, i;
+
+   memset ( file, 0, sizeof ( ESTextureFile ) );
+
+   // the levels stay in the mapping until they are uploaded
+   if ( !esFileMap ( NULL, fileName, &file->map ) )
+   {
+      return GL_FALSE;
+   }
+
+   size = file->map.size;
+
+   if ( size < sizeof ( ESTextureFileHeader ) )
+   {
+      esTextureFileFree ( file );
+      return GL_FALSE;
+   }
+
+   memcpy ( header, file->map.data, sizeof ( ESTextureFileHeader ) );
+
+   channels = HeaderChannels ( header );
+
+   if ( header->magic != ES_TEXTURE_FILE_MAGIC || header->version != ES_TEXTURE_FILE_VERSION ||
+         header->width == 0 || header->height == 0 || channels == 0 ||
+         header->width > ES_TEXTURE_FILE_SIZE_MAX || header->height > ES_TEXTURE_FILE_SIZE_MAX ||
+         header->levelCount == 0 || header->levelCount > ES_TEXTURE_FILE_LEVEL_MAX ||
+         header->levelCount > MaxLevelCount ( header->width, header->height ) )
+   {
+      esLogMessage ( "esTextureFileLoad: %s is not a texture container\n", fileName );
+      esTextureFileFree ( file );
+      return GL_FALSE;
+   }
+
+   // every level has to hold its pixels, the upload reads them without checking
+   width = header->width;
+   height = header->height;
+
+   for ( i = 0; i < header->levelCount; i++ )
+   {
+      if ( header->levels[i].offset > size || header->levels[i].size > size - header->levels[i].offset ||
+            header->levels[i].size < LevelSize ( header, width, height ) )
+      {
+         esLogMessage ( "esTextureFileLoad: %s is truncated\n", fileName );
+         esTextureFileFree ( file );
+         return GL_FALSE;
+      }
+
+      width = ( width > 1 ) ? width / 2 : 1;
+      height = ( height > 1 ) ? height / 2 : 1;
+   }
+
+   return GL_TRUE;
+}
+
+///
+//  esTextureFileFree()
+//
+void ESUTIL_API esTextureFileFree ( ESTextureFile *file )
+{
+   esFileUnmap ( &file->map );
+}
+
+///
+//  esTextureFileUpload()
+//
+//    Immutable storage with every level of the file, the rows are
+//    tightly packed so the unpack alignment is lowered meanwhile.
+//    Compressed levels go to the GPU as they are.  Errors raised
+//    before the call are cleared so that only the upload is checked.
+//
+GLboolean ESUTIL_API esTextureFileUpload ( const ESTextureFile *file )
+{
+   const ESTextureFileHeader *header = &file->header;
+   GLint alignment = 4;
+   GLint maxSize = 0;
+   GLsizei width = header->width;
+   GLsizei height = header->height;
+   GLboolean ok = GL_TRUE;
+   unsigned int i;
+
+   glGetIntegerv ( GL_MAX_TEXTURE_SIZE, &maxSize );
+
+   if ( width > maxSize || height > maxSize )
+   {
+      esLogMessage ( "esTextureFileUpload: %dx%d is above GL_MAX_TEXTURE_SIZE %d\n", width, height, maxSize );
+      return GL_FALSE;
+   }
+
+   while ( glGetError ( ) != GL_NO_ERROR )
+   {
+   }
+
+   glTexStorage2D ( GL_TEXTURE_2D, header->levelCount, header->internalFormat, width, height );
+
+   if ( glGetError ( ) != GL_NO_ERROR )
+   {
+      return GL_FALSE;
+   }
+
+   glGetIntegerv ( GL_UNPACK_ALIGNMENT, &alignment );
+   glPixelStorei ( GL_UNPACK_ALIGNMENT, 1 );
+
+   for ( i = 0; i < header->levelCount; i++ )
+   {
+      if ( header->format == 0 && header->type == 0 )
+      {
+         glCompressedTexSubImage2D ( GL_TEXTURE_2D, i, 0, 0, width, height, header->internalFormat,
+                                     ( GLsizei ) LevelSize ( header, width, height ), file->map.data + header->levels[i].offset );
+      }
+      else
+      {
+         glTexSubImage2D ( GL_TEXTURE_2D, i, 0, 0, width, height, header->format, header->type,
+                           file->map.data + header->levels[i].offset );
+      }
+      width = ( width > 1 ) ? width / 2 : 1;
+      height = ( height > 1 ) ? height / 2 : 1;
+   }
+
+   if ( glGetError ( ) != GL_NO_ERROR )
+   {
+      ok = GL_FALSE;
+   }
+
+   glPixelStorei ( GL_UNPACK_ALIGNMENT, alignment );
+   return ok;
+}
+
+///
+//  esTextureLoaderCreate()
+//
+ESTextureLoader *ESUTIL_API esTextureLoaderCreate ( ESJobPool *pool )
+{
+   ESTextureLoader *loader = ( ESTextureLoader * ) calloc ( 1, sizeof ( ESTextureLoader ) );
+
+   if ( loader != NULL )
+   {
+      loader->pool = pool;
+   }
+
+   return loader;
+}
+
+///
+//  esTextureLoaderDestroy()
+//
+void ESUTIL_API esTextureLoaderDestroy ( ESTextureLoader *loader )
+{
+   if ( loader == NULL )
+   {
+      return;
+   }
+
+   if ( loader->pool != NULL )
+   {
+      esJobPoolWait ( loader->pool, &loader->group );
+   }
+
+   TakeDecoded ( loader );
+
+   while ( loader->readyHead != NULL )
+   {
+      ESTextureJob *job = loader->readyHead;
+
+      loader->readyHead = job->next;
+      FreeTextureJob ( job );
+   }
+
+   free ( loader );
+}
+
+///
+//  esTextureLoaderRequest()
+//
+GLuint ESUTIL_API esTextureLoaderRequest ( ESTextureLoader *loader, const char *fileName, GLboolean mipmap, ESTextureRequest *request )
+{
+   ESTextureJob *job = ( ESTextureJob * ) calloc ( 1, sizeof ( ESTextureJob ) );
+
+   memset ( request, 0, sizeof ( ESTextureRequest ) );
+
+   if ( job != NULL )
+   {
+      job->fileName = ( char * ) malloc ( strlen ( fileName ) + 1 );
+   }
+
+   if ( job == NULL || job->fileName == NULL )
+   {
+      free ( job );
+      request->failed = GL_TRUE;
+      request->ready = GL_TRUE;
+      return 0;
+   }
+
+   strcpy ( job->fileName, fileName );
+   job->loader = loader;
+   job->request = request;
+   job->mipmap = mipmap;
+   glGenTextures ( 1, &job->texture );
+   request->texture = job->texture;
+   loader->pending++;
+
+   if ( loader->pool != NULL )
+   {
+      esJobPoolSubmit ( loader->pool, &loader->group, DecodeTextureJob, job );
+   }
+   else
+   {
+      DecodeTextureJob ( job );
+   }
+
+   return job->texture;
+}
+
+///
+//  esTextureLoaderUpload()
+//
+int ESUTIL_API esTextureLoaderUpload ( ESTextureLoader *loader, double budget )
+{
+   double end = esGetTime () + budget;
+
+   TakeDecoded ( loader );
+
+   while ( loader->readyHead != NULL )
+   {
+      ESTextureJob *job = loader->readyHead;
+
+      loader->readyHead = job->next;
+
+      if ( loader->readyHead == NULL )
+      {
+         loader->readyTail = NULL;
+      }
+
+      UploadTexture ( job );
+      loader->pending--;
+
+      if ( esGetTime () >= end )
+      {
+         break;
+      }
+   }
+
+   return loader->pending;
+}
+
+///
+//  esTextureLoaderFinish()
+//
+//    The GL thread helps decoding while it waits
+//
+void ESUTIL_API esTextureLoaderFinish ( ESTextureLoader *loader )
+{
+   if ( loader->pool != NULL )
+   {
+      esJobPoolWait ( loader->pool, &loader->group );
+   }
+
+   // every request is decoded now, an unlimited budget uploads them all
+   esTextureLoaderUpload ( loader, 1.0e9 );
+}
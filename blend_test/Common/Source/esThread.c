@@ -0,0 +1,689 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2013 Dan Ginsburg, Budirijanto Purnomo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+//
+// Book:      OpenGL(R) ES 3.0 Programming Guide, 2nd Edition
+// Authors:   Dan Ginsburg, Budirijanto Purnomo, Dave Shreiner, Aaftab Munshi
+// ISBN-10:   0-321-93388-5
+// ISBN-13:   978-0-321-93388-1
+// Publisher: Addison-Wesley Professional
+// URLs:      http://www.opengles-book.com
+//            http://my.safaribooksonline.com/book/animation-and-3d/9780133440133
+//
+// ESThread.c
+//
+//    Portable threads, mutexes, condition variables and a small job pool
+//    used to spread CPU work over the available cores.
+//
+
+///
+//  Includes
+//
+#ifdef _WIN32
+#ifndef _WIN32_WINNT
+#define _WIN32_WINNT 0x0601   // CONDITION_VARIABLE needs Vista or later
+#endif
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <process.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#endif
+#include <stdlib.h>
+#include <string.h>
+#include "esUtil.h"
+
+///
+//  Types
+//
+struct ESThread
+{
+#ifdef _WIN32
+   HANDLE            handle;
+#else
+   pthread_t         handle;
+#endif
+   void ( *func ) ( void * );
+   void             *arg;
+};
+
+struct ESMutex
+{
+#ifdef _WIN32
+   CRITICAL_SECTION  cs;
+#else
+   pthread_mutex_t   mutex;
+#endif
+};
+
+struct ESCond
+{
+#ifdef _WIN32
+   CONDITION_VARIABLE cv;
+#else
+   pthread_cond_t    cond;
+#endif
+};
+
+typedef struct
+{
+   void ( *func ) ( void * );
+   void             *arg;
+   ESJobGroup       *group;
+} ESJob;
+
+struct ESJobPool
+{
+   ESMutex          *mutex;
+   ESCond           *jobReady;     // signaled when a job is queued or on shutdown
+   ESCond           *jobDone;      // broadcast when a job finishes
+   ESThread        **workers;
+   int               numWorkers;
+
+   // ring buffer of queued jobs, grows when full
+   ESJob            *jobs;
+   int               capacity;
+   int               head;
+   int               count;
+
+   int               waiters;      // threads inside esJobPoolWait
+   int               quit;
+};
+
+// shared pool of esGetJobPool, created and destroyed under s_sharedPoolMutex
+static ESOnce        s_sharedPoolOnce = ES_ONCE_INIT;
+static ESMutex      *s_sharedPoolMutex = NULL;
+static ESJobPool    *s_sharedPool = NULL;
+
+//////////////////////////////////////////////////////////////////
+//
+//  Private Functions
+//
+//
+
+#ifdef _WIN32
+static unsigned __stdcall esThreadEntry ( void *arg )
+#else
+static void *esThreadEntry ( void *arg )
+#endif
+{
+   ESThread *thread = ( ESThread * ) arg;
+
+   thread->func ( thread->arg );
+   return 0;
+}
+
+///
+// esJobPoolPop()
+//
+//    Take the oldest job from the queue, the pool mutex must be held
+//
+static int esJobPoolPop ( ESJobPool *pool, ESJob *job )
+{
+   if ( pool->count == 0 )
+   {
+      return GL_FALSE;
+   }
+
+   *job = pool->jobs[pool->head];
+   pool->head = ( pool->head + 1 ) % pool->capacity;
+   pool->count--;
+   return GL_TRUE;
+}
+
+///
+// esJobRun()
+//
+//    Run a job outside of the lock and mark it as done
+//
+static void esJobRun ( ESJobPool *pool, ESJob *job )
+{
+   job->func ( job->arg );
+
+   esMutexLock ( pool->mutex );
+
+   if ( job->group != NULL )
+   {
+      job->group->pending--;
+   }
+
+   esCondBroadcast ( pool->jobDone );
+   esMutexUnlock ( pool->mutex );
+}
+
+static void esJobPoolWorker ( void *arg )
+{
+   ESJobPool *pool = ( ESJobPool * ) arg;
+   ESJob job;
+
+   esMutexLock ( pool->mutex );
+
+   // the queue is emptied before quitting so that no group is left pending
+   for ( ;; )
+   {
+      if ( esJobPoolPop ( pool, &job ) )
+      {
+         esMutexUnlock ( pool->mutex );
+         esJobRun ( pool, &job );
+         esMutexLock ( pool->mutex );
+      }
+      else if ( pool->quit )
+      {
+         break;
+      }
+      else
+      {
+         esCondWait ( pool->jobReady, pool->mutex );
+      }
+   }
+
+   esMutexUnlock ( pool->mutex );
+}
+
+static void esSharedPoolInit ( void )
+{
+   s_sharedPoolMutex = esMutexCreate ( );
+}
+
+//////////////////////////////////////////////////////////////////
+//
+//  Public Functions
+//
+//
+
+///
+//  esGetCpuCount()
+//
+int ESUTIL_API esGetCpuCount ( void )
+{
+#ifdef _WIN32
+   SYSTEM_INFO info;
+   GetSystemInfo ( &info );
+   return ( int ) info.dwNumberOfProcessors;
+#else
+   long count = sysconf ( _SC_NPROCESSORS_ONLN );
+   return ( count > 0 ) ? ( int ) count : 1;
+#endif
+}
+
+///
+//  esThreadCreate()
+//
+ESThread *ESUTIL_API esThreadCreate ( void ( *func ) ( void * ), void *arg )
+{
+   ESThread *thread = ( ESThread * ) malloc ( sizeof ( ESThread ) );
+
+   if ( thread == NULL )
+   {
+      return NULL;
+   }
+
+   thread->func = func;
+   thread->arg = arg;
+
+#ifdef _WIN32
+   thread->handle = ( HANDLE ) _beginthreadex ( NULL, 0, esThreadEntry, thread, 0, NULL );
+
+   if ( thread->handle == 0 )
+#else
+   if ( pthread_create ( &thread->handle, NULL, esThreadEntry, thread ) != 0 )
+#endif
+   {
+      free ( thread );
+      return NULL;
+   }
+
+   return thread;
+}
+
+///
+//  esThreadJoin()
+//
+void ESUTIL_API esThreadJoin ( ESThread *thread )
+{
+   if ( thread == NULL )
+   {
+      return;
+   }
+
+#ifdef _WIN32
+   WaitForSingleObject ( thread->handle, INFINITE );
+   CloseHandle ( thread->handle );
+#else
+   pthread_join ( thread->handle, NULL );
+#endif
+   free ( thread );
+}
+
+///
+//  esMutexCreate()
+//
+ESMutex *ESUTIL_API esMutexCreate ( void )
+{
+   ESMutex *mutex = ( ESMutex * ) malloc ( sizeof ( ESMutex ) );
+
+   if ( mutex != NULL )
+   {
+#ifdef _WIN32
+      InitializeCriticalSection ( &mutex->cs );
+#else
+      pthread_mutex_init ( &mutex->mutex, NULL );
+#endif
+   }
+
+   return mutex;
+}
+
+void ESUTIL_API esMutexDestroy ( ESMutex *mutex )
+{
+   if ( mutex != NULL )
+   {
+#ifdef _WIN32
+      DeleteCriticalSection ( &mutex->cs );
+#else
+      pthread_mutex_destroy ( &mutex->mutex );
+#endif
+      free ( mutex );
+   }
+}
+
+void ESUTIL_API esMutexLock ( ESMutex *mutex )
+{
+#ifdef _WIN32
+   EnterCriticalSection ( &mutex->cs );
+#else
+   pthread_mutex_lock ( &mutex->mutex );
+#endif
+}
+
+void ESUTIL_API esMutexUnlock ( ESMutex *mutex )
+{
+#ifdef _WIN32
+   LeaveCriticalSection ( &mutex->cs );
+#else
+   pthread_mutex_unlock ( &mutex->mutex );
+#endif
+}
+
+///
+//  esCondCreate()
+//
+ESCond *ESUTIL_API esCondCreate ( void )
+{
+   ESCond *cond = ( ESCond * ) malloc ( sizeof ( ESCond ) );
+
+   if ( cond != NULL )
+   {
+#ifdef _WIN32
+      InitializeConditionVariable ( &cond->cv );
+#else
+      pthread_cond_init ( &cond->cond, NULL );
+#endif
+   }
+
+   return cond;
+}
+
+void ESUTIL_API esCondDestroy ( ESCond *cond )
+{
+   if ( cond != NULL )
+   {
+#ifndef _WIN32
+      pthread_cond_destroy ( &cond->cond );
+#endif
+      free ( cond );
+   }
+}
+
+void ESUTIL_API esCondWait ( ESCond *cond, ESMutex *mutex )
+{
+#ifdef _WIN32
+   SleepConditionVariableCS ( &cond->cv, &mutex->cs, INFINITE );
+#else
+   pthread_cond_wait ( &cond->cond, &mutex->mutex );
+#endif
+}
+
+void ESUTIL_API esCondSignal ( ESCond *cond )
+{
+#ifdef _WIN32
+   WakeConditionVariable ( &cond->cv );
+#else
+   pthread_cond_signal ( &cond->cond );
+#endif
+}
+
+void ESUTIL_API esCondBroadcast ( ESCond *cond )
+{
+#ifdef _WIN32
+   WakeAllConditionVariable ( &cond->cv );
+#else
+   pthread_cond_broadcast ( &cond->cond );
+#endif
+}
+
+///
+//  esAtomicExchangePointer()
+//
+void *ESUTIL_API esAtomicExchangePointer ( void *volatile *target, void *value )
+{
+#ifdef _WIN32
+   return InterlockedExchangePointer ( target, value );
+#else
+   return __atomic_exchange_n ( target, value, __ATOMIC_ACQ_REL );
+#endif
+}
+
+///
+//  esAtomicCompareExchangePointer()
+//
+//    Store desired if the target holds expected, returns the previous value
+//
+void *ESUTIL_API esAtomicCompareExchangePointer ( void *volatile *target, void *expected, void *desired )
+{
+#ifdef _WIN32
+   return InterlockedCompareExchangePointer ( target, desired, expected );
+#else
+   __atomic_compare_exchange_n ( target, &expected, desired, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE );
+   return expected;
+#endif
+}
+
+///
+//  esOnce()
+//
+//    The state goes from 0 to 1 while func runs, then to 2
+//
+void ESUTIL_API esOnce ( ESOnce *once, void ( *func ) ( void ) )
+{
+#ifdef _WIN32
+   // volatile reads have acquire semantics with MSVC on x86 and x64
+   if ( once->state == 2 )
+   {
+      return;
+   }
+
+   if ( InterlockedCompareExchange ( &once->state, 1, 0 ) == 0 )
+   {
+      func ( );
+      InterlockedExchange ( &once->state, 2 );
+      return;
+   }
+
+   while ( once->state != 2 )
+   {
+      SwitchToThread ( );
+   }
+#else
+   long expected = 0;
+
+   if ( __atomic_load_n ( &once->state, __ATOMIC_ACQUIRE ) == 2 )
+   {
+      return;
+   }
+
+   if ( __atomic_compare_exchange_n ( &once->state, &expected, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE ) )
+   {
+      func ( );
+      __atomic_store_n ( &once->state, 2, __ATOMIC_RELEASE );
+      return;
+   }
+
+   while ( __atomic_load_n ( &once->state, __ATOMIC_ACQUIRE ) != 2 )
+   {
+      sched_yield ( );
+   }
+#endif
+}
+
+///
+//  esJobPoolCreate()
+//
+ESJobPool *ESUTIL_API esJobPoolCreate ( int numThreads )
+{
+   ESJobPool *pool = ( ESJobPool * ) calloc ( 1, sizeof ( ESJobPool ) );
+   int i;
+
+   if ( pool == NULL )
+   {
+      return NULL;
+   }
+
+   if ( numThreads <= 0 )
+   {
+      // the thread that waits on the jobs helps running them
+      numThreads = esGetCpuCount ( ) - 1;
+      numThreads = ( numThreads < 1 ) ? 1 : numThreads;
+   }
+
+   pool->mutex = esMutexCreate ( );
+   pool->jobReady = esCondCreate ( );
+   pool->jobDone = esCondCreate ( );
+   pool->capacity = 64;
+   pool->jobs = ( ESJob * ) malloc ( pool->capacity * sizeof ( ESJob ) );
+   pool->workers = ( ESThread ** ) calloc ( numThreads, sizeof ( ESThread * ) );
+
+   if ( pool->mutex == NULL || pool->jobReady == NULL || pool->jobDone == NULL ||
+        pool->jobs == NULL || pool->workers == NULL )
+   {
+      esJobPoolDestroy ( pool );
+      return NULL;
+   }
+
+   for ( i = 0; i < numThreads; i++ )
+   {
+      pool->workers[i] = esThreadCreate ( esJobPoolWorker, pool );
+
+      if ( pool->workers[i] == NULL )
+      {
+         break;
+      }
+
+      pool->numWorkers++;
+   }
+
+   return pool;
+}
+
+///
+//  esJobPoolDestroy()
+//
+//    Queued jobs still run, the calling thread helps the workers with them,
+//    and the pool is only freed once the last waiting thread left esJobPoolWait
+//
+void ESUTIL_API esJobPoolDestroy ( ESJobPool *pool )
+{
+   ESJob job;
+   int i;
+
+   if ( pool == NULL )
+   {
+      return;
+   }
+
+   if ( pool->mutex != NULL && pool->jobReady != NULL && pool->jobDone != NULL )
+   {
+      esMutexLock ( pool->mutex );
+      pool->quit = 1;
+      esCondBroadcast ( pool->jobReady );
+
+      while ( esJobPoolPop ( pool, &job ) )
+      {
+         esMutexUnlock ( pool->mutex );
+         esJobRun ( pool, &job );
+         esMutexLock ( pool->mutex );
+      }
+
+      while ( pool->waiters > 0 )
+      {
+         esCondWait ( pool->jobDone, pool->mutex );
+      }
+
+      esMutexUnlock ( pool->mutex );
+   }
+
+   for ( i = 0; i < pool->numWorkers; i++ )
+   {
+      esThreadJoin ( pool->workers[i] );
+   }
+
+   esCondDestroy ( pool->jobDone );
+   esCondDestroy ( pool->jobReady );
+   esMutexDestroy ( pool->mutex );
+   free ( pool->workers );
+   free ( pool->jobs );
+   free ( pool );
+}
+
+///
+//  esJobPoolSubmit()
+//
+void ESUTIL_API esJobPoolSubmit ( ESJobPool *pool, ESJobGroup *group, void ( *func ) ( void * ), void *arg )
+{
+   esMutexLock ( pool->mutex );
+
+   if ( pool->count == pool->capacity )
+   {
+      int newCapacity = pool->capacity * 2;
+      ESJob *jobs = ( ESJob * ) malloc ( newCapacity * sizeof ( ESJob ) );
+      int i;
+
+      if ( jobs == NULL )
+      {
+         // the queue cannot grow, run the job here rather than losing it
+         esMutexUnlock ( pool->mutex );
+         func ( arg );
+         return;
+      }
+
+      for ( i = 0; i < pool->count; i++ )
+      {
+         jobs[i] = pool->jobs[ ( pool->head + i ) % pool->capacity];
+      }
+
+      free ( pool->jobs );
+      pool->jobs = jobs;
+      pool->capacity = newCapacity;
+      pool->head = 0;
+   }
+
+   pool->jobs[ ( pool->head + pool->count ) % pool->capacity].func = func;
+   pool->jobs[ ( pool->head + pool->count ) % pool->capacity].arg = arg;
+   pool->jobs[ ( pool->head + pool->count ) % pool->capacity].group = group;
+   pool->count++;
+
+   if ( group != NULL )
+   {
+      group->pending++;
+   }
+
+   esCondSignal ( pool->jobReady );
+   esMutexUnlock ( pool->mutex );
+}
+
+///
+//  esJobPoolWait()
+//
+//    Wait until every job of the group is done, the calling thread runs
+//    queued jobs meanwhile instead of sleeping
+//
+void ESUTIL_API esJobPoolWait ( ESJobPool *pool, ESJobGroup *group )
+{
+   ESJob job;
+
+   esMutexLock ( pool->mutex );
+   pool->waiters++;
+
+   while ( group->pending > 0 )
+   {
+      if ( esJobPoolPop ( pool, &job ) )
+      {
+         esMutexUnlock ( pool->mutex );
+         esJobRun ( pool, &job );
+         esMutexLock ( pool->mutex );
+      }
+      else
+      {
+         esCondWait ( pool->jobDone, pool->mutex );
+      }
+   }
+
+   pool->waiters--;
+
+   if ( pool->quit )
+   {
+      // esJobPoolDestroy waits for the last waiter to leave
+      esCondBroadcast ( pool->jobDone );
+   }
+
+   esMutexUnlock ( pool->mutex );
+}
+
+///
+//  esGetJobPool()
+//
+//    Shared pool, created on first use with one worker per extra core
+//
+ESJobPool *ESUTIL_API esGetJobPool ( void )
+{
+   ESJobPool *pool;
+
+   esOnce ( &s_sharedPoolOnce, esSharedPoolInit );
+
+   if ( s_sharedPoolMutex == NULL )
+   {
+      return NULL;
+   }
+
+   esMutexLock ( s_sharedPoolMutex );
+
+   if ( s_sharedPool == NULL )
+   {
+      s_sharedPool = esJobPoolCreate ( 0 );
+   }
+
+   pool = s_sharedPool;
+   esMutexUnlock ( s_sharedPoolMutex );
+   return pool;
+}
+
+///
+//  esShutdownJobPool()
+//
+//    The next esGetJobPool creates a new pool, e.g. when Android recreates the window
+//
+void ESUTIL_API esShutdownJobPool ( void )
+{
+   esOnce ( &s_sharedPoolOnce, esSharedPoolInit );
+
+   if ( s_sharedPoolMutex == NULL )
+   {
+      return;
+   }
+
+   esMutexLock ( s_sharedPoolMutex );
+   esJobPoolDestroy ( s_sharedPool );
+   s_sharedPool = NULL;
+   esMutexUnlock ( s_sharedPoolMutex );
+}
@@ -43,8 +43,697 @@
 #include <math.h>
 #include <string.h>
 
+#if defined ( __SSE__ ) || defined ( _M_X64 ) || ( defined ( _M_IX86_FP ) && _M_IX86_FP >= 1 )
+#define ES_MATRIX_SSE
+#include <xmmintrin.h>
+#if defined ( _MSC_VER ) || defined ( __GNUC__ )
+// AVX kernels are compiled for the AVX target only and selected at runtime
+#define ES_MATRIX_AVX
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define ES_TARGET_AVX
+#else
+#define ES_TARGET_AVX __attribute__ ( ( target ( "avx" ) ) )
+#endif
+#endif
+#endif
+
+#if defined ( __ARM_NEON ) || defined ( __ARM_NEON__ )
+#define ES_MATRIX_NEON
+#include <arm_neon.h>
+#endif
+
 #define PI 3.1415926535897932384626433832795f
 
+//////////////////////////////////////////////////////////////////
+//
+//  Private Functions
+//
+//
+
+///
+//  Matrix kernels
+//
+//    Every kernel computes the same sums in the same order as the scalar code
+//    (no fused multiply-add), so the SIMD results are bit-identical to it.
+//    The inputs are read completely before the result is written, so result
+//    may alias any of the inputs.
+//
+typedef struct
+{
+   const char *name;
+   void ( *multiply ) ( ESMatrix *result, const ESMatrix *srcA, const ESMatrix *srcB );
+   void ( *multiplyAffine ) ( ESMatrix *result, const ESMatrix *srcA, const ESMatrix *srcB );
+   void ( *transpose ) ( ESMatrix *result, const ESMatrix *src );
+   void ( *transformVec4 ) ( GLfloat *result, const ESMatrix *matrix, const GLfloat *vec );
+   void ( *multiplyBatch ) ( char *result, GLsizei resultStride, const char *srcA, GLsizei srcStride,
+                             const ESMatrix *srcB, int count );
+} ESMatrixKernels;
+
+static void esMatrixMultiplyScalar ( ESMatrix *result, const ESMatrix *srcA, const ESMatrix *srcB )
+{
+   ESMatrix    tmp;
+   int         i;
+
+   for ( i = 0; i < 4; i++ )
+   {
+      tmp.m[i][0] =  ( srcA->m[i][0] * srcB->m[0][0] ) +
+                     ( srcA->m[i][1] * srcB->m[1][0] ) +
+                     ( srcA->m[i][2] * srcB->m[2][0] ) +
+                     ( srcA->m[i][3] * srcB->m[3][0] ) ;
+
+      tmp.m[i][1] =  ( srcA->m[i][0] * srcB->m[0][1] ) +
+                     ( srcA->m[i][1] * srcB->m[1][1] ) +
+                     ( srcA->m[i][2] * srcB->m[2][1] ) +
+                     ( srcA->m[i][3] * srcB->m[3][1] ) ;
+
+      tmp.m[i][2] =  ( srcA->m[i][0] * srcB->m[0][2] ) +
+                     ( srcA->m[i][1] * srcB->m[1][2] ) +
+                     ( srcA->m[i][2] * srcB->m[2][2] ) +
+                     ( srcA->m[i][3] * srcB->m[3][2] ) ;
+
+      tmp.m[i][3] =  ( srcA->m[i][0] * srcB->m[0][3] ) +
+                     ( srcA->m[i][1] * srcB->m[1][3] ) +
+                     ( srcA->m[i][2] * srcB->m[2][3] ) +
+                     ( srcA->m[i][3] * srcB->m[3][3] ) ;
+   }
+
+   *result = tmp;
+}
+
+static void esMatrixMultiplyAffineScalar ( ESMatrix *result, const ESMatrix *srcA, const ESMatrix *srcB )
+{
+   ESMatrix    tmp;
+   int         i, j;
+
+   // The last column of both matrices is ( 0, 0, 0, 1 )
+   for ( i = 0; i < 3; i++ )
+   {
+      for ( j = 0; j < 3; j++ )
+      {
+         tmp.m[i][j] = ( srcA->m[i][0] * srcB->m[0][j] ) +
+                       ( srcA->m[i][1] * srcB->m[1][j] ) +
+                       ( srcA->m[i][2] * srcB->m[2][j] );
+      }
+
+      tmp.m[i][3] = 0.0f;
+   }
+
+   for ( j = 0; j < 3; j++ )
+   {
+      tmp.m[3][j] = ( srcA->m[3][0] * srcB->m[0][j] ) +
+                    ( srcA->m[3][1] * srcB->m[1][j] ) +
+                    ( srcA->m[3][2] * srcB->m[2][j] ) +
+                    srcB->m[3][j];
+   }
+
+   tmp.m[3][3] = 1.0f;
+
+   *result = tmp;
+}
+
+static void esMatrixTransposeScalar ( ESMatrix *result, const ESMatrix *src )
+{
+   ESMatrix    tmp;
+   int         i, j;
+
+   for ( i = 0; i < 4; i++ )
+   {
+      for ( j = 0; j < 4; j++ )
+      {
+         tmp.m[i][j] = src->m[j][i];
+      }
+   }
+
+   *result = tmp;
+}
+
+static void esMatrixTransformVec4Scalar ( GLfloat *result, const ESMatrix *matrix, const GLfloat *vec )
+{
+   GLfloat     tmp[4];
+   int         j;
+
+   for ( j = 0; j < 4; j++ )
+   {
+      tmp[j] = ( vec[0] * matrix->m[0][j] ) +
+               ( vec[1] * matrix->m[1][j] ) +
+               ( vec[2] * matrix->m[2][j] ) +
+               ( vec[3] * matrix->m[3][j] );
+   }
+
+   memcpy ( result, tmp, sizeof ( tmp ) );
+}
+
+// Batch kernels walk byte strides so the matrices can be embedded in bigger structures
+static void esMatrixMultiplyBatchScalar ( char *result, GLsizei resultStride, const char *srcA, GLsizei srcStride,
+                                          const ESMatrix *srcB, int count )
+{
+   ESMatrix b = *srcB;
+   int i;
+
+   for ( i = 0; i < count; i++ )
+   {
+      esMatrixMultiplyScalar ( ( ESMatrix * ) ( result + i * resultStride ),
+                               ( const ESMatrix * ) ( srcA + i * srcStride ), &b );
+   }
+}
+
+static const ESMatrixKernels s_scalarKernels =
+{
+   "scalar",
+   esMatrixMultiplyScalar,
+   esMatrixMultiplyAffineScalar,
+   esMatrixTransposeScalar,
+   esMatrixTransformVec4Scalar,
+   esMatrixMultiplyBatchScalar
+};
+
+#ifdef ES_MATRIX_SSE
+
+// row * B, where row is one row of A broadcast element by element
+static __inline __m128 esRowMultiplySSE ( __m128 row, __m128 b0, __m128 b1, __m128 b2, __m128 b3 )
+{
+   __m128 r = _mm_mul_ps ( _mm_shuffle_ps ( row, row, 0x00 ), b0 );
+   r = _mm_add_ps ( r, _mm_mul_ps ( _mm_shuffle_ps ( row, row, 0x55 ), b1 ) );
+   r = _mm_add_ps ( r, _mm_mul_ps ( _mm_shuffle_ps ( row, row, 0xAA ), b2 ) );
+   return _mm_add_ps ( r, _mm_mul_ps ( _mm_shuffle_ps ( row, row, 0xFF ), b3 ) );
+}
+
+static void esMatrixMultiplySSE ( ESMatrix *result, const ESMatrix *srcA, const ESMatrix *srcB )
+{
+   __m128 b0 = _mm_loadu_ps ( srcB->m[0] );
+   __m128 b1 = _mm_loadu_ps ( srcB->m[1] );
+   __m128 b2 = _mm_loadu_ps ( srcB->m[2] );
+   __m128 b3 = _mm_loadu_ps ( srcB->m[3] );
+   __m128 r0 = esRowMultiplySSE ( _mm_loadu_ps ( srcA->m[0] ), b0, b1, b2, b3 );
+   __m128 r1 = esRowMultiplySSE ( _mm_loadu_ps ( srcA->m[1] ), b0, b1, b2, b3 );
+   __m128 r2 = esRowMultiplySSE ( _mm_loadu_ps ( srcA->m[2] ), b0, b1, b2, b3 );
+   __m128 r3 = esRowMultiplySSE ( _mm_loadu_ps ( srcA->m[3] ), b0, b1, b2, b3 );
+
+   _mm_storeu_ps ( result->m[0], r0 );
+   _mm_storeu_ps ( result->m[1], r1 );
+   _mm_storeu_ps ( result->m[2], r2 );
+   _mm_storeu_ps ( result->m[3], r3 );
+}
+
+static __inline __m128 esRowMultiplyAffineSSE ( __m128 row, __m128 b0, __m128 b1, __m128 b2 )
+{
+   __m128 r = _mm_mul_ps ( _mm_shuffle_ps ( row, row, 0x00 ), b0 );
+   r = _mm_add_ps ( r, _mm_mul_ps ( _mm_shuffle_ps ( row, row, 0x55 ), b1 ) );
+   return _mm_add_ps ( r, _mm_mul_ps ( _mm_shuffle_ps ( row, row, 0xAA ), b2 ) );
+}
+
+static void esMatrixMultiplyAffineSSE ( ESMatrix *result, const ESMatrix *srcA, const ESMatrix *srcB )
+{
+   __m128 b0 = _mm_loadu_ps ( srcB->m[0] );
+   __m128 b1 = _mm_loadu_ps ( srcB->m[1] );
+   __m128 b2 = _mm_loadu_ps ( srcB->m[2] );
+   __m128 b3 = _mm_loadu_ps ( srcB->m[3] );
+   __m128 r0 = esRowMultiplyAffineSSE ( _mm_loadu_ps ( srcA->m[0] ), b0, b1, b2 );
+   __m128 r1 = esRowMultiplyAffineSSE ( _mm_loadu_ps ( srcA->m[1] ), b0, b1, b2 );
+   __m128 r2 = esRowMultiplyAffineSSE ( _mm_loadu_ps ( srcA->m[2] ), b0, b1, b2 );
+   __m128 r3 = _mm_add_ps ( esRowMultiplyAffineSSE ( _mm_loadu_ps ( srcA->m[3] ), b0, b1, b2 ), b3 );
+
+   // B has ( 0, 0, 0, 1 ) as last column, so only the w of rows 0 ~ 2 is fixed up
+   _mm_storeu_ps ( result->m[0], r0 );
+   _mm_storeu_ps ( result->m[1], r1 );
+   _mm_storeu_ps ( result->m[2], r2 );
+   _mm_storeu_ps ( result->m[3], r3 );
+   result->m[0][3] = 0.0f;
+   result->m[1][3] = 0.0f;
+   result->m[2][3] = 0.0f;
+   result->m[3][3] = 1.0f;
+}
+
+static void esMatrixTransposeSSE ( ESMatrix *result, const ESMatrix *src )
+{
+   __m128 r0 = _mm_loadu_ps ( src->m[0] );
+   __m128 r1 = _mm_loadu_ps ( src->m[1] );
+   __m128 r2 = _mm_loadu_ps ( src->m[2] );
+   __m128 r3 = _mm_loadu_ps ( src->m[3] );
+
+   _MM_TRANSPOSE4_PS ( r0, r1, r2, r3 );
+
+   _mm_storeu_ps ( result->m[0], r0 );
+   _mm_storeu_ps ( result->m[1], r1 );
+   _mm_storeu_ps ( result->m[2], r2 );
+   _mm_storeu_ps ( result->m[3], r3 );
+}
+
+static void esMatrixTransformVec4SSE ( GLfloat *result, const ESMatrix *matrix, const GLfloat *vec )
+{
+   __m128 r = esRowMultiplySSE ( _mm_loadu_ps ( vec ),
+                                 _mm_loadu_ps ( matrix->m[0] ), _mm_loadu_ps ( matrix->m[1] ),
+                                 _mm_loadu_ps ( matrix->m[2] ), _mm_loadu_ps ( matrix->m[3] ) );
+   _mm_storeu_ps ( result, r );
+}
+
+static void esMatrixMultiplyBatchSSE ( char *result, GLsizei resultStride, const char *srcA, GLsizei srcStride,
+                                       const ESMatrix *srcB, int count )
+{
+   __m128 b0 = _mm_loadu_ps ( srcB->m[0] );
+   __m128 b1 = _mm_loadu_ps ( srcB->m[1] );
+   __m128 b2 = _mm_loadu_ps ( srcB->m[2] );
+   __m128 b3 = _mm_loadu_ps ( srcB->m[3] );
+   int i;
+
+   for ( i = 0; i < count; i++ )
+   {
+      const ESMatrix *a = ( const ESMatrix * ) ( srcA + i * srcStride );
+      ESMatrix *r = ( ESMatrix * ) ( result + i * resultStride );
+      __m128 r0 = esRowMultiplySSE ( _mm_loadu_ps ( a->m[0] ), b0, b1, b2, b3 );
+      __m128 r1 = esRowMultiplySSE ( _mm_loadu_ps ( a->m[1] ), b0, b1, b2, b3 );
+      __m128 r2 = esRowMultiplySSE ( _mm_loadu_ps ( a->m[2] ), b0, b1, b2, b3 );
+      __m128 r3 = esRowMultiplySSE ( _mm_loadu_ps ( a->m[3] ), b0, b1, b2, b3 );
+
+      _mm_storeu_ps ( r->m[0], r0 );
+      _mm_storeu_ps ( r->m[1], r1 );
+      _mm_storeu_ps ( r->m[2], r2 );
+      _mm_storeu_ps ( r->m[3], r3 );
+   }
+}
+
+static const ESMatrixKernels s_sseKernels =
+{
+   "sse",
+   esMatrixMultiplySSE,
+   esMatrixMultiplyAffineSSE,
+   esMatrixTransposeSSE,
+   esMatrixTransformVec4SSE,
+   esMatrixMultiplyBatchSSE
+};
+
+#endif // ES_MATRIX_SSE
+
+#ifdef ES_MATRIX_AVX
+
+// Two rows of A per 256-bit register, B rows are duplicated into both lanes
+static ES_TARGET_AVX void esMatrixMultiplyAVX ( ESMatrix *result, const ESMatrix *srcA, const ESMatrix *srcB )
+{
+   __m256 b0 = _mm256_broadcast_ps ( ( const __m128 * ) srcB->m[0] );
+   __m256 b1 = _mm256_broadcast_ps ( ( const __m128 * ) srcB->m[1] );
+   __m256 b2 = _mm256_broadcast_ps ( ( const __m128 * ) srcB->m[2] );
+   __m256 b3 = _mm256_broadcast_ps ( ( const __m128 * ) srcB->m[3] );
+   __m256 a01 = _mm256_loadu_ps ( srcA->m[0] );
+   __m256 a23 = _mm256_loadu_ps ( srcA->m[2] );
+   __m256 r01, r23;
+
+   r01 = _mm256_mul_ps ( _mm256_permute_ps ( a01, 0x00 ), b0 );
+   r01 = _mm256_add_ps ( r01, _mm256_mul_ps ( _mm256_permute_ps ( a01, 0x55 ), b1 ) );
+   r01 = _mm256_add_ps ( r01, _mm256_mul_ps ( _mm256_permute_ps ( a01, 0xAA ), b2 ) );
+   r01 = _mm256_add_ps ( r01, _mm256_mul_ps ( _mm256_permute_ps ( a01, 0xFF ), b3 ) );
+
+   r23 = _mm256_mul_ps ( _mm256_permute_ps ( a23, 0x00 ), b0 );
+   r23 = _mm256_add_ps ( r23, _mm256_mul_ps ( _mm256_permute_ps ( a23, 0x55 ), b1 ) );
+   r23 = _mm256_add_ps ( r23, _mm256_mul_ps ( _mm256_permute_ps ( a23, 0xAA ), b2 ) );
+   r23 = _mm256_add_ps ( r23, _mm256_mul_ps ( _mm256_permute_ps ( a23, 0xFF ), b3 ) );
+
+   _mm256_storeu_ps ( result->m[0], r01 );
+   _mm256_storeu_ps ( result->m[2], r23 );
+   _mm256_zeroupper ( );
+}
+
+static ES_TARGET_AVX void esMatrixMultiplyBatchAVX ( char *result, GLsizei resultStride, const char *srcA,
+                                                     GLsizei srcStride, const ESMatrix *srcB, int count )
+{
+   __m256 b0 = _mm256_broadcast_ps ( ( const __m128 * ) srcB->m[0] );
+   __m256 b1 = _mm256_broadcast_ps ( ( const __m128 * ) srcB->m[1] );
+   __m256 b2 = _mm256_broadcast_ps ( ( const __m128 * ) srcB->m[2] );
+   __m256 b3 = _mm256_broadcast_ps ( ( const __m128 * ) srcB->m[3] );
+   int i;
+
+   for ( i = 0; i < count; i++ )
+   {
+      const ESMatrix *a = ( const ESMatrix * ) ( srcA + i * srcStride );
+      ESMatrix *r = ( ESMatrix * ) ( result + i * resultStride );
+      __m256 a01 = _mm256_loadu_ps ( a->m[0] );
+      __m256 a23 = _mm256_loadu_ps ( a->m[2] );
+      __m256 r01, r23;
+
+      r01 = _mm256_mul_ps ( _mm256_permute_ps ( a01, 0x00 ), b0 );
+      r01 = _mm256_add_ps ( r01, _mm256_mul_ps ( _mm256_permute_ps ( a01, 0x55 ), b1 ) );
+      r01 = _mm256_add_ps ( r01, _mm256_mul_ps ( _mm256_permute_ps ( a01, 0xAA ), b2 ) );
+      r01 = _mm256_add_ps ( r01, _mm256_mul_ps ( _mm256_permute_ps ( a01, 0xFF ), b3 ) );
+
+      r23 = _mm256_mul_ps ( _mm256_permute_ps ( a23, 0x00 ), b0 );
+      r23 = _mm256_add_ps ( r23, _mm256_mul_ps ( _mm256_permute_ps ( a23, 0x55 ), b1 ) );
+      r23 = _mm256_add_ps ( r23, _mm256_mul_ps ( _mm256_permute_ps ( a23, 0xAA ), b2 ) );
+      r23 = _mm256_add_ps ( r23, _mm256_mul_ps ( _mm256_permute_ps ( a23, 0xFF ), b3 ) );
+
+      _mm256_storeu_ps ( r->m[0], r01 );
+      _mm256_storeu_ps ( r->m[2], r23 );
+   }
+
+   _mm256_zeroupper ( );
+}
+
+static const ESMatrixKernels s_avxKernels =
+{
+   "avx",
+   esMatrixMultiplyAVX,
+   esMatrixMultiplyAffineSSE,
+   esMatrixTransposeSSE,
+   esMatrixTransformVec4SSE,
+   esMatrixMultiplyBatchAVX
+};
+
+///
+// esCpuHasAVX()
+//
+//    AVX needs both the CPU flag and OS support for saving the YMM registers
+//
+static int esCpuHasAVX ( void )
+{
+#ifdef _MSC_VER
+   int info[4];
+   __cpuid ( info, 1 );
+
+   if ( ( info[2] & ( 1 << 27 ) ) && ( info[2] & ( 1 << 28 ) ) )
+   {
+      return ( _xgetbv ( 0 ) & 0x6 ) == 0x6;
+   }
+
+   return 0;
+#else
+   __builtin_cpu_init ( );
+   return __builtin_cpu_supports ( "avx" );
+#endif
+}
+
+#endif // ES_MATRIX_AVX
+
+#ifdef ES_MATRIX_NEON
+
+static __inline float32x4_t esRowMultiplyNEON ( const GLfloat *row, float32x4_t b0, float32x4_t b1,
+                                                float32x4_t b2, float32x4_t b3 )
+{
+   float32x4_t r = vmulq_n_f32 ( b0, row[0] );
+   r = vaddq_f32 ( r, vmulq_n_f32 ( b1, row[1] ) );
+   r = vaddq_f32 ( r, vmulq_n_f32 ( b2, row[2] ) );
+   return vaddq_f32 ( r, vmulq_n_f32 ( b3, row[3] ) );
+}
+
+static void esMatrixMultiplyNEON ( ESMatrix *result, const ESMatrix *srcA, const ESMatrix *srcB )
+{
+   float32x4_t b0 = vld1q_f32 ( srcB->m[0] );
+   float32x4_t b1 = vld1q_f32 ( srcB->m[1] );
+   float32x4_t b2 = vld1q_f32 ( srcB->m[2] );
+   float32x4_t b3 = vld1q_f32 ( srcB->m[3] );
+   float32x4_t r0 = esRowMultiplyNEON ( srcA->m[0], b0, b1, b2, b3 );
+   float32x4_t r1 = esRowMultiplyNEON ( srcA->m[1], b0, b1, b2, b3 );
+   float32x4_t r2 = esRowMultiplyNEON ( srcA->m[2], b0, b1, b2, b3 );
+   float32x4_t r3 = esRowMultiplyNEON ( srcA->m[3], b0, b1, b2, b3 );
+
+   vst1q_f32 ( result->m[0], r0 );
+   vst1q_f32 ( result->m[1], r1 );
+   vst1q_f32 ( result->m[2], r2 );
+   vst1q_f32 ( result->m[3], r3 );
+}
+
+static void esMatrixTransposeNEON ( ESMatrix *result, const ESMatrix *src )
+{
+   // de-interleaving load, val[i] is column i of src
+   float32x4x4_t cols = vld4q_f32 ( &src->m[0][0] );
+
+   vst1q_f32 ( result->m[0], cols.val[0] );
+   vst1q_f32 ( result->m[1], cols.val[1] );
+   vst1q_f32 ( result->m[2], cols.val[2] );
+   vst1q_f32 ( result->m[3], cols.val[3] );
+}
+
+static void esMatrixTransformVec4NEON ( GLfloat *result, const ESMatrix *matrix, const GLfloat *vec )
+{
+   float32x4_t r = esRowMultiplyNEON ( vec, vld1q_f32 ( matrix->m[0] ), vld1q_f32 ( matrix->m[1] ),
+                                       vld1q_f32 ( matrix->m[2] ), vld1q_f32 ( matrix->m[3] ) );
+   vst1q_f32 ( result, r );
+}
+
+static void esMatrixMultiplyBatchNEON ( char *result, GLsizei resultStride, const char *srcA, GLsizei srcStride,
+                                        const ESMatrix *srcB, int count )
+{
+   float32x4_t b0 = vld1q_f32 ( srcB->m[0] );
+   float32x4_t b1 = vld1q_f32 ( srcB->m[1] );
+   float32x4_t b2 = vld1q_f32 ( srcB->m[2] );
+   float32x4_t b3 = vld1q_f32 ( srcB->m[3] );
+   int i;
+
+   for ( i = 0; i < count; i++ )
+   {
+      const ESMatrix *a = ( const ESMatrix * ) ( srcA + i * srcStride );
+      ESMatrix *r = ( ESMatrix * ) ( result + i * resultStride );
+      float32x4_t r0 = esRowMultiplyNEON ( a->m[0], b0, b1, b2, b3 );
+      float32x4_t r1 = esRowMultiplyNEON ( a->m[1], b0, b1, b2, b3 );
+      float32x4_t r2 = esRowMultiplyNEON ( a->m[2], b0, b1, b2, b3 );
+      float32x4_t r3 = esRowMultiplyNEON ( a->m[3], b0, b1, b2, b3 );
+
+      vst1q_f32 ( r->m[0], r0 );
+      vst1q_f32 ( r->m[1], r1 );
+      vst1q_f32 ( r->m[2], r2 );
+      vst1q_f32 ( r->m[3], r3 );
+   }
+}
+
+static const ESMatrixKernels s_neonKernels =
+{
+   "neon",
+   esMatrixMultiplyNEON,
+   esMatrixMultiplyAffineScalar,
+   esMatrixTransposeNEON,
+   esMatrixTransformVec4NEON,
+   esMatrixMultiplyBatchNEON
+};
+
+#endif // ES_MATRIX_NEON
+
+static ESOnce s_kernelsOnce = ES_ONCE_INIT;
+static const ESMatrixKernels *s_kernels = NULL;
+
+///
+// esSelectMatrixKernels()
+//
+//    Pick the best kernels for the running CPU, called once through s_kernelsOnce
+//
+static void esSelectMatrixKernels ( void )
+{
+   // ES_MATRIX_SCALAR=1 forces the reference kernels, e.g. to compare results
+   const char *forceScalar = getenv ( "ES_MATRIX_SCALAR" );
+
+   if ( forceScalar != NULL && forceScalar[0] == '1' )
+   {
+      s_kernels = &s_scalarKernels;
+   }
+   else
+   {
+#if defined ( ES_MATRIX_AVX )
+      s_kernels = esCpuHasAVX ( ) ? &s_avxKernels : &s_sseKernels;
+#elif defined ( ES_MATRIX_SSE )
+      s_kernels = &s_sseKernels;
+#elif defined ( ES_MATRIX_NEON )
+      s_kernels = &s_neonKernels;
+#else
+      s_kernels = &s_scalarKernels;
+#endif
+   }
+}
+
+///
+// esGetMatrixKernels()
+//
+//    Kernels for the running CPU, safe to call from any thread
+//
+static const ESMatrixKernels *esGetMatrixKernels ( void )
+{
+   esOnce ( &s_kernelsOnce, esSelectMatrixKernels );
+   return s_kernels;
+}
+
+///
+// esMatrixBuildTRS()
+//
+//    Same matrices as esMatrixLoadIdentity, esTranslate, esRotate, esScale
+//    in this order, written directly instead of through the multiplies.
+//    Each source array is read sequentially so the loop stays cache friendly.
+//
+static void esMatrixBuildTRS ( char *result, GLsizei resultStride, const ESTRSArrays *src, int first, int count )
+{
+   int i;
+
+   for ( i = first; i < first + count; i++ )
+   {
+      ESMatrix *r = ( ESMatrix * ) ( result + ( i - first ) * resultStride );
+      GLfloat angle = ( src->angle != NULL ) ? src->angle[i] : src->defaultAngle;
+      GLfloat scale = ( src->scale != NULL ) ? src->scale[i] : 1.0f;
+      GLfloat x = 0.0f, y = 0.0f, z = 0.0f, mag = 0.0f;
+
+      if ( src->axisX != NULL )
+      {
+         x = src->axisX[i];
+         y = src->axisY[i];
+         z = src->axisZ[i];
+         mag = sqrtf ( x * x + y * y + z * z );
+      }
+
+      if ( mag > 0.0f )
+      {
+         GLfloat sinAngle = sinf ( angle * PI / 180.0f );
+         GLfloat cosAngle = cosf ( angle * PI / 180.0f );
+         GLfloat oneMinusCos = 1.0f - cosAngle;
+         GLfloat xs, ys, zs;
+
+         x /= mag;
+         y /= mag;
+         z /= mag;
+         xs = x * sinAngle;
+         ys = y * sinAngle;
+         zs = z * sinAngle;
+
+         r->m[0][0] = ( ( oneMinusCos * ( x * x ) ) + cosAngle ) * scale;
+         r->m[0][1] = ( ( oneMinusCos * ( x * y ) ) - zs ) * scale;
+         r->m[0][2] = ( ( oneMinusCos * ( z * x ) ) + ys ) * scale;
+
+         r->m[1][0] = ( ( oneMinusCos * ( x * y ) ) + zs ) * scale;
+         r->m[1][1] = ( ( oneMinusCos * ( y * y ) ) + cosAngle ) * scale;
+         r->m[1][2] = ( ( oneMinusCos * ( y * z ) ) - xs ) * scale;
+
+         r->m[2][0] = ( ( oneMinusCos * ( z * x ) ) - ys ) * scale;
+         r->m[2][1] = ( ( oneMinusCos * ( y * z ) ) + xs ) * scale;
+         r->m[2][2] = ( ( oneMinusCos * ( z * z ) ) + cosAngle ) * scale;
+      }
+      else
+      {
+         r->m[0][0] = scale;
+         r->m[0][1] = 0.0f;
+         r->m[0][2] = 0.0f;
+         r->m[1][0] = 0.0f;
+         r->m[1][1] = scale;
+         r->m[1][2] = 0.0f;
+         r->m[2][0] = 0.0f;
+         r->m[2][1] = 0.0f;
+         r->m[2][2] = scale;
+      }
+
+      r->m[0][3] = 0.0f;
+      r->m[1][3] = 0.0f;
+      r->m[2][3] = 0.0f;
+
+      r->m[3][0] = src->posX[i];
+      r->m[3][1] = src->posY[i];
+      r->m[3][2] = src->posZ[i];
+      r->m[3][3] = 1.0f;
+   }
+}
+
+// Smaller batches are not worth waking up the worker threads for
+#define ES_MATRIX_BATCH_CHUNK   ( 4096 )
+#define ES_MATRIX_BATCH_MAX_JOB ( 32 )
+
+typedef struct
+{
+   char              *result;
+   GLsizei            resultStride;
+   const char        *srcA;
+   GLsizei            srcStride;
+   const ESMatrix    *srcB;
+   const ESTRSArrays *trs;
+   int                first;
+   int                count;
+} ESMatrixBatchJob;
+
+static void esMatrixMultiplyBatchJob ( void *arg )
+{
+   ESMatrixBatchJob *job = ( ESMatrixBatchJob * ) arg;
+
+   esGetMatrixKernels ( )->multiplyBatch ( job->result, job->resultStride, job->srcA, job->srcStride,
+                                           job->srcB, job->count );
+}
+
+static void esMatrixBuildTRSJob ( void *arg )
+{
+   ESMatrixBatchJob *job = ( ESMatrixBatchJob * ) arg;
+
+   esMatrixBuildTRS ( job->result, job->resultStride, job->trs, job->first, job->count );
+}
+
+///
+// esMatrixRunBatch()
+//
+//    Split the batch in ranges over the shared job pool and wait for them
+//
+static void esMatrixRunBatch ( ESMatrixBatchJob *batch, void ( *func ) ( void * ), int count )
+{
+   ESMatrixBatchJob jobs[ES_MATRIX_BATCH_MAX_JOB];
+   ESJobGroup group = { 0 };
+   ESJobPool *pool;
+   int numJobs = count / ES_MATRIX_BATCH_CHUNK;
+   int first = 0;
+   int i;
+
+   numJobs = ( numJobs > esGetCpuCount ( ) ) ? esGetCpuCount ( ) : numJobs;
+   numJobs = ( numJobs > ES_MATRIX_BATCH_MAX_JOB ) ? ES_MATRIX_BATCH_MAX_JOB : numJobs;
+   pool = ( numJobs < 2 ) ? NULL : esGetJobPool ( );
+
+   if ( pool == NULL )
+   {
+      batch->first = 0;
+      batch->count = count;
+      func ( batch );
+      return;
+   }
+
+   for ( i = 0; i < numJobs; i++ )
+   {
+      int last = ( int ) ( ( long long ) count * ( i + 1 ) / numJobs );
+
+      jobs[i] = *batch;
+      jobs[i].first = first;
+      jobs[i].count = last - first;
+      jobs[i].result += ( size_t ) first * batch->resultStride;
+
+      if ( jobs[i].srcA != NULL )
+      {
+         jobs[i].srcA += ( size_t ) first * batch->srcStride;
+      }
+
+      esJobPoolSubmit ( pool, &group, func, &jobs[i] );
+      first = last;
+   }
+
+   esJobPoolWait ( pool, &group );
+}
+
+///
+// esMatrixCofactor3()
+//
+//    Cofactors and determinant of the upper 3x3 part of a matrix
+//
+static void esMatrixCofactor3 ( ESMatrix3 *result, const ESMatrix *src, GLfloat *det )
+{
+   int i, j;
+
+   for ( i = 0; i < 3; i++ )
+   {
+      int i1 = ( i + 1 ) % 3;
+      int i2 = ( i + 2 ) % 3;
+
+      for ( j = 0; j < 3; j++ )
+      {
+         int j1 = ( j + 1 ) % 3;
+         int j2 = ( j + 2 ) % 3;
+
+         result->m[i][j] = src->m[i1][j1] * src->m[i2][j2] - src->m[i1][j2] * src->m[i2][j1];
+      }
+   }
+
+   *det = src->m[0][0] * result->m[0][0] + src->m[0][1] * result->m[0][1] + src->m[0][2] * result->m[0][2];
+}
+
+//////////////////////////////////////////////////////////////////
+//
+//  Public Functions
+//
+//
+
 void ESUTIL_API
 esScale ( ESMatrix *result, GLfloat sx, GLfloat sy, GLfloat sz )
 {
@@ -198,35 +887,242 @@ esOrtho ( ESMatrix *result, float left, float right, float bottom, float top, fl
 void ESUTIL_API
 esMatrixMultiply ( ESMatrix *result, ESMatrix *srcA, ESMatrix *srcB )
 {
+   esGetMatrixKernels ( )->multiply ( result, srcA, srcB );
+}
+
+void ESUTIL_API
+esMatrixMultiplyAffine ( ESMatrix *result, ESMatrix *srcA, ESMatrix *srcB )
+{
+   esGetMatrixKernels ( )->multiplyAffine ( result, srcA, srcB );
+}
+
+void ESUTIL_API
+esMatrixTranspose ( ESMatrix *result, ESMatrix *src )
+{
+   esGetMatrixKernels ( )->transpose ( result, src );
+}
+
+void ESUTIL_API
+esMatrixTransformVec4 ( GLfloat *result, ESMatrix *matrix, const GLfloat *vec )
+{
+   esGetMatrixKernels ( )->transformVec4 ( result, matrix, vec );
+}
+
+void ESUTIL_API
+esMatrixMultiplyBatch ( void *result, GLsizei resultStride, const void *srcA, GLsizei srcStride,
+                        ESMatrix *srcB, int count )
+{
+   resultStride = ( resultStride == 0 ) ? ( GLsizei ) sizeof ( ESMatrix ) : resultStride;
+   srcStride = ( srcStride == 0 ) ? ( GLsizei ) sizeof ( ESMatrix ) : srcStride;
+
+   esGetMatrixKernels ( )->multiplyBatch ( ( char * ) result, resultStride, ( const char * ) srcA, srcStride,
+                                           srcB, count );
+}
+
+void ESUTIL_API
+esMatrixMultiplyBatchParallel ( void *result, GLsizei resultStride, const void *srcA, GLsizei srcStride,
+                                ESMatrix *srcB, int count )
+{
+   ESMatrixBatchJob batch;
+
+   memset ( &batch, 0, sizeof ( batch ) );
+   batch.result = ( char * ) result;
+   batch.resultStride = ( resultStride == 0 ) ? ( GLsizei ) sizeof ( ESMatrix ) : resultStride;
+   batch.srcA = ( const char * ) srcA;
+   batch.srcStride = ( srcStride == 0 ) ? ( GLsizei ) sizeof ( ESMatrix ) : srcStride;
+   batch.srcB = srcB;
+
+   esMatrixRunBatch ( &batch, esMatrixMultiplyBatchJob, count );
+}
+
+void ESUTIL_API
+esMatrixBuildTRSBatch ( void *result, GLsizei resultStride, const ESTRSArrays *src, int count )
+{
+   resultStride = ( resultStride == 0 ) ? ( GLsizei ) sizeof ( ESMatrix ) : resultStride;
+
+   esMatrixBuildTRS ( ( char * ) result, resultStride, src, 0, count );
+}
+
+void ESUTIL_API
+esMatrixBuildTRSBatchParallel ( void *result, GLsizei resultStride, const ESTRSArrays *src, int count )
+{
+   ESMatrixBatchJob batch;
+
+   memset ( &batch, 0, sizeof ( batch ) );
+   batch.result = ( char * ) result;
+   batch.resultStride = ( resultStride == 0 ) ? ( GLsizei ) sizeof ( ESMatrix ) : resultStride;
+   batch.trs = src;
+
+   esMatrixRunBatch ( &batch, esMatrixBuildTRSJob, count );
+}
+
+const char *ESUTIL_API
+esMatrixKernelName ( void )
+{
+   return esGetMatrixKernels ( )->name;
+}
+
+
+GLboolean ESUTIL_API
+esMatrixInverse ( ESMatrix *result, ESMatrix *src )
+{
+   const GLfloat *a = &src->m[0][0];
+   GLfloat inv[16];
+   GLfloat det;
+   int i;
+
+   // cofactors of the transposed matrix, the inverse of the stored array is
+   // the stored array of the inverse so the layout does not matter here
+   inv[0] = a[5] * a[10] * a[15] - a[5] * a[11] * a[14] - a[9] * a[6] * a[15] +
+            a[9] * a[7] * a[14] + a[13] * a[6] * a[11] - a[13] * a[7] * a[10];
+   inv[4] = -a[4] * a[10] * a[15] + a[4] * a[11] * a[14] + a[8] * a[6] * a[15] -
+            a[8] * a[7] * a[14] - a[12] * a[6] * a[11] + a[12] * a[7] * a[10];
+   inv[8] = a[4] * a[9] * a[15] - a[4] * a[11] * a[13] - a[8] * a[5] * a[15] +
+            a[8] * a[7] * a[13] + a[12] * a[5] * a[11] - a[12] * a[7] * a[9];
+   inv[12] = -a[4] * a[9] * a[14] + a[4] * a[10] * a[13] + a[8] * a[5] * a[14] -
+             a[8] * a[6] * a[13] - a[12] * a[5] * a[10] + a[12] * a[6] * a[9];
+   inv[1] = -a[1] * a[10] * a[15] + a[1] * a[11] * a[14] + a[9] * a[2] * a[15] -
+            a[9] * a[3] * a[14] - a[13] * a[2] * a[11] + a[13] * a[3] * a[10];
+   inv[5] = a[0] * a[10] * a[15] - a[0] * a[11] * a[14] - a[8] * a[2] * a[15] +
+            a[8] * a[3] * a[14] + a[12] * a[2] * a[11] - a[12] * a[3] * a[10];
+   inv[9] = -a[0] * a[9] * a[15] + a[0] * a[11] * a[13] + a[8] * a[1] * a[15] -
+            a[8] * a[3] * a[13] - a[12] * a[1] * a[11] + a[12] * a[3] * a[9];
+   inv[13] = a[0] * a[9] * a[14] - a[0] * a[10] * a[13] - a[8] * a[1] * a[14] +
+             a[8] * a[2] * a[13] + a[12] * a[1] * a[10] - a[12] * a[2] * a[9];
+   inv[2] = a[1] * a[6] * a[15] - a[1] * a[7] * a[14] - a[5] * a[2] * a[15] +
+            a[5] * a[3] * a[14] + a[13] * a[2] * a[7] - a[13] * a[3] * a[6];
+   inv[6] = -a[0] * a[6] * a[15] + a[0] * a[7] * a[14] + a[4] * a[2] * a[15] -
+            a[4] * a[3] * a[14] - a[12] * a[2] * a[7] + a[12] * a[3] * a[6];
+   inv[10] = a[0] * a[5] * a[15] - a[0] * a[7] * a[13] - a[4] * a[1] * a[15] +
+             a[4] * a[3] * a[13] + a[12] * a[1] * a[7] - a[12] * a[3] * a[5];
+   inv[14] = -a[0] * a[5] * a[14] + a[0] * a[6] * a[13] + a[4] * a[1] * a[14] -
+             a[4] * a[2] * a[13] - a[12] * a[1] * a[6] + a[12] * a[2] * a[5];
+   inv[3] = -a[1] * a[6] * a[11] + a[1] * a[7] * a[10] + a[5] * a[2] * a[11] -
+            a[5] * a[3] * a[10] - a[9] * a[2] * a[7] + a[9] * a[3] * a[6];
+   inv[7] = a[0] * a[6] * a[11] - a[0] * a[7] * a[10] - a[4] * a[2] * a[11] +
+            a[4] * a[3] * a[10] + a[8] * a[2] * a[7] - a[8] * a[3] * a[6];
+   inv[11] = -a[0] * a[5] * a[11] + a[0] * a[7] * a[9] + a[4] * a[1] * a[11] -
+             a[4] * a[3] * a[9] - a[8] * a[1] * a[7] + a[8] * a[3] * a[5];
+   inv[15] = a[0] * a[5] * a[10] - a[0] * a[6] * a[9] - a[4] * a[1] * a[10] +
+             a[4] * a[2] * a[9] + a[8] * a[1] * a[6] - a[8] * a[2] * a[5];
+
+   det = a[0] * inv[0] + a[1] * inv[4] + a[2] * inv[8] + a[3] * inv[12];
+
+   if ( det == 0.0f )
+   {
+      return GL_FALSE;
+   }
+
+   det = 1.0f / det;
+
+   for ( i = 0; i < 16; i++ )
+   {
+      ( &result->m[0][0] ) [i] = inv[i] * det;
+   }
+
+   return GL_TRUE;
+}
+
+GLboolean ESUTIL_API
+esMatrixInverseAffine ( ESMatrix *result, ESMatrix *src )
+{
+   ESMatrix3   cof;
    ESMatrix    tmp;
-   int         i;
+   GLfloat     det;
+   int         i, j;
 
-   for ( i = 0; i < 4; i++ )
+   // inverse of the 3x3 part is transpose ( cofactors ) / det
+   esMatrixCofactor3 ( &cof, src, &det );
+
+   if ( det == 0.0f )
    {
-      tmp.m[i][0] =  ( srcA->m[i][0] * srcB->m[0][0] ) +
-                     ( srcA->m[i][1] * srcB->m[1][0] ) +
-                     ( srcA->m[i][2] * srcB->m[2][0] ) +
-                     ( srcA->m[i][3] * srcB->m[3][0] ) ;
+      return GL_FALSE;
+   }
 
-      tmp.m[i][1] =  ( srcA->m[i][0] * srcB->m[0][1] ) +
-                     ( srcA->m[i][1] * srcB->m[1][1] ) +
-                     ( srcA->m[i][2] * srcB->m[2][1] ) +
-                     ( srcA->m[i][3] * srcB->m[3][1] ) ;
+   det = 1.0f / det;
 
-      tmp.m[i][2] =  ( srcA->m[i][0] * srcB->m[0][2] ) +
-                     ( srcA->m[i][1] * srcB->m[1][2] ) +
-                     ( srcA->m[i][2] * srcB->m[2][2] ) +
-                     ( srcA->m[i][3] * srcB->m[3][2] ) ;
+   for ( i = 0; i < 3; i++ )
+   {
+      for ( j = 0; j < 3; j++ )
+      {
+         tmp.m[i][j] = cof.m[j][i] * det;
+      }
 
-      tmp.m[i][3] =  ( srcA->m[i][0] * srcB->m[0][3] ) +
-                     ( srcA->m[i][1] * srcB->m[1][3] ) +
-                     ( srcA->m[i][2] * srcB->m[2][3] ) +
-                     ( srcA->m[i][3] * srcB->m[3][3] ) ;
+      tmp.m[i][3] = 0.0f;
    }
 
-   memcpy ( result, &tmp, sizeof ( ESMatrix ) );
+   // translation is -t * inverse ( 3x3 )
+   for ( j = 0; j < 3; j++ )
+   {
+      tmp.m[3][j] = - ( src->m[3][0] * tmp.m[0][j] + src->m[3][1] * tmp.m[1][j] + src->m[3][2] * tmp.m[2][j] );
+   }
+
+   tmp.m[3][3] = 1.0f;
+   *result = tmp;
+   return GL_TRUE;
 }
 
+void ESUTIL_API
+esMatrixNormalMatrix ( ESMatrix3 *result, const ESMatrix *src )
+{
+   GLfloat     det;
+   int         i, j;
+
+   // transpose ( inverse ( M ) ) is cofactors / det, a singular matrix keeps
+   // the cofactors which still give usable directions
+   esMatrixCofactor3 ( result, src, &det );
+
+   if ( det != 0.0f && det != 1.0f )
+   {
+      det = 1.0f / det;
+
+      for ( i = 0; i < 3; i++ )
+      {
+         for ( j = 0; j < 3; j++ )
+         {
+            result->m[i][j] *= det;
+         }
+      }
+   }
+}
+
+void ESUTIL_API
+esMatrixNormalMatrixRigid ( ESMatrix3 *result, const ESMatrix *src )
+{
+   int i;
+
+   for ( i = 0; i < 3; i++ )
+   {
+      result->m[i][0] = src->m[i][0];
+      result->m[i][1] = src->m[i][1];
+      result->m[i][2] = src->m[i][2];
+   }
+}
+
+void ESUTIL_API
+esMatrixNormalMatrixBatch ( void *result, GLsizei resultStride, const void *src, GLsizei srcStride,
+                            int count, GLboolean rigid )
+{
+   int i;
+
+   resultStride = ( resultStride == 0 ) ? ( GLsizei ) sizeof ( ESMatrix3 ) : resultStride;
+   srcStride = ( srcStride == 0 ) ? ( GLsizei ) sizeof ( ESMatrix ) : srcStride;
+
+   for ( i = 0; i < count; i++ )
+   {
+      ESMatrix3 *r = ( ESMatrix3 * ) ( ( char * ) result + i * resultStride );
+      const ESMatrix *m = ( const ESMatrix * ) ( ( const char * ) src + i * srcStride );
+
+      if ( rigid )
+      {
+         esMatrixNormalMatrixRigid ( r, m );
+      }
+      else
+      {
+         esMatrixNormalMatrix ( r, m );
+      }
+   }
+}
 
 void ESUTIL_API
 esMatrixLoadIdentity ( ESMatrix *result )
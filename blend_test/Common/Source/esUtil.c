@@ -43,6 +43,15 @@
 #include <stdlib.h>
 #include <stdarg.h>
 #include <string.h>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#elif !defined ( ANDROID )
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 #include "esUtil.h"
 #include "esUtil_win.h"
 
@@ -50,9 +59,6 @@
 #include <android/log.h>
 #include <android_native_app_glue.h>
 #include <android/asset_manager.h>
-typedef AAsset esFile;
-#else
-typedef FILE esFile;
 #endif
 
 #ifdef __APPLE__
@@ -119,6 +125,149 @@ EGLint GetContextRenderableType ( EGLDisplay eglDisplay )
    // extension is not supported
    return EGL_OPENGL_ES2_BIT;
 }
+
+///
+// HasEGLExtension()
+//
+//    Check whether the extension is in the EGL extension string
+//
+static GLboolean HasEGLExtension ( EGLDisplay eglDisplay, const char *name )
+{
+   const char *extensions = eglQueryString ( eglDisplay, EGL_EXTENSIONS );
+   size_t len = strlen ( name );
+
+   while ( extensions != NULL && ( extensions = strstr ( extensions, name ) ) != NULL )
+   {
+      // whole names only, EGL_EXT_foo must not match EGL_EXT_foo_bar
+      if ( extensions[len] == ' ' || extensions[len] == '\0' )
+      {
+         return GL_TRUE;
+      }
+      extensions += len;
+   }
+   return GL_FALSE;
+}
+
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+
+#define ES_HEADLESS_FRAMES      300
+
+// most fixed updates run in one frame
+#define ES_MAX_UPDATE_STEPS     8
+
+typedef EGLDisplay ( EGLAPIENTRYP ESGetPlatformDisplayProc ) ( EGLenum platform, void *native_display, const EGLint *attrib_list );
+
+///
+// IsHeadlessRequested()
+//
+//    ES_HEADLESS set to anything but "0" forces the headless mode
+//
+static GLboolean IsHeadlessRequested ( GLuint flags )
+{
+#ifndef ANDROID
+   const char *env = getenv ( "ES_HEADLESS" );
+
+   if ( env != NULL && env[0] != '\0' && strcmp ( env, "0" ) != 0 )
+   {
+      return GL_TRUE;
+   }
+#endif
+   return ( flags & ES_WINDOW_HEADLESS ) ? GL_TRUE : GL_FALSE;
+}
+
+///
+// GetHeadlessDisplay()
+//
+//    Use the Mesa surfaceless platform when there is one, it needs neither a display server
+//    nor a GPU.  Otherwise the default display is used, which still has pbuffers.
+//
+static EGLDisplay GetHeadlessDisplay ( void )
+{
+   // client extensions are queried without a display
+   const char *extensions = eglQueryString ( EGL_NO_DISPLAY, EGL_EXTENSIONS );
+
+   if ( extensions != NULL && strstr ( extensions, "EGL_MESA_platform_surfaceless" ) )
+   {
+      ESGetPlatformDisplayProc getPlatformDisplay =
+         ( ESGetPlatformDisplayProc ) eglGetProcAddress ( "eglGetPlatformDisplayEXT" );
+
+      if ( getPlatformDisplay != NULL )
+      {
+         EGLDisplay display = getPlatformDisplay ( EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL );
+
+         if ( display != EGL_NO_DISPLAY )
+         {
+            return display;
+         }
+      }
+   }
+   return eglGetDisplay ( EGL_DEFAULT_DISPLAY );
+}
+
+///
+// ChooseHeadlessConfig()
+//
+//    EGL sorts deeper color buffers first, so a 10 bit config may come before the 8 bit ones.
+//    Headless runs are compared with each other, so an 8 bit config is taken when there is one.
+//
+static EGLConfig ChooseHeadlessConfig ( EGLDisplay eglDisplay, const EGLint *attribList, EGLConfig defaultConfig )
+{
+   EGLConfig configs[64];
+   EGLint numConfigs = 0;
+   EGLint i;
+
+   if ( !eglChooseConfig ( eglDisplay, attribList, configs, 64, &numConfigs ) )
+   {
+      return defaultConfig;
+   }
+
+   for ( i = 0; i < numConfigs; i++ )
+   {
+      EGLint red = 0, green = 0, blue = 0;
+
+      eglGetConfigAttrib ( eglDisplay, configs[i], EGL_RED_SIZE, &red );
+      eglGetConfigAttrib ( eglDisplay, configs[i], EGL_GREEN_SIZE, &green );
+      eglGetConfigAttrib ( eglDisplay, configs[i], EGL_BLUE_SIZE, &blue );
+      if ( red == 8 && green == 8 && blue == 8 )
+      {
+         return configs[i];
+      }
+   }
+   return defaultConfig;
+}
+
+#ifndef EGL_BUFFER_AGE_EXT
+#define EGL_BUFFER_AGE_EXT 0x313D
+#endif
+
+typedef EGLBoolean ( EGLAPIENTRYP ESSwapBuffersWithDamageProc ) ( EGLDisplay dpy, EGLSurface surface, EGLint *rects, EGLint n_rects );
+
+// resolved on the first swap, the display does not change during the process
+static GLboolean s_extensionsQueried = GL_FALSE;
+static GLboolean s_hasBufferAge = GL_FALSE;
+static ESSwapBuffersWithDamageProc s_swapBuffersWithDamage = NULL;
+
+static void QuerySwapExtensions ( EGLDisplay eglDisplay )
+{
+   if ( s_extensionsQueried )
+   {
+      return;
+   }
+   s_extensionsQueried = GL_TRUE;
+
+   s_hasBufferAge = HasEGLExtension ( eglDisplay, "EGL_EXT_buffer_age" );
+
+   if ( HasEGLExtension ( eglDisplay, "EGL_KHR_swap_buffers_with_damage" ) )
+   {
+      s_swapBuffersWithDamage = ( ESSwapBuffersWithDamageProc ) eglGetProcAddress ( "eglSwapBuffersWithDamageKHR" );
+   }
+   else if ( HasEGLExtension ( eglDisplay, "EGL_EXT_swap_buffers_with_damage" ) )
+   {
+      s_swapBuffersWithDamage = ( ESSwapBuffersWithDamageProc ) eglGetProcAddress ( "eglSwapBuffersWithDamageEXT" );
+   }
+}
 #endif
 
 //////////////////////////////////////////////////////////////////
@@ -138,6 +287,7 @@ EGLint GetContextRenderableType ( EGLDisplay eglDisplay )
 //          ES_WINDOW_DEPTH       - specifies that a depth buffer should be created
 //          ES_WINDOW_STENCIL     - specifies that a stencil buffer should be created
 //          ES_WINDOW_MULTISAMPLE - specifies that a multi-sample buffer should be created
+//          ES_WINDOW_HEADLESS    - specifies that no window is created, rendering goes to an EGL pbuffer
 //
 GLboolean ESUTIL_API esCreateWindow ( ESContext *esContext, const char *title, GLint width, GLint height, GLuint flags )
 {
@@ -162,12 +312,32 @@ GLboolean ESUTIL_API esCreateWindow ( ESContext *esContext, const char *title, G
    esContext->height = height;
 #endif
 
-   if ( !WinCreate ( esContext, title ) )
+   esContext->headless = IsHeadlessRequested ( flags );
+
+#ifndef ANDROID
+   if ( getenv ( "ES_FRAME_RATE" ) != NULL )
    {
-      return GL_FALSE;
+      esSetFrameRate ( esContext, ( float ) atof ( getenv ( "ES_FRAME_RATE" ) ) );
+   }
+   if ( getenv ( "ES_FIXED_TIME_STEP" ) != NULL )
+   {
+      esSetFixedTimeStep ( esContext, ( float ) atof ( getenv ( "ES_FIXED_TIME_STEP" ) ) );
    }
+#endif
+
+   if ( esContext->headless )
+   {
+      esContext->eglDisplay = GetHeadlessDisplay ();
+   }
+   else
+   {
+      if ( !WinCreate ( esContext, title ) )
+      {
+         return GL_FALSE;
+      }
 
-   esContext->eglDisplay = eglGetDisplay( esContext->eglNativeDisplay );
+      esContext->eglDisplay = eglGetDisplay( esContext->eglNativeDisplay );
+   }
    if ( esContext->eglDisplay == EGL_NO_DISPLAY )
    {
       return GL_FALSE;
@@ -190,6 +360,7 @@ GLboolean ESUTIL_API esCreateWindow ( ESContext *esContext, const char *title, G
          EGL_DEPTH_SIZE,     ( flags & ES_WINDOW_DEPTH ) ? 8 : EGL_DONT_CARE,
          EGL_STENCIL_SIZE,   ( flags & ES_WINDOW_STENCIL ) ? 8 : EGL_DONT_CARE,
          EGL_SAMPLE_BUFFERS, ( flags & ES_WINDOW_MULTISAMPLE ) ? 1 : 0,
+         EGL_SURFACE_TYPE,   esContext->headless ? EGL_PBUFFER_BIT : EGL_WINDOW_BIT,
          // if EGL_KHR_create_context extension is supported, then we will use
          // EGL_OPENGL_ES3_BIT_KHR instead of EGL_OPENGL_ES2_BIT in the attribute list
          EGL_RENDERABLE_TYPE, GetContextRenderableType ( esContext->eglDisplay ),
@@ -206,6 +377,11 @@ GLboolean ESUTIL_API esCreateWindow ( ESContext *esContext, const char *title, G
       {
          return GL_FALSE;
       }
+
+      if ( esContext->headless )
+      {
+         config = ChooseHeadlessConfig ( esContext->eglDisplay, attribList, config );
+      }
    }
 
 
@@ -219,8 +395,16 @@ GLboolean ESUTIL_API esCreateWindow ( ESContext *esContext, const char *title, G
 #endif // ANDROID
 
    // Create a surface
-   esContext->eglSurface = eglCreateWindowSurface ( esContext->eglDisplay, config, 
-                                                    esContext->eglNativeWindow, NULL );
+   if ( esContext->headless )
+   {
+      EGLint pbufferAttribs[] = { EGL_WIDTH, esContext->width, EGL_HEIGHT, esContext->height, EGL_NONE };
+      esContext->eglSurface = eglCreatePbufferSurface ( esContext->eglDisplay, config, pbufferAttribs );
+   }
+   else
+   {
+      esContext->eglSurface = eglCreateWindowSurface ( esContext->eglDisplay, config, 
+                                                       esContext->eglNativeWindow, NULL );
+   }
 
    if ( esContext->eglSurface == EGL_NO_SURFACE )
    {
@@ -248,6 +432,502 @@ GLboolean ESUTIL_API esCreateWindow ( ESContext *esContext, const char *title, G
    return GL_TRUE;
 }
 
+///
+//  Frame states
+//
+struct ESFrameStates
+{
+   size_t      size;
+   char       *buffers;         // three states of size bytes, only the first one without update thread
+   int         updateIdx;       // state written by the update callback
+   int         readyIdx;        // newest finished state
+   int         drawIdx;         // state read by the draw callback
+   GLboolean   fresh;           // readyIdx was finished after the draw side took its state
+   GLboolean   threaded;
+   GLboolean   stop;
+   float       fixedDeltaTime;  // set by the headless and benchmark loops, every update gets this step
+   ESThread   *thread;
+   ESMutex    *mutex;
+   ESCond     *cond;
+};
+
+#define FRAME_STATE( states, idx )   ( ( states )->buffers + ( idx ) * ( states )->size )
+
+///
+//  UpdateFrame()
+//
+//      Call the update callback once with the elapsed time, or in fixed steps
+//
+static void UpdateFrame ( ESContext *esContext, float deltaTime )
+{
+   if ( esContext->updateFunc == NULL )
+   {
+      return;
+   }
+
+   if ( esContext->fixedTimeStep > 0.0 )
+   {
+      int steps = 0;
+
+      esContext->updateTimeLeft += deltaTime;
+      while ( esContext->updateTimeLeft >= esContext->fixedTimeStep )
+      {
+         // after a long stall the time left is dropped rather than updating for ever
+         if ( ++steps > ES_MAX_UPDATE_STEPS )
+         {
+            esContext->updateTimeLeft = 0.0;
+            break;
+         }
+         esContext->updateFunc ( esContext, ( float ) esContext->fixedTimeStep );
+         esContext->updateTimeLeft -= esContext->fixedTimeStep;
+      }
+   }
+   else
+   {
+      esContext->updateFunc ( esContext, deltaTime );
+   }
+}
+
+///
+//  UpdateThreadFunc()
+//
+//      Update, publish the state, then wait until the draw side took it: the next update
+//      runs while the state just published is drawn
+//
+static void UpdateThreadFunc ( void *arg )
+{
+   ESContext *esContext = ( ESContext * ) arg;
+   ESFrameStates *states = esContext->frameStates;
+   double lastTime = esGetTime ();
+
+   esMutexLock ( states->mutex );
+   while ( !states->stop )
+   {
+      double now;
+      int finishedIdx;
+      float fixedDeltaTime = states->fixedDeltaTime;
+
+      esMutexUnlock ( states->mutex );
+
+      now = esGetTime ();
+      if ( fixedDeltaTime > 0.0f )
+      {
+         esContext->updateFunc ( esContext, fixedDeltaTime );
+      }
+      else
+      {
+         UpdateFrame ( esContext, ( float ) ( now - lastTime ) );
+      }
+      lastTime = now;
+
+      esMutexLock ( states->mutex );
+      finishedIdx = states->updateIdx;
+      states->updateIdx = states->readyIdx;
+      states->readyIdx = finishedIdx;
+      states->fresh = GL_TRUE;
+      esCondBroadcast ( states->cond );
+      esMutexUnlock ( states->mutex );
+
+      // the next update goes on from the state just finished, which is only read from now on
+      memcpy ( FRAME_STATE ( states, states->updateIdx ), FRAME_STATE ( states, finishedIdx ), states->size );
+
+      esMutexLock ( states->mutex );
+      while ( states->fresh && !states->stop )
+      {
+         esCondWait ( states->cond, states->mutex );
+      }
+   }
+   esMutexUnlock ( states->mutex );
+}
+
+///
+//  AcquireDrawState()
+//
+//      Give the newest finished state to the draw side, starting the update thread on the
+//      first frame.  If wait is set, wait for a state finished after the last one drawn.
+//
+static void AcquireDrawState ( ESContext *esContext, GLboolean wait )
+{
+   ESFrameStates *states = esContext->frameStates;
+
+   if ( states->thread == NULL )
+   {
+      states->thread = esThreadCreate ( UpdateThreadFunc, esContext );
+      if ( states->thread == NULL )
+      {
+         // no thread, update and draw the same state on this thread from now on
+         esLogMessage ( "Could not start the update thread\n" );
+         states->threaded = GL_FALSE;
+         states->drawIdx = states->updateIdx;
+         if ( states->fixedDeltaTime > 0.0f )
+         {
+            esContext->updateFunc ( esContext, states->fixedDeltaTime );
+         }
+         return;
+      }
+   }
+
+   esMutexLock ( states->mutex );
+   while ( wait && !states->fresh && states->thread != NULL )
+   {
+      esCondWait ( states->cond, states->mutex );
+   }
+   if ( states->fresh )
+   {
+      int drawIdx = states->drawIdx;
+
+      states->drawIdx = states->readyIdx;
+      states->readyIdx = drawIdx;
+      states->fresh = GL_FALSE;
+      esCondBroadcast ( states->cond );
+   }
+   esMutexUnlock ( states->mutex );
+}
+
+static GLboolean IsUpdateThreaded ( ESContext *esContext )
+{
+   return ( esContext->frameStates != NULL && esContext->frameStates->threaded && esContext->updateFunc != NULL ) ? GL_TRUE : GL_FALSE;
+}
+
+///
+//  UpdateFixedStep()
+//
+//      Update of the headless and benchmark loops, every frame is one deltaTime step
+//      and draws the state of exactly that step, with or without update thread
+//
+static void UpdateFixedStep ( ESContext *esContext, float deltaTime )
+{
+   if ( IsUpdateThreaded ( esContext ) )
+   {
+      // read by the update thread with the mutex held
+      esMutexLock ( esContext->frameStates->mutex );
+      esContext->frameStates->fixedDeltaTime = deltaTime;
+      esMutexUnlock ( esContext->frameStates->mutex );
+      AcquireDrawState ( esContext, GL_TRUE );
+   }
+   else if ( esContext->updateFunc != NULL )
+   {
+      esContext->updateFunc ( esContext, deltaTime );
+   }
+}
+
+///
+//  FrameStatesDestroy()
+//
+void FrameStatesDestroy ( ESContext *esContext )
+{
+   ESFrameStates *states = esContext->frameStates;
+
+   if ( states == NULL )
+   {
+      return;
+   }
+
+   if ( states->thread != NULL )
+   {
+      esMutexLock ( states->mutex );
+      states->stop = GL_TRUE;
+      esCondBroadcast ( states->cond );
+      esMutexUnlock ( states->mutex );
+      esThreadJoin ( states->thread );
+   }
+   if ( states->mutex != NULL )
+   {
+      esMutexDestroy ( states->mutex );
+   }
+   if ( states->cond != NULL )
+   {
+      esCondDestroy ( states->cond );
+   }
+   free ( states->buffers );
+   free ( states );
+   esContext->frameStates = NULL;
+}
+
+///
+//  HeadlessLoop()
+//
+//      Run ES_HEADLESS_FRAMES frames, or the number in the ES_HEADLESS_FRAMES environment
+//      variable.  The time step is a fixed 1/60 second so that every run renders the same frames.
+//
+void HeadlessLoop ( ESContext *esContext )
+{
+   int numFrames = ES_HEADLESS_FRAMES;
+   int frame;
+#ifndef ANDROID
+   const char *env = getenv ( "ES_HEADLESS_FRAMES" );
+
+   if ( env != NULL && atoi ( env ) > 0 )
+   {
+      numFrames = atoi ( env );
+   }
+#endif
+
+   for ( frame = 0; frame < numFrames; frame++ )
+   {
+      UpdateFixedStep ( esContext, 1.0f / 60.0f );
+      if ( esContext->drawFunc != NULL )
+      {
+         esContext->drawFunc ( esContext );
+      }
+      esSwapBuffers ( esContext );
+   }
+
+   // everything submitted is executed before the caller tears the context down
+   glFinish ();
+}
+
+///
+//  RunFrame()
+//
+void RunFrame ( ESContext *esContext )
+{
+   double now;
+   float deltaTime;
+
+   if ( esContext->frameInterval > 0.0 )
+   {
+      if ( esContext->nextFrameTime > 0.0 )
+      {
+         esWaitUntil ( esContext->nextFrameTime );
+      }
+      now = esGetTime ();
+
+      // a late frame moves the schedule instead of rushing the next frames to catch up
+      esContext->nextFrameTime += esContext->frameInterval;
+      if ( esContext->nextFrameTime < now )
+      {
+         esContext->nextFrameTime = now + esContext->frameInterval;
+      }
+   }
+   else
+   {
+      now = esGetTime ();
+   }
+
+   deltaTime = ( esContext->lastFrameTime > 0.0 ) ? ( float ) ( now - esContext->lastFrameTime ) : 0.0f;
+   esContext->lastFrameTime = now;
+
+   if ( IsUpdateThreaded ( esContext ) )
+   {
+      // the update thread keeps its own clock, the newest state it finished is drawn
+      AcquireDrawState ( esContext, GL_FALSE );
+   }
+   else
+   {
+      UpdateFrame ( esContext, deltaTime );
+   }
+
+   if ( esContext->drawFunc != NULL )
+   {
+      esContext->drawFunc ( esContext );
+      esSwapBuffers ( esContext );
+   }
+}
+
+///
+//  GetEnvInt()
+//
+static int GetEnvInt ( const char *name, int defaultValue )
+{
+#ifndef ANDROID
+   const char *env = getenv ( name );
+
+   if ( env != NULL && atoi ( env ) > 0 )
+   {
+      return atoi ( env );
+   }
+#endif
+   return defaultValue;
+}
+
+///
+//  WriteStateStats()
+//
+//    Calls of the state tracker per frame, issued and elided
+//
+static void WriteStateStats ( FILE *file, const ESStateStats *stats, int count )
+{
+   const ESStateCounter *counters[4];
+   const char *names[4] = { "programs", "vertexArrays", "textures", "uniforms" };
+   int i;
+
+   counters[0] = &stats->programs;
+   counters[1] = &stats->vertexArrays;
+   counters[2] = &stats->textures;
+   counters[3] = &stats->uniforms;
+
+   fprintf ( file, "  \"stateCallsPerFrame\": {" );
+   for ( i = 0; i < 4; i++ )
+   {
+      fprintf ( file, " \"%s\": { \"issued\": %.2f, \"elided\": %.2f }%s", names[i],
+                ( double ) counters[i]->issued / count, ( double ) counters[i]->elided / count, ( i < 3 ) ? "," : "" );
+   }
+   fprintf ( file, " }\n" );
+}
+
+///
+//  BenchmarkRequested()
+//
+GLboolean BenchmarkRequested ( void )
+{
+#ifndef ANDROID
+   const char *env = getenv ( "ES_BENCHMARK" );
+
+   return ( env != NULL && env[0] != '\0' && strcmp ( env, "0" ) != 0 ) ? GL_TRUE : GL_FALSE;
+#else
+   return GL_FALSE;
+#endif
+}
+
+static int CompareDouble ( const void *a, const void *b )
+{
+   double da = *( const double * ) a;
+   double db = *( const double * ) b;
+
+   return ( da < db ) ? -1 : ( ( da > db ) ? 1 : 0 );
+}
+
+///
+//  WriteBenchmarkStats()
+//
+//      Sort the frame times and write min, median, 99th percentile (nearest rank), max
+//      and mean in milliseconds
+//
+static void WriteBenchmarkStats ( FILE *file, const char *name, double *times, int count, GLboolean last )
+{
+   double sum = 0.0;
+   int i;
+
+   qsort ( times, count, sizeof ( double ), CompareDouble );
+   for ( i = 0; i < count; i++ )
+   {
+      sum += times[i];
+   }
+
+   fprintf ( file, "  \"%s\": { \"min\": %.4f, \"median\": %.4f, \"p99\": %.4f, \"max\": %.4f, \"mean\": %.4f }%s\n",
+             name, times[0] * 1000.0, times[( count - 1 ) / 2] * 1000.0,
+             times[( count * 99 + 99 ) / 100 - 1] * 1000.0, times[count - 1] * 1000.0,
+             sum / count * 1000.0, last ? "" : "," );
+}
+
+///
+//  BenchmarkLoop()
+//
+//      ES_BENCHMARK_WARMUP frames (default 60) are run untimed, then ES_BENCHMARK_FRAMES
+//      frames (default 600) are timed.  Update, draw and swap are timed separately with a
+//      fixed 1/60 second time step, so every run renders the same frames.  The result is
+//      written as JSON to the file named by ES_BENCHMARK_OUTPUT, or to stdout.
+//
+void BenchmarkLoop ( ESContext *esContext )
+{
+   const float deltaTime = 1.0f / 60.0f;
+   int numWarmup = GetEnvInt ( "ES_BENCHMARK_WARMUP", 60 );
+   int numFrames = GetEnvInt ( "ES_BENCHMARK_FRAMES", 600 );
+   double *times = ( double * ) malloc ( 4 * numFrames * sizeof ( double ) );
+   double *updateTimes = times;
+   double *drawTimes = times + numFrames;
+   double *swapTimes = times + 2 * numFrames;
+   double *frameTimes = times + 3 * numFrames;
+   const char *outputName = NULL;
+   const char *renderer;
+   double start;
+   FILE *file = stdout;
+   ESStateStats stats;
+   int frame;
+
+   if ( times == NULL )
+   {
+      return;
+   }
+
+   start = esGetTime ();
+   for ( frame = -numWarmup; frame < numFrames; frame++ )
+   {
+      double t0, t1, t2, t3;
+
+      if ( frame == 0 )
+      {
+         start = esGetTime ();
+         esStateResetStats ();
+      }
+
+      // with the update thread this is the time waiting for the state of the frame
+      t0 = esGetTime ();
+      UpdateFixedStep ( esContext, deltaTime );
+      t1 = esGetTime ();
+      if ( esContext->drawFunc != NULL )
+      {
+         esContext->drawFunc ( esContext );
+      }
+      t2 = esGetTime ();
+      esSwapBuffers ( esContext );
+#ifndef __APPLE__
+      // a pbuffer swap does not wait for the GPU, so the wait is done here to time the frame
+      if ( esContext->headless )
+      {
+         glFinish ();
+      }
+#endif
+      t3 = esGetTime ();
+
+      if ( frame >= 0 )
+      {
+         updateTimes[frame] = t1 - t0;
+         drawTimes[frame] = t2 - t1;
+         swapTimes[frame] = t3 - t2;
+         frameTimes[frame] = t3 - t0;
+      }
+   }
+   start = esGetTime () - start;
+   esStateGetStats ( &stats );
+
+#ifndef ANDROID
+   outputName = getenv ( "ES_BENCHMARK_OUTPUT" );
+#endif
+   if ( outputName != NULL && outputName[0] != '\0' )
+   {
+      file = fopen ( outputName, "w" );
+      if ( file == NULL )
+      {
+         esLogMessage ( "BenchmarkLoop: can not open %s\n", outputName );
+         file = stdout;
+      }
+   }
+
+   renderer = ( const char * ) glGetString ( GL_RENDERER );
+   fprintf ( file, "{\n" );
+   fprintf ( file, "  \"renderer\": \"" );
+   for ( ; renderer != NULL && *renderer != '\0'; renderer++ )
+   {
+      if ( *renderer == '"' || *renderer == '\\' )
+      {
+         fputc ( '\\', file );
+      }
+      fputc ( *renderer, file );
+   }
+   fprintf ( file, "\",\n" );
+   fprintf ( file, "  \"width\": %d,\n  \"height\": %d,\n", esContext->width, esContext->height );
+#ifndef __APPLE__
+   fprintf ( file, "  \"headless\": %s,\n", esContext->headless ? "true" : "false" );
+#endif
+   fprintf ( file, "  \"warmupFrames\": %d,\n  \"frames\": %d,\n", numWarmup, numFrames );
+   fprintf ( file, "  \"deltaTime\": %.6f,\n", deltaTime );
+   fprintf ( file, "  \"totalSeconds\": %.4f,\n  \"fps\": %.2f,\n", start, numFrames / start );
+   WriteBenchmarkStats ( file, "update", updateTimes, numFrames, GL_FALSE );
+   WriteBenchmarkStats ( file, "draw", drawTimes, numFrames, GL_FALSE );
+   WriteBenchmarkStats ( file, "swap", swapTimes, numFrames, GL_FALSE );
+   WriteBenchmarkStats ( file, "frame", frameTimes, numFrames, GL_FALSE );
+   WriteStateStats ( file, &stats, numFrames );
+   fprintf ( file, "}\n" );
+
+   if ( file != stdout )
+   {
+      fclose ( file );
+   }
+   free ( times );
+}
+
 ///
 //  esRegisterDrawFunc()
 //
@@ -283,6 +963,153 @@ void ESUTIL_API esRegisterKeyFunc ( ESContext *esContext,
 }
 
 
+///
+//  esSetFrameRate()
+//
+void ESUTIL_API esSetFrameRate ( ESContext *esContext, float framesPerSecond )
+{
+   esContext->frameInterval = ( framesPerSecond > 0.0f ) ? 1.0 / framesPerSecond : 0.0;
+   esContext->nextFrameTime = 0.0;
+}
+
+///
+//  esSetFixedTimeStep()
+//
+void ESUTIL_API esSetFixedTimeStep ( ESContext *esContext, float timeStep )
+{
+   esContext->fixedTimeStep = ( timeStep > 0.0f ) ? timeStep : 0.0;
+   esContext->updateTimeLeft = 0.0;
+}
+
+///
+//  esRegisterFrameState()
+//
+GLboolean ESUTIL_API esRegisterFrameState ( ESContext *esContext, const void *initialState, size_t stateSize, GLboolean updateThread )
+{
+   ESFrameStates *states;
+   int numStates = updateThread ? 3 : 1;
+   int i;
+
+   FrameStatesDestroy ( esContext );
+
+   states = ( ESFrameStates * ) calloc ( 1, sizeof ( ESFrameStates ) );
+   if ( states == NULL )
+   {
+      return GL_FALSE;
+   }
+
+   states->size = stateSize;
+   states->buffers = ( char * ) malloc ( numStates * stateSize );
+   if ( states->buffers == NULL )
+   {
+      free ( states );
+      return GL_FALSE;
+   }
+   for ( i = 0; i < numStates; i++ )
+   {
+      memcpy ( FRAME_STATE ( states, i ), initialState, stateSize );
+   }
+
+   if ( updateThread )
+   {
+      states->threaded = GL_TRUE;
+      states->updateIdx = 0;
+      states->readyIdx = 1;
+      states->drawIdx = 2;
+      states->mutex = esMutexCreate ();
+      states->cond = esCondCreate ();
+      if ( states->mutex == NULL || states->cond == NULL )
+      {
+         esContext->frameStates = states;
+         FrameStatesDestroy ( esContext );
+         return GL_FALSE;
+      }
+   }
+
+   esContext->frameStates = states;
+   return GL_TRUE;
+}
+
+///
+//  esGetUpdateState()
+//
+void *ESUTIL_API esGetUpdateState ( ESContext *esContext )
+{
+   ESFrameStates *states = esContext->frameStates;
+
+   return ( states != NULL ) ? FRAME_STATE ( states, states->updateIdx ) : NULL;
+}
+
+///
+//  esGetDrawState()
+//
+const void *ESUTIL_API esGetDrawState ( ESContext *esContext )
+{
+   ESFrameStates *states = esContext->frameStates;
+
+   return ( states != NULL ) ? FRAME_STATE ( states, states->drawIdx ) : NULL;
+}
+
+///
+//  esGetBufferAge()
+//
+GLint ESUTIL_API esGetBufferAge ( ESContext *esContext )
+{
+#ifndef __APPLE__
+   EGLint age = 0;
+
+   QuerySwapExtensions ( esContext->eglDisplay );
+   if ( s_hasBufferAge && eglQuerySurface ( esContext->eglDisplay, esContext->eglSurface, EGL_BUFFER_AGE_EXT, &age ) )
+   {
+      return age;
+   }
+#endif
+   return 0;
+}
+
+///
+//  esSetSwapDamage()
+//
+void ESUTIL_API esSetSwapDamage ( ESContext *esContext, const GLint *rects, GLint numRects )
+{
+#ifndef __APPLE__
+   GLint i;
+
+   if ( rects == NULL || numRects <= 0 || numRects > ES_DAMAGE_RECT_MAX )
+   {
+      esContext->numDamageRects = 0;
+      return;
+   }
+
+   for ( i = 0; i < 4 * numRects; i++ )
+   {
+      esContext->damageRects[i] = rects[i];
+   }
+   esContext->numDamageRects = numRects;
+#endif
+}
+
+///
+//  esSwapBuffers()
+//
+void ESUTIL_API esSwapBuffers ( ESContext *esContext )
+{
+#ifndef __APPLE__
+   QuerySwapExtensions ( esContext->eglDisplay );
+
+   if ( s_swapBuffersWithDamage != NULL && esContext->numDamageRects > 0 )
+   {
+      s_swapBuffersWithDamage ( esContext->eglDisplay, esContext->eglSurface,
+                                esContext->damageRects, esContext->numDamageRects );
+   }
+   else
+   {
+      eglSwapBuffers ( esContext->eglDisplay, esContext->eglSurface );
+   }
+   esContext->numDamageRects = 0;
+#endif
+}
+
 ///
 // esLogMessage()
 //
@@ -306,73 +1133,219 @@ void ESUTIL_API esLogMessage ( const char *formatStr, ... )
 }
 
 ///
-// esFileRead()
+// esFileMap()
 //
-//    Wrapper for platform specific File open
+//    Map a whole file read-only, the pages are shared with the page cache
+//    and with the other processes mapping the file.  The mounted packs
+//    are searched before the disk.
 //
-static esFile *esFileOpen ( void *ioContext, const char *fileName )
+GLboolean ESUTIL_API esFileMap ( void *ioContext, const char *fileName, ESFileMap *map )
 {
-   esFile *pFile = NULL;
+#ifdef ANDROID
+   AAsset *asset = NULL;
+#elif defined ( _WIN32 )
+   HANDLE file, mapping;
+   LARGE_INTEGER size;
+#else
+   struct stat status;
+   void *data;
+   int fd;
+#endif
+
+   if ( esPackMap ( fileName, map ) )
+   {
+      return GL_TRUE;
+   }
+
+   memset ( map, 0, sizeof ( ESFileMap ) );
 
 #ifdef ANDROID
 
    if ( ioContext != NULL )
    {
-      AAssetManager *assetManager = ( AAssetManager * ) ioContext;
-      pFile = AAssetManager_open ( assetManager, fileName, AASSET_MODE_BUFFER );
+      asset = AAssetManager_open ( ( AAssetManager * ) ioContext, fileName, AASSET_MODE_BUFFER );
+   }
+
+   if ( asset == NULL )
+   {
+      return GL_FALSE;
+   }
+
+   // uncompressed assets are mapped from the apk, the others are inflated once by the asset manager
+   map->data = ( const unsigned char * ) AAsset_getBuffer ( asset );
+   map->size = ( size_t ) AAsset_getLength ( asset );
+   map->handle = asset;
+
+   if ( map->data == NULL && map->size != 0 )
+   {
+      AAsset_close ( asset );
+      memset ( map, 0, sizeof ( ESFileMap ) );
+      return GL_FALSE;
+   }
+
+#elif defined ( _WIN32 )
+
+   file = CreateFileA ( fileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+
+   if ( file == INVALID_HANDLE_VALUE )
+   {
+      return GL_FALSE;
+   }
+
+   if ( !GetFileSizeEx ( file, &size ) )
+   {
+      CloseHandle ( file );
+      return GL_FALSE;
+   }
+
+   // an empty file cannot be mapped, it has no data
+   if ( size.QuadPart != 0 )
+   {
+      mapping = CreateFileMappingA ( file, NULL, PAGE_READONLY, 0, 0, NULL );
+      map->data = ( mapping != NULL ) ? ( const unsigned char * ) MapViewOfFile ( mapping, FILE_MAP_READ, 0, 0, 0 ) : NULL;
+      map->size = ( size_t ) size.QuadPart;
+
+      // the view keeps the mapping alive
+      if ( mapping != NULL )
+      {
+         CloseHandle ( mapping );
+      }
+   }
+
+   CloseHandle ( file );
+
+   if ( map->data == NULL && map->size != 0 )
+   {
+      map->size = 0;
+      return GL_FALSE;
    }
 
 #else
+   ( void ) ioContext;
+
 #ifdef __APPLE__
    // iOS: Remap the filename to a path that can be opened from the bundle.
    fileName = GetBundleFileName ( fileName );
 #endif
 
-   pFile = fopen ( fileName, "rb" );
+   fd = open ( fileName, O_RDONLY );
+
+   if ( fd < 0 )
+   {
+      return GL_FALSE;
+   }
+
+   if ( fstat ( fd, &status ) != 0 )
+   {
+      close ( fd );
+      return GL_FALSE;
+   }
+
+   // an empty file cannot be mapped, it has no data
+   if ( status.st_size != 0 )
+   {
+      data = mmap ( NULL, ( size_t ) status.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+
+      if ( data == MAP_FAILED )
+      {
+         close ( fd );
+         return GL_FALSE;
+      }
+
+      map->data = ( const unsigned char * ) data;
+      map->size = ( size_t ) status.st_size;
+   }
+
+   // the mapping keeps the file alive
+   close ( fd );
+
 #endif
 
-   return pFile;
+   return GL_TRUE;
 }
 
 ///
-// esFileRead()
-//
-//    Wrapper for platform specific File close
+// esFileUnmap()
 //
-static void esFileClose ( esFile *pFile )
+void ESUTIL_API esFileUnmap ( ESFileMap *map )
 {
-   if ( pFile != NULL )
+   // the pack stays mapped, only an inflated entry is freed
+   if ( map->packed )
    {
+      free ( map->handle );
+      memset ( map, 0, sizeof ( ESFileMap ) );
+      return;
+   }
+
 #ifdef ANDROID
-      AAsset_close ( pFile );
+
+   if ( map->handle != NULL )
+   {
+      AAsset_close ( ( AAsset * ) map->handle );
+   }
+
+#elif defined ( _WIN32 )
+
+   if ( map->data != NULL )
+   {
+      UnmapViewOfFile ( map->data );
+   }
+
 #else
-      fclose ( pFile );
-      pFile = NULL;
-#endif
+
+   if ( map->data != NULL )
+   {
+      munmap ( ( void * ) map->data, map->size );
    }
+
+#endif
+
+   memset ( map, 0, sizeof ( ESFileMap ) );
 }
 
 ///
-// esFileRead()
+// esLoadTGAMapped()
 //
-//    Wrapper for platform specific File read
+//    Map a 8-bit, 24-bit or 32-bit TGA image, the pixels are read in place
 //
-static int esFileRead ( esFile *pFile, int bytesToRead, void *buffer )
+const char *ESUTIL_API esLoadTGAMapped ( void *ioContext, const char *fileName, ESFileMap *map,
+                                         int *width, int *height, int *bitsPerPixel )
 {
-   int bytesRead = 0;
+   TGA_HEADER   Header;
+   size_t       offset;
+   size_t       bytesToRead;
 
-   if ( pFile == NULL )
+   if ( !esFileMap ( ioContext, fileName, map ) )
    {
-      return bytesRead;
+      // Log error as 'error in opening the input file from apk'
+      esLogMessage ( "esLoadTGA FAILED to load : { %s }\n", fileName );
+      return NULL;
    }
 
-#ifdef ANDROID
-   bytesRead = AAsset_read ( pFile, buffer, bytesToRead );
-#else
-   bytesRead = fread ( buffer, bytesToRead, 1, pFile );
-#endif
+   if ( map->size < sizeof ( TGA_HEADER ) )
+   {
+      esFileUnmap ( map );
+      return NULL;
+   }
+
+   memcpy ( &Header, map->data, sizeof ( TGA_HEADER ) );
+
+   *width = Header.Width;
+   *height = Header.Height;
+   *bitsPerPixel = Header.ColorDepth;
 
-   return bytesRead;
+   // the pixels follow the image ID
+   offset = sizeof ( TGA_HEADER ) + Header.IdSize;
+   bytesToRead = ( size_t ) ( *width ) * ( *height ) * Header.ColorDepth / 8;
+
+   if ( ( Header.ColorDepth != 8 && Header.ColorDepth != 24 && Header.ColorDepth != 32 ) ||
+         offset > map->size || bytesToRead > map->size - offset )
+   {
+      esFileUnmap ( map );
+      return NULL;
+   }
+
+   return ( const char * ) map->data + offset;
 }
 
 ///
@@ -383,41 +1356,28 @@ static int esFileRead ( esFile *pFile, int bytesToRead, void *buffer )
 char *ESUTIL_API esLoadTGA ( void *ioContext, const char *fileName, int *width, int *height )
 {
    char        *buffer;
-   esFile      *fp;
-   TGA_HEADER   Header;
-   int          bytesRead;
+   const char  *pixels;
+   ESFileMap    map;
+   int          bitsPerPixel;
+   size_t       bytesToRead;
 
-   // Open the file for reading
-   fp = esFileOpen ( ioContext, fileName );
+   pixels = esLoadTGAMapped ( ioContext, fileName, &map, width, height, &bitsPerPixel );
 
-   if ( fp == NULL )
+   if ( pixels == NULL )
    {
-      // Log error as 'error in opening the input file from apk'
-      esLogMessage ( "esLoadTGA FAILED to load : { %s }\n", fileName );
       return NULL;
    }
 
-   bytesRead = esFileRead ( fp, sizeof ( TGA_HEADER ), &Header );
+   bytesToRead = ( size_t ) ( *width ) * ( *height ) * bitsPerPixel / 8;
 
-   *width = Header.Width;
-   *height = Header.Height;
+   // Allocate the image data buffer
+   buffer = ( char * ) malloc ( bytesToRead );
 
-   if ( Header.ColorDepth == 8 ||
-         Header.ColorDepth == 24 || Header.ColorDepth == 32 )
+   if ( buffer )
    {
-      int bytesToRead = sizeof ( char ) * ( *width ) * ( *height ) * Header.ColorDepth / 8;
-
-      // Allocate the image data buffer
-      buffer = ( char * ) malloc ( bytesToRead );
-
-      if ( buffer )
-      {
-         bytesRead = esFileRead ( fp, bytesToRead, buffer );
-         esFileClose ( fp );
-
-         return ( buffer );
-      }
+      memcpy ( buffer, pixels, bytesToRead );
    }
 
-   return ( NULL );
+   esFileUnmap ( &map );
+   return ( buffer );
 }
@@ -0,0 +1,735 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2013 Dan Ginsburg, Budirijanto Purnomo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+//
+// Book:      OpenGL(R) ES 3.0 Programming Guide, 2nd Edition
+// Authors:   Dan Ginsburg, Budirijanto Purnomo, Dave Shreiner, Aaftab Munshi
+// ISBN-10:   0-321-93388-5
+// ISBN-13:   978-0-321-93388-1
+// Publisher: Addison-Wesley Professional
+// URLs:      http://www.opengles-book.com
+//            http://my.safaribooksonline.com/book/animation-and-3d/9780133440133
+//
+//
+// esEtc.c
+//
+//    ETC2 and EAC block encoder of esTexConv.
+//
+//    Color blocks are searched in the ETC1 individual and differential
+//    modes and, from ES_ETC_QUALITY_MEDIUM on, the ETC2 planar mode; the
+//    T and H modes are not searched.  The quality picks how far the base
+//    colors are moved around the ones fitted to the pixels:
+//
+//       ES_ETC_QUALITY_FAST    the fitted colors only
+//       ES_ETC_QUALITY_MEDIUM  one step of a channel or of the brightness,
+//                              planar blocks
+//       ES_ETC_QUALITY_HIGH    steps of any channels until the error stops
+//                              falling
+//
+//    Alpha, red and red-green images use the EAC blocks.
+//
+
+///
+//  Includes
+//
+#include <string.h>
+#include "esEtc.h"
+
+///
+//  Macros
+//
+#define ETC_ERROR_MAX   0x7fffffff
+
+///
+//  Types
+//
+typedef struct
+{
+   int           color[3];
+   int           table;
+   int           error;
+   unsigned char index[8];
+} EtcSubblock;
+
+///
+//  Tables
+//
+static const int etcModifiers[8][2] =
+{
+   { 2, 8 }, { 5, 17 }, { 9, 29 }, { 13, 42 }, { 18, 60 }, { 24, 80 }, { 33, 106 }, { 47, 183 }
+};
+
+static const int eacModifiers[16][8] =
+{
+   { -3, -6, -9, -15, 2, 5, 8, 14 },
+   { -3, -7, -10, -13, 2, 6, 9, 12 },
+   { -2, -5, -8, -13, 1, 4, 7, 12 },
+   { -2, -4, -6, -13, 1, 3, 5, 12 },
+   { -3, -6, -8, -12, 2, 5, 7, 11 },
+   { -3, -7, -9, -11, 2, 6, 8, 10 },
+   { -4, -7, -8, -11, 3, 6, 7, 10 },
+   { -3, -5, -8, -11, 2, 4, 7, 10 },
+   { -2, -6, -8, -10, 1, 5, 7, 9 },
+   { -2, -5, -8, -10, 1, 4, 7, 9 },
+   { -2, -4, -8, -10, 1, 3, 7, 9 },
+   { -2, -5, -7, -10, 1, 4, 6, 9 },
+   { -3, -4, -7, -10, 2, 3, 6, 9 },
+   { -1, -2, -3, -10, 0, 1, 2, 9 },
+   { -4, -6, -8, -9, 3, 5, 7, 8 },
+   { -3, -5, -7, -9, 2, 4, 6, 8 }
+};
+
+///
+// Private Functions
+//
+
+///
+//  Clamp()
+//
+static int Clamp ( int value, int max )
+{
+   return ( value < 0 ) ? 0 : ( ( value > max ) ? max : value );
+}
+
+///
+//  Expand()
+//
+//    8 bit value of a base color stored with the given bits
+//
+static int Expand ( int value, int bits )
+{
+   return ( value << ( 8 - bits ) ) | ( value >> ( 2 * bits - 8 ) );
+}
+
+///
+//  Quantize()
+//
+static int Quantize ( int value, int bits )
+{
+   return Clamp ( ( value * ( ( 1 << bits ) - 1 ) + 127 ) / 255, ( 1 << bits ) - 1 );
+}
+
+///
+//  StoreBigEndian()
+//
+static void StoreBigEndian ( unsigned char *bytes, unsigned int value )
+{
+   bytes[0] = ( unsigned char ) ( value >> 24 );
+   bytes[1] = ( unsigned char ) ( value >> 16 );
+   bytes[2] = ( unsigned char ) ( value >> 8 );
+   bytes[3] = ( unsigned char ) value;
+}
+
+///
+//  FitSubblock()
+//
+//    Best modifier table and indices for a base color, the pixels are
+//    numbered down the columns like the indices of the block
+//
+static void FitSubblock ( const unsigned char pixels[16][4], const int members[8], int bits,
+                          const int color[3], EtcSubblock *sub )
+{
+   int base[3];
+   int table, k, c, m;
+
+   base[0] = Expand ( color[0], bits );
+   base[1] = Expand ( color[1], bits );
+   base[2] = Expand ( color[2], bits );
+
+   sub->error = ETC_ERROR_MAX;
+
+   for ( table = 0; table < 8; table++ )
+   {
+      unsigned char index[8];
+      int modifiers[4];
+      int error = 0;
+
+      modifiers[0] = etcModifiers[table][0];
+      modifiers[1] = etcModifiers[table][1];
+      modifiers[2] = -etcModifiers[table][0];
+      modifiers[3] = -etcModifiers[table][1];
+
+      for ( k = 0; k < 8 && error < sub->error; k++ )
+      {
+         const unsigned char *pixel = pixels[members[k]];
+         int best = ETC_ERROR_MAX;
+
+         for ( m = 0; m < 4; m++ )
+         {
+            int pixelError = 0;
+
+            for ( c = 0; c < 3; c++ )
+            {
+               int diff = Clamp ( base[c] + modifiers[m], 255 ) - pixel[c];
+               pixelError += diff * diff;
+            }
+
+            if ( pixelError < best )
+            {
+               best = pixelError;
+               index[k] = ( unsigned char ) m;
+            }
+         }
+
+         error += best;
+      }
+
+      if ( error < sub->error )
+      {
+         sub->error = error;
+         sub->table = table;
+         memcpy ( sub->index, index, sizeof ( index ) );
+      }
+   }
+
+   memcpy ( sub->color, color, sizeof ( sub->color ) );
+}
+
+///
+//  SearchSubblock()
+//
+//    Base color of a subblock, from the average of its pixels
+//
+static void SearchSubblock ( const unsigned char pixels[16][4], const int members[8], int bits,
+                             int quality, EtcSubblock *sub )
+{
+   int max = ( 1 << bits ) - 1;
+   int color[3];
+   int passes = ( quality >= ES_ETC_QUALITY_HIGH ) ? 8 : quality;
+   int pass, k, c;
+
+   for ( c = 0; c < 3; c++ )
+   {
+      int sum = 0;
+
+      for ( k = 0; k < 8; k++ )
+      {
+         sum += pixels[members[k]][c];
+      }
+
+      color[c] = Quantize ( ( sum + 4 ) / 8, bits );
+   }
+
+   FitSubblock ( pixels, members, bits, color, sub );
+
+   for ( pass = 0; pass < passes; pass++ )
+   {
+      EtcSubblock center = *sub;
+      int step;
+
+      for ( step = 0; step < 27; step++ )
+      {
+         EtcSubblock candidate;
+         int offset[3];
+         int moved;
+
+         offset[0] = step % 3 - 1;
+         offset[1] = step / 3 % 3 - 1;
+         offset[2] = step / 9 - 1;
+
+         // the medium quality only tries the 8 steps of one channel or of all of them
+         moved = ( offset[0] != 0 ) + ( offset[1] != 0 ) + ( offset[2] != 0 );
+         if ( quality < ES_ETC_QUALITY_HIGH && moved > 1 && ( offset[0] != offset[1] || offset[1] != offset[2] ) )
+         {
+            continue;
+         }
+
+         color[0] = center.color[0] + offset[0];
+         color[1] = center.color[1] + offset[1];
+         color[2] = center.color[2] + offset[2];
+
+         if ( step == 13 || color[0] < 0 || color[1] < 0 || color[2] < 0 ||
+               color[0] > max || color[1] > max || color[2] > max )
+         {
+            continue;
+         }
+
+         FitSubblock ( pixels, members, bits, color, &candidate );
+         if ( candidate.error < sub->error )
+         {
+            *sub = candidate;
+         }
+      }
+
+      if ( sub->error == center.error )
+      {
+         break;
+      }
+   }
+}
+
+///
+//  PackEtc1()
+//
+//    Individual or differential block, the differential base colors are in range
+//
+static void PackEtc1 ( const EtcSubblock sub[2], const int members[2][8], int differential, int flip,
+                       unsigned char block[8] )
+{
+   unsigned int indices = 0;
+   int s, k, c;
+
+   for ( c = 0; c < 3; c++ )
+   {
+      if ( differential )
+      {
+         block[c] = ( unsigned char ) ( ( sub[0].color[c] << 3 ) | ( ( sub[1].color[c] - sub[0].color[c] ) & 7 ) );
+      }
+      else
+      {
+         block[c] = ( unsigned char ) ( ( sub[0].color[c] << 4 ) | sub[1].color[c] );
+      }
+   }
+
+   block[3] = ( unsigned char ) ( ( sub[0].table << 5 ) | ( sub[1].table << 2 ) | ( differential << 1 ) | flip );
+
+   // the most significant bits of the indices are in the upper half
+   for ( s = 0; s < 2; s++ )
+   {
+      for ( k = 0; k < 8; k++ )
+      {
+         int i = members[s][k];
+
+         indices |= ( unsigned int ) ( sub[s].index[k] >> 1 ) << ( 16 + i );
+         indices |= ( unsigned int ) ( sub[s].index[k] & 1 ) << i;
+      }
+   }
+
+   StoreBigEndian ( block + 4, indices );
+}
+
+///
+//  ConstrainSubblock()
+//
+//    Differential pair with the second color moved next to the first one,
+//    the stored difference from the left or top color is -4 to 3
+//
+static void ConstrainSubblock ( const unsigned char pixels[16][4], const int members[8],
+                                const EtcSubblock *first, EtcSubblock *second, int lowest, int highest )
+{
+   int color[3];
+   int c;
+
+   for ( c = 0; c < 3; c++ )
+   {
+      int diff = second->color[c] - first->color[c];
+
+      color[c] = first->color[c] + ( ( diff < lowest ) ? lowest : ( ( diff > highest ) ? highest : diff ) );
+   }
+
+   FitSubblock ( pixels, members, 5, color, second );
+}
+
+///
+//  PlanarChannel()
+//
+//    Least squares plane of a channel, then the stored colors around it
+//    with the least error
+//
+static int PlanarChannel ( const unsigned char pixels[16][4], int c, int bits, int radius, int color[3] )
+{
+   int max = ( 1 << bits ) - 1;
+   float sum = 0.0f, sumX = 0.0f, sumY = 0.0f;
+   float slopeX, slopeY, origin;
+   int fitted[3];
+   int best = ETC_ERROR_MAX;
+   int o, h, v, i;
+
+   for ( i = 0; i < 16; i++ )
+   {
+      sum += pixels[i][c];
+      sumX += ( ( i >> 2 ) - 1.5f ) * pixels[i][c];
+      sumY += ( ( i & 3 ) - 1.5f ) * pixels[i][c];
+   }
+
+   slopeX = sumX / 20.0f;
+   slopeY = sumY / 20.0f;
+   origin = sum / 16.0f - 1.5f * slopeX - 1.5f * slopeY;
+
+   fitted[0] = Quantize ( ( int ) ( origin + 0.5f ), bits );
+   fitted[1] = Quantize ( ( int ) ( origin + 4.0f * slopeX + 0.5f ), bits );
+   fitted[2] = Quantize ( ( int ) ( origin + 4.0f * slopeY + 0.5f ), bits );
+
+   for ( o = fitted[0] - radius; o <= fitted[0] + radius; o++ )
+   {
+      for ( h = fitted[1] - radius; h <= fitted[1] + radius; h++ )
+      {
+         for ( v = fitted[2] - radius; v <= fitted[2] + radius; v++ )
+         {
+            int eo, eh, ev;
+            int error = 0;
+
+            if ( o < 0 || h < 0 || v < 0 || o > max || h > max || v > max )
+            {
+               continue;
+            }
+
+            eo = Expand ( o, bits );
+            eh = Expand ( h, bits );
+            ev = Expand ( v, bits );
+
+            for ( i = 0; i < 16 && error < best; i++ )
+            {
+               int x = i >> 2;
+               int y = i & 3;
+               int diff = Clamp ( ( x * ( eh - eo ) + y * ( ev - eo ) + 4 * eo + 2 ) >> 2, 255 ) - pixels[i][c];
+
+               error += diff * diff;
+            }
+
+            if ( error < best )
+            {
+               best = error;
+               color[0] = o;
+               color[1] = h;
+               color[2] = v;
+            }
+         }
+      }
+   }
+
+   return best;
+}
+
+///
+//  PackPlanar()
+//
+//    The red and green base colors of the differential mode have to stay in
+//    range and the blue one has to overflow, the free bits are set for that
+//
+static void PackPlanar ( const int red[3], const int green[3], const int blue[3], unsigned char block[8] )
+{
+   int low, delta;
+
+   block[0] = ( unsigned char ) ( ( red[0] << 1 ) | ( green[0] >> 6 ) );
+   block[1] = ( unsigned char ) ( ( ( green[0] & 0x3f ) << 1 ) | ( blue[0] >> 5 ) );
+   block[2] = ( unsigned char ) ( ( blue[0] & 0x18 ) | ( ( blue[0] >> 1 ) & 3 ) );
+   block[3] = ( unsigned char ) ( ( ( blue[0] & 1 ) << 7 ) | ( ( red[1] >> 1 ) << 2 ) | 2 | ( red[1] & 1 ) );
+   block[4] = ( unsigned char ) ( ( green[1] << 1 ) | ( blue[1] >> 5 ) );
+   block[5] = ( unsigned char ) ( ( ( blue[1] & 0x1f ) << 3 ) | ( red[2] >> 3 ) );
+   block[6] = ( unsigned char ) ( ( ( red[2] & 7 ) << 5 ) | ( green[2] >> 2 ) );
+   block[7] = ( unsigned char ) ( ( ( green[2] & 3 ) << 6 ) | blue[2] );
+
+   // a base of 0 to 15 only overflows downwards, 16 to 31 only upwards
+   if ( ( block[0] >> 3 ) + ( ( block[0] & 4 ) ? ( block[0] & 3 ) - 4 : ( block[0] & 3 ) ) < 0 )
+   {
+      block[0] |= 0x80;
+   }
+   if ( ( block[1] >> 3 ) + ( ( block[1] & 4 ) ? ( block[1] & 3 ) - 4 : ( block[1] & 3 ) ) < 0 )
+   {
+      block[1] |= 0x80;
+   }
+
+   low = ( block[2] >> 3 ) & 3;
+   delta = block[2] & 3;
+   block[2] |= ( low + delta < 4 ) ? 0x04 : 0xe0;
+}
+
+///
+//  EncodeColorBlock()
+//
+static void EncodeColorBlock ( const unsigned char pixels[16][4], int quality, unsigned char block[8] )
+{
+   int best = ETC_ERROR_MAX;
+   int flip, s, k;
+
+   for ( flip = 0; flip < 2; flip++ )
+   {
+      EtcSubblock individual[2], differential[2], constrained[2];
+      int members[2][8];
+      int counts[2] = { 0, 0 };
+      int i, c;
+      int inRange = 1;
+
+      // flipped blocks split into top and bottom, the others into left and right
+      for ( i = 0; i < 16; i++ )
+      {
+         s = flip ? ( ( i & 3 ) >= 2 ) : ( i >= 8 );
+         members[s][counts[s]++] = i;
+      }
+
+      for ( s = 0; s < 2; s++ )
+      {
+         SearchSubblock ( pixels, members[s], 4, quality, &individual[s] );
+         SearchSubblock ( pixels, members[s], 5, quality, &differential[s] );
+      }
+
+      if ( individual[0].error + individual[1].error < best )
+      {
+         best = individual[0].error + individual[1].error;
+         PackEtc1 ( individual, members, 0, flip, block );
+      }
+
+      for ( c = 0; c < 3; c++ )
+      {
+         k = differential[1].color[c] - differential[0].color[c];
+         inRange = inRange && k >= -4 && k <= 3;
+      }
+
+      // out of range pairs keep the better of their subblocks
+      if ( !inRange )
+      {
+         constrained[0] = differential[0];
+         constrained[1] = differential[1];
+         ConstrainSubblock ( pixels, members[1], &differential[0], &differential[1], -4, 3 );
+         ConstrainSubblock ( pixels, members[0], &constrained[1], &constrained[0], -3, 4 );
+
+         if ( constrained[0].error + constrained[1].error < differential[0].error + differential[1].error )
+         {
+            differential[0] = constrained[0];
+            differential[1] = constrained[1];
+         }
+      }
+
+      if ( differential[0].error + differential[1].error < best )
+      {
+         best = differential[0].error + differential[1].error;
+         PackEtc1 ( differential, members, 1, flip, block );
+      }
+   }
+
+   if ( quality >= ES_ETC_QUALITY_MEDIUM )
+   {
+      int red[3], green[3], blue[3];
+      int error = PlanarChannel ( pixels, 0, 6, quality, red ) +
+                  PlanarChannel ( pixels, 1, 7, quality, green ) +
+                  PlanarChannel ( pixels, 2, 6, quality, blue );
+
+      if ( error < best )
+      {
+         PackPlanar ( red, green, blue, block );
+      }
+   }
+}
+
+///
+//  EncodeEacBlock()
+//
+//    Values of 8 bits like alpha, or of 11 bits like the red and green of the
+//    EAC formats, where the base is scaled by 8 and a multiplier of 0 means
+//    a step of 1 that is of no use here
+//
+static void EncodeEacBlock ( const int values[16], int eleven, int quality, unsigned char block[8] )
+{
+   int radius = quality;
+   int max = eleven ? 2047 : 255;
+   int lo = values[0], hi = values[0];
+   int best = ETC_ERROR_MAX;
+   int bestBase = 0, bestMultiplier = 1, bestTable = 0;
+   unsigned char bestIndex[16];
+   unsigned int upper, lower;
+   int table, i;
+
+   memset ( bestIndex, 0, sizeof ( bestIndex ) );
+
+   for ( i = 1; i < 16; i++ )
+   {
+      lo = ( values[i] < lo ) ? values[i] : lo;
+      hi = ( values[i] > hi ) ? values[i] : hi;
+   }
+
+   // in steps of the base codeword
+   if ( eleven )
+   {
+      lo = ( lo - 4 ) / 8;
+      hi = ( hi - 4 + 7 ) / 8;
+   }
+
+   for ( table = 0; table < 16; table++ )
+   {
+      const int *modifiers = eacModifiers[table];
+      int span = modifiers[7] - modifiers[3];
+      int fittedMultiplier = Clamp ( ( hi - lo + span / 2 ) / span, 15 );
+      int multiplier;
+
+      fittedMultiplier = ( fittedMultiplier < 1 ) ? 1 : fittedMultiplier;
+
+      for ( multiplier = fittedMultiplier - radius; multiplier <= fittedMultiplier + radius; multiplier++ )
+      {
+         int fittedBase = Clamp ( ( lo + hi - multiplier * ( modifiers[7] + modifiers[3] ) + 1 ) / 2, 255 );
+         int base;
+
+         if ( multiplier < 1 || multiplier > 15 )
+         {
+            continue;
+         }
+
+         for ( base = fittedBase - radius; base <= fittedBase + radius; base++ )
+         {
+            unsigned char index[16];
+            int error = 0;
+            int m;
+
+            if ( base < 0 || base > 255 )
+            {
+               continue;
+            }
+
+            for ( i = 0; i < 16 && error < best; i++ )
+            {
+               int pixelBest = ETC_ERROR_MAX;
+
+               for ( m = 0; m < 8; m++ )
+               {
+                  int value = eleven ? base * 8 + 4 + modifiers[m] * multiplier * 8 : base + modifiers[m] * multiplier;
+                  int diff = Clamp ( value, max ) - values[i];
+
+                  if ( diff * diff < pixelBest )
+                  {
+                     pixelBest = diff * diff;
+                     index[i] = ( unsigned char ) m;
+                  }
+               }
+
+               error += pixelBest;
+            }
+
+            if ( error < best )
+            {
+               best = error;
+               bestBase = base;
+               bestMultiplier = multiplier;
+               bestTable = table;
+               memcpy ( bestIndex, index, sizeof ( index ) );
+            }
+         }
+      }
+   }
+
+   // 3 bit indices from the top, down the columns
+   upper = 0;
+   lower = 0;
+   for ( i = 0; i < 16; i++ )
+   {
+      int shift = 45 - 3 * i;
+
+      if ( shift >= 32 )
+      {
+         upper |= ( unsigned int ) bestIndex[i] << ( shift - 32 );
+      }
+      else
+      {
+         lower |= ( unsigned int ) bestIndex[i] << shift;
+         if ( shift > 29 )
+         {
+            upper |= ( unsigned int ) bestIndex[i] >> ( 32 - shift );
+         }
+      }
+   }
+
+   block[0] = ( unsigned char ) bestBase;
+   block[1] = ( unsigned char ) ( ( bestMultiplier << 4 ) | bestTable );
+   block[2] = ( unsigned char ) ( upper >> 8 );
+   block[3] = ( unsigned char ) upper;
+   StoreBigEndian ( block + 4, lower );
+}
+
+///
+//  Public Functions
+//
+
+///
+//  esEtcFormat()
+//
+GLenum esEtcFormat ( int channels )
+{
+   static const GLenum formats[4] =
+   {
+      GL_COMPRESSED_R11_EAC, GL_COMPRESSED_RG11_EAC, GL_COMPRESSED_RGB8_ETC2, GL_COMPRESSED_RGBA8_ETC2_EAC
+   };
+
+   return formats[channels - 1];
+}
+
+///
+//  esEtcSize()
+//
+unsigned int esEtcSize ( int width, int height, int channels )
+{
+   unsigned int blockBytes = ( channels == 1 || channels == 3 ) ? 8 : 16;
+
+   return ( ( width + 3 ) / 4 ) * ( ( height + 3 ) / 4 ) * blockBytes;
+}
+
+///
+//  esEtcEncode()
+//
+void esEtcEncode ( const unsigned char *pixels, int width, int height, int channels, int quality,
+                   unsigned char *blocks )
+{
+   int bx, by, i, c;
+
+   for ( by = 0; by < ( height + 3 ) / 4; by++ )
+   {
+      for ( bx = 0; bx < ( width + 3 ) / 4; bx++ )
+      {
+         unsigned char block[16][4];
+         int values[16];
+
+         for ( i = 0; i < 16; i++ )
+         {
+            int x = bx * 4 + ( i >> 2 );
+            int y = by * 4 + ( i & 3 );
+            const unsigned char *pixel;
+
+            x = ( x < width ) ? x : width - 1;
+            y = ( y < height ) ? y : height - 1;
+            pixel = pixels + ( y * width + x ) * channels;
+
+            for ( c = 0; c < channels; c++ )
+            {
+               block[i][c] = pixel[c];
+            }
+         }
+
+         // the alpha block comes before the color block, red before green
+         if ( channels >= 3 )
+         {
+            if ( channels == 4 )
+            {
+               for ( i = 0; i < 16; i++ )
+               {
+                  values[i] = block[i][3];
+               }
+
+               EncodeEacBlock ( values, 0, quality, blocks );
+               blocks += 8;
+            }
+
+            EncodeColorBlock ( ( const unsigned char ( * ) [4] ) block, quality, blocks );
+            blocks += 8;
+            continue;
+         }
+
+         for ( c = 0; c < channels; c++ )
+         {
+            for ( i = 0; i < 16; i++ )
+            {
+               values[i] = ( block[i][c] * 2047 + 127 ) / 255;
+            }
+
+            EncodeEacBlock ( values, 1, quality, blocks );
+            blocks += 8;
+         }
+      }
+   }
+}
@@ -0,0 +1,84 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2013 Dan Ginsburg, Budirijanto Purnomo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+//
+// Book:      OpenGL(R) ES 3.0 Programming Guide, 2nd Edition
+// Authors:   Dan Ginsburg, Budirijanto Purnomo, Dave Shreiner, Aaftab Munshi
+// ISBN-10:   0-321-93388-5
+// ISBN-13:   978-0-321-93388-1
+// Publisher: Addison-Wesley Professional
+// URLs:      http://www.opengles-book.com
+//            http://my.safaribooksonline.com/book/animation-and-3d/9780133440133
+//
+//
+// esEtc.h
+//
+//    ETC2 and EAC block encoder of esTexConv
+//
+#ifndef ESETC_H
+#define ESETC_H
+
+///
+//  Includes
+//
+#include "esUtil.h"
+
+///
+//  Macros
+//
+#define ES_ETC_QUALITY_FAST     0
+#define ES_ETC_QUALITY_MEDIUM   1
+#define ES_ETC_QUALITY_HIGH     2
+
+///
+//  Public Functions
+//
+
+//
+/// \brief Compressed format that esEtcEncode writes for an image
+/// \param channels Channels of the image, 1 to 4
+/// \return GL_COMPRESSED_R11_EAC, GL_COMPRESSED_RG11_EAC, GL_COMPRESSED_RGB8_ETC2 or
+///         GL_COMPRESSED_RGBA8_ETC2_EAC
+//
+GLenum esEtcFormat ( int channels );
+
+//
+/// \brief Bytes of the blocks of an image
+/// \param width Width of the image
+/// \param height Height of the image
+/// \param channels Channels of the image, 1 to 4
+//
+unsigned int esEtcSize ( int width, int height, int channels );
+
+//
+/// \brief Encode an image, the blocks past its edges repeat the last row and column
+/// \param pixels Tightly packed pixels of the image
+/// \param width Width of the image
+/// \param height Height of the image
+/// \param channels Channels of the image, 1 to 4
+/// \param quality ES_ETC_QUALITY_FAST, ES_ETC_QUALITY_MEDIUM or ES_ETC_QUALITY_HIGH
+/// \param blocks Receives esEtcSize() bytes, the blocks in rows
+//
+void esEtcEncode ( const unsigned char *pixels, int width, int height, int channels, int quality,
+                   unsigned char *blocks );
+
+#endif // ESETC_H
@@ -0,0 +1,352 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2013 Dan Ginsburg, Budirijanto Purnomo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+//
+// Book:      OpenGL(R) ES 3.0 Programming Guide, 2nd Edition
+// Authors:   Dan Ginsburg, Budirijanto Purnomo, Dave Shreiner, Aaftab Munshi
+// ISBN-10:   0-321-93388-5
+// ISBN-13:   978-0-321-93388-1
+// Publisher: Addison-Wesley Professional
+// URLs:      http://www.opengles-book.com
+//            http://my.safaribooksonline.com/book/animation-and-3d/9780133440133
+//
+//
+// esTexConv.c
+//
+//    Offline converter from the image files the samples load to the
+//    texture container read by esTextureFileLoad, so that the samples
+//    start without decoding.
+//
+//    esTexConv [-m] [-p] [-e] [-q quality] input output
+//       -m  store the whole mip chain, box filtered
+//       -p  premultiply the color channels by alpha
+//       -e  encode the levels to ETC2, or to EAC for red and red-green images
+//       -q  quality of the encoder, 0 fast, 1 medium (default) or 2 high
+//
+//    The samples look for the container of "image.png" in "image.png.estex".
+//    Compressed textures cannot be written with glTexSubImage2D, the ones
+//    a sample edits at run time have to stay uncompressed.
+//
+//    The header is written in the byte order of the host, which has to be
+//    little endian like the targets.
+//
+
+///
+//  Includes
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esUtil.h"
+#include "esEtc.h"
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+///
+//  Types
+//
+typedef struct
+{
+   unsigned char *pixels;
+   int            width;
+   int            height;
+   unsigned int   size;
+} Level;
+
+///
+//  Premultiply()
+//
+static void Premultiply ( unsigned char *pixels, int width, int height )
+{
+   int i;
+
+   for ( i = 0; i < width * height; i++ )
+   {
+      unsigned char *pixel = pixels + i * 4;
+      int c;
+
+      for ( c = 0; c < 3; c++ )
+      {
+         pixel[c] = ( unsigned char ) ( ( pixel[c] * pixel[3] + 127 ) / 255 );
+      }
+   }
+}
+
+///
+//  Downsample()
+//
+//    Next mip level, each texel is the average of the 2x2 texels above it,
+//    the last row or column is repeated when the size is odd
+//
+static int Downsample ( const Level *src, Level *dst, int channels )
+{
+   int x, y, c;
+
+   dst->width = ( src->width > 1 ) ? src->width / 2 : 1;
+   dst->height = ( src->height > 1 ) ? src->height / 2 : 1;
+   dst->size = dst->width * dst->height * channels;
+   dst->pixels = ( unsigned char * ) malloc ( dst->size );
+
+   if ( dst->pixels == NULL )
+   {
+      return 0;
+   }
+
+   for ( y = 0; y < dst->height; y++ )
+   {
+      int y0 = 2 * y;
+      int y1 = ( 2 * y + 1 < src->height ) ? 2 * y + 1 : src->height - 1;
+
+      for ( x = 0; x < dst->width; x++ )
+      {
+         int x0 = 2 * x;
+         int x1 = ( 2 * x + 1 < src->width ) ? 2 * x + 1 : src->width - 1;
+
+         for ( c = 0; c < channels; c++ )
+         {
+            int sum = src->pixels[ ( y0 * src->width + x0 ) * channels + c] +
+                      src->pixels[ ( y0 * src->width + x1 ) * channels + c] +
+                      src->pixels[ ( y1 * src->width + x0 ) * channels + c] +
+                      src->pixels[ ( y1 * src->width + x1 ) * channels + c];
+
+            dst->pixels[ ( y * dst->width + x ) * channels + c] = ( unsigned char ) ( ( sum + 2 ) / 4 );
+         }
+      }
+   }
+
+   return 1;
+}
+
+///
+//  Encode()
+//
+//    Replaces the pixels of a level by its ETC2 or EAC blocks
+//
+static int Encode ( Level *level, int channels, int quality )
+{
+   unsigned int size = esEtcSize ( level->width, level->height, channels );
+   unsigned char *blocks = ( unsigned char * ) malloc ( size );
+
+   if ( blocks == NULL )
+   {
+      return 0;
+   }
+
+   esEtcEncode ( level->pixels, level->width, level->height, channels, quality, blocks );
+   free ( level->pixels );
+   level->pixels = blocks;
+   level->size = size;
+   return 1;
+}
+
+///
+//  WritePadding()
+//
+static int WritePadding ( FILE *fp, long offset )
+{
+   static const unsigned char zeros[64] = { 0 };
+
+   while ( ftell ( fp ) < offset )
+   {
+      long count = offset - ftell ( fp );
+
+      count = ( count > ( long ) sizeof ( zeros ) ) ? ( long ) sizeof ( zeros ) : count;
+      if ( fwrite ( zeros, 1, count, fp ) != ( size_t ) count )
+      {
+         return 0;
+      }
+   }
+
+   return 1;
+}
+
+///
+//  WriteContainer()
+//
+static int WriteContainer ( const char *fileName, ESTextureFileHeader *header, const Level *levels )
+{
+   FILE *fp = fopen ( fileName, "wb" );
+   unsigned int offset = sizeof ( ESTextureFileHeader );
+   unsigned int i;
+   int ok = 1;
+
+   if ( fp == NULL )
+   {
+      fprintf ( stderr, "esTexConv: cannot create %s\n", fileName );
+      return 0;
+   }
+
+   for ( i = 0; i < header->levelCount; i++ )
+   {
+      offset = ( offset + ES_TEXTURE_FILE_ALIGN - 1 ) / ES_TEXTURE_FILE_ALIGN * ES_TEXTURE_FILE_ALIGN;
+      header->levels[i].offset = offset;
+      header->levels[i].size = levels[i].size;
+      offset += header->levels[i].size;
+   }
+
+   ok = ( fwrite ( header, sizeof ( ESTextureFileHeader ), 1, fp ) == 1 );
+
+   for ( i = 0; ok && i < header->levelCount; i++ )
+   {
+      ok = WritePadding ( fp, header->levels[i].offset ) &&
+           ( fwrite ( levels[i].pixels, 1, header->levels[i].size, fp ) == header->levels[i].size );
+   }
+
+   if ( fclose ( fp ) != 0 || !ok )
+   {
+      fprintf ( stderr, "esTexConv: cannot write %s\n", fileName );
+      remove ( fileName );
+      return 0;
+   }
+
+   return 1;
+}
+
+int main ( int argc, char *argv[] )
+{
+   static const GLenum formats[4] = { GL_RED, GL_RG, GL_RGB, GL_RGBA };
+   static const GLenum internalFormats[4] = { GL_R8, GL_RG8, GL_RGB8, GL_RGBA8 };
+   ESTextureFileHeader header;
+   Level levels[ES_TEXTURE_FILE_LEVEL_MAX];
+   const char *input = NULL;
+   const char *output = NULL;
+   int mipmap = 0, premultiply = 0, compress = 0;
+   int quality = ES_ETC_QUALITY_MEDIUM;
+   int channels = 0;
+   unsigned int i;
+   int arg, ok;
+
+   for ( arg = 1; arg < argc; arg++ )
+   {
+      if ( strcmp ( argv[arg], "-m" ) == 0 )
+      {
+         mipmap = 1;
+      }
+      else if ( strcmp ( argv[arg], "-p" ) == 0 )
+      {
+         premultiply = 1;
+      }
+      else if ( strcmp ( argv[arg], "-e" ) == 0 )
+      {
+         compress = 1;
+      }
+      else if ( strcmp ( argv[arg], "-q" ) == 0 && arg + 1 < argc )
+      {
+         quality = atoi ( argv[++arg] );
+         quality = ( quality < ES_ETC_QUALITY_FAST ) ? ES_ETC_QUALITY_FAST :
+                   ( ( quality > ES_ETC_QUALITY_HIGH ) ? ES_ETC_QUALITY_HIGH : quality );
+      }
+      else if ( input == NULL )
+      {
+         input = argv[arg];
+      }
+      else if ( output == NULL )
+      {
+         output = argv[arg];
+      }
+   }
+
+   if ( input == NULL || output == NULL )
+   {
+      fprintf ( stderr, "usage: esTexConv [-m] [-p] [-e] [-q quality] input input%s\n", ES_TEXTURE_FILE_EXT );
+      return 1;
+   }
+
+   memset ( &header, 0, sizeof ( ESTextureFileHeader ) );
+   memset ( levels, 0, sizeof ( levels ) );
+
+   levels[0].pixels = stbi_load ( input, &levels[0].width, &levels[0].height, &channels, 0 );
+   if ( levels[0].pixels == NULL || channels < 1 || channels > 4 )
+   {
+      fprintf ( stderr, "esTexConv: cannot decode %s\n", input );
+      return 1;
+   }
+   if ( levels[0].width > ES_TEXTURE_FILE_SIZE_MAX || levels[0].height > ES_TEXTURE_FILE_SIZE_MAX )
+   {
+      fprintf ( stderr, "esTexConv: %s is larger than %d pixels\n", input, ES_TEXTURE_FILE_SIZE_MAX );
+      return 1;
+   }
+   levels[0].size = levels[0].width * levels[0].height * channels;
+
+   // only RGBA has an alpha to multiply by, two channels are red and green in ES 3.0
+   if ( premultiply && channels == 4 )
+   {
+      Premultiply ( levels[0].pixels, levels[0].width, levels[0].height );
+      header.flags |= ES_TEXTURE_FILE_PREMULTIPLIED;
+   }
+
+   header.magic = ES_TEXTURE_FILE_MAGIC;
+   header.version = ES_TEXTURE_FILE_VERSION;
+   header.internalFormat = internalFormats[channels - 1];
+   header.format = formats[channels - 1];
+   header.type = GL_UNSIGNED_BYTE;
+   header.width = levels[0].width;
+   header.height = levels[0].height;
+   header.levelCount = 1;
+
+   while ( mipmap && header.levelCount < ES_TEXTURE_FILE_LEVEL_MAX &&
+           ( levels[header.levelCount - 1].width > 1 || levels[header.levelCount - 1].height > 1 ) )
+   {
+      if ( !Downsample ( &levels[header.levelCount - 1], &levels[header.levelCount], channels ) )
+      {
+         break;
+      }
+      header.levelCount++;
+   }
+
+   // the levels are filtered before any of them is encoded, a compressed
+   // container has no format and type, only the compressed internal format
+   ok = 1;
+   if ( compress )
+   {
+      header.internalFormat = esEtcFormat ( channels );
+      header.format = 0;
+      header.type = 0;
+
+      for ( i = 0; ok && i < header.levelCount; i++ )
+      {
+         ok = Encode ( &levels[i], channels, quality );
+      }
+
+      if ( !ok )
+      {
+         fprintf ( stderr, "esTexConv: out of memory\n" );
+      }
+   }
+
+   ok = ok && WriteContainer ( output, &header, levels );
+
+   if ( ok )
+   {
+      printf ( "%s: [%d, %d] %d channels, %u levels%s%s\n", output, levels[0].width, levels[0].height,
+               channels, header.levelCount, ( header.flags & ES_TEXTURE_FILE_PREMULTIPLIED ) ? ", premultiplied" : "",
+               compress ? ", ETC2/EAC" : "" );
+   }
+
+   stbi_image_free ( levels[0].pixels );
+   for ( i = 1; i < header.levelCount; i++ )
+   {
+      free ( levels[i].pixels );
+   }
+
+   return ok ? 0 : 1;
+}
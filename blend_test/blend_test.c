@@ -4,13 +4,31 @@
 ***/
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
 #include "esUtil.h"
-#define STB_IMAGE_IMPLEMENTATION
-#include "stb_image.h"
 
 #define MAX_TEXTURE_PER_LAYER   (20)  // the textures that each layer can have
 #define MUTI_PROGRAM_ENABLE   (0) //if enable each layer can control alpha value, else each layer just have show or hide two status
 
+#define QUAD_MAX              (LAYER_MAX * MAX_TEXTURE_PER_LAYER)
+#define QUAD_VERTEX_NUM       (4)   // left top, left bottom, right bottom, right top
+#define QUAD_INDICE_NUM       (6)
+#define VERTEX_FLOAT_NUM      (5)   // x, y, z, s, t
+#define STREAM_REGION_NUM     (3)   // the vertex stream is split in regions, the GPU can still read 2 old frames while we write
+
+#define TEXTURE_ATLAS_ENABLE  (1)   // if enable the layer images are packed into a few big textures, so quads rarely break a draw batch
+#define ATLAS_SIZE_MAX        (2048)
+#define ATLAS_PADDING         (2)   // pixels around each packed image, filled by extruding its border
+#define ATLAS_PAGE_MAX        (4)
+#define ASSET_PACK_FILE       "assets.espak"   // made by esPacker, the loose files are read when it is missing
+
+#define HOLE_SHADER_ENABLE    (0)   // if enable holes are cut in the fragment shader with a mask rectangle, the texture is never written
+#define HOLE_BUFFER_MAX       (4)   // hole sizes whose pixels are kept, punching a hole of a kept size costs only the upload
+
+#define DIRTY_RECT_ENABLE     (1)   // if enable only the screen area changed since the back buffer was drawn is redrawn
+#define DAMAGE_HISTORY_NUM    (4)   // damages of the last frames kept, an older back buffer is redrawn whole
+
 #define PI 3.1415926535897932384626433832795f
 
 typedef enum
@@ -55,10 +73,30 @@ typedef struct
 	GLfloat y;
 }stPos;
 
+// continuous quads of the vertex stream drawn by one glDrawElements
+typedef struct
+{
+	GLuint texture;
+	GLuint layer;       // program and alpha are per layer when MUTI_PROGRAM_ENABLE
+	GLuint firstQuad;   // quad index in the vertex stream
+	GLuint quadNum;
+#if HOLE_SHADER_ENABLE
+	GLint holeTexIdx;   // the only quad of the batch has this hole in the layer, -1 if no quad of the batch has a hole
+#endif
+}stDrawBatch;
+
+typedef struct
+{
+	GLint width;
+	GLint height;
+	GLubyte alpha;     // alpha of every pixel in the buffer
+	GLubyte *pixels;   // RGBA, width * height
+}stHoleBuffer;
+
 typedef struct
 {
 #if MUTI_PROGRAM_ENABLE
-	GLuint programObjects[LAYER_MAX];	// Handle to a program object
+	GLuint programObjects[LAYER_MAX];	// Handle to a program object, the layers share one program from the registry
 	GLint samplerLocs[LAYER_MAX];	    // Sampler location
 	GLint ctlAlphaLocs[LAYER_MAX];      // control alpha location
 #else
@@ -69,12 +107,18 @@ typedef struct
 	GLfloat alphas[LAYER_MAX];
 	GLuint textureIds[LAYER_MAX][MAX_TEXTURE_PER_LAYER];	// Texture handle
 	GLuint textureNumPerLayer[LAYER_MAX];
-	GLuint vboIds[LAYER_MAX][MAX_TEXTURE_PER_LAYER];	// VBO IDs
+	GLuint streamVboId;                                 // vertex stream of all the quads, STREAM_REGION_NUM regions
 	GLuint vboIndiceId;                                 // indice VBO Id
-	GLuint vaoIds[LAYER_MAX][MAX_TEXTURE_PER_LAYER];	// VAO IDs
+	GLuint streamVaoId;                                 // the only VAO, configured once
+	GLuint streamRegion;                                // region written by the current frame
+	GLsync streamFences[STREAM_REGION_NUM];             // signaled when the GPU is done with a region
+	stDrawBatch batches[QUAD_MAX];                      // draws of the current frame, in layer order
+	GLuint batchNum;
 	stRect dispArea[LAYER_MAX][MAX_TEXTURE_PER_LAYER]; // display area of each texture in window
 	stRect clipArea[LAYER_MAX][MAX_TEXTURE_PER_LAYER]; // clip area of each texture
-	stTexSize texSize[LAYER_MAX][MAX_TEXTURE_PER_LAYER]; // texture width and height
+	stTexSize texSize[LAYER_MAX][MAX_TEXTURE_PER_LAYER]; // image width and height
+	stRect texArea[LAYER_MAX][MAX_TEXTURE_PER_LAYER];    // area of the image in its texture, not the whole texture with an atlas
+	stTexSize texPageSize[LAYER_MAX][MAX_TEXTURE_PER_LAYER]; // width and height of the texture holding the image
 	stPos texCenterPos[LAYER_MAX][MAX_TEXTURE_PER_LAYER]; // save every texture center vexture coordinate
 	GLboolean texVisable[LAYER_MAX][MAX_TEXTURE_PER_LAYER]; // indicate the texture is visable
 	GLuint winWidth;  // windows width
@@ -86,7 +130,27 @@ typedef struct
 	GLushort indiceNum;
 
 	GLubyte *dumpPixels;
-	GLubyte *holePixes;
+	ESPack *assetPack;
+#if HOLE_SHADER_ENABLE
+	stRect holeRect[LAYER_MAX][MAX_TEXTURE_PER_LAYER];  // mask rectangle in image coordinates, no hole if width is 0
+	GLubyte holeAlpha[LAYER_MAX][MAX_TEXTURE_PER_LAYER];
+#if MUTI_PROGRAM_ENABLE
+	GLint holeRectLocs[LAYER_MAX];
+	GLint holeAlphaLocs[LAYER_MAX];
+#else
+	GLint holeRectLoc;
+	GLint holeAlphaLoc;
+#endif
+#else
+	stHoleBuffer holeBuffers[HOLE_BUFFER_MAX];
+	GLuint holeBufferNext;  // buffer replaced when a new hole size comes
+#endif
+#if DIRTY_RECT_ENABLE
+	GLboolean quadDirty[LAYER_MAX][MAX_TEXTURE_PER_LAYER];  // quad changed since it was last drawn
+	GLboolean quadDrawn[LAYER_MAX][MAX_TEXTURE_PER_LAYER];  // quad was visible when it was last drawn
+	stRect quadBounds[LAYER_MAX][MAX_TEXTURE_PER_LAYER];    // screen area of the quad when it was last drawn
+	stRect damages[DAMAGE_HISTORY_NUM];                     // screen area changed by the last frames, newest first
+#endif
 } stUserData;
 
 static const char* s_images[LAYER_MAX][MAX_TEXTURE_PER_LAYER] = {
@@ -96,65 +160,353 @@ static const char* s_images[LAYER_MAX][MAX_TEXTURE_PER_LAYER] = {
 	{"sun.png", "FC_level.png",  "FC_level_1.png", "FC_level_2.png", "FC_level_3.png", "FC_level_4.png"}
 };
 
-///
-// Load texture from disk
-//
+// the quad has to be redrawn in the next frame, where it was and where it is now
+static void markQuadDirty(stUserData *pUser, GLuint layer, GLuint texIdx)
+{
+#if DIRTY_RECT_ENABLE
+	pUser->quadDirty[layer][texIdx] = GL_TRUE;
+#endif
+}
+
+#if !HOLE_SHADER_ENABLE
+// the image content changed, every quad showing it has to be redrawn
+static void markImageDirty(stUserData *pUser, GLuint layer, GLuint texIdx)
+{
+	GLuint l = LAYER_ID_0;
+	for (l = LAYER_ID_0; l < LAYER_MAX; l++) {
+		GLuint i = 0;
+		for (i = 0; i < pUser->textureNumPerLayer[l]; i++) {
+			if ((pUser->textureIds[l][i] == pUser->textureIds[layer][texIdx]) &&
+				(pUser->texArea[l][i].left == pUser->texArea[layer][texIdx].left) &&
+				(pUser->texArea[l][i].top == pUser->texArea[layer][texIdx].top)) {
+				markQuadDirty(pUser, l, i);
+			}
+		}
+	}
+}
+#endif
 
-GLint loadTexture(const char* name, GLint *outWidth, GLint *outHeight)
+#if HOLE_SHADER_ENABLE
+// only one hole per quad is kept, the newest one; the texture is shared with the other quads so only this quad changes
+void digHoleInTexture(stUserData *userData, GLuint layer, GLuint texIdx, stRect *pRect, GLubyte alpha)
 {
-	unsigned int texture;
-	glGenTextures(1, &texture);
+	userData->holeRect[layer][texIdx] = *pRect;
+	userData->holeAlpha[layer][texIdx] = alpha;
+	markQuadDirty(userData, layer, texIdx);
+}
 
-	int width, height, nrChannels;
-	unsigned char *data = stbi_load(name, &width, &height, &nrChannels, 0);
-	GLint format = GL_RGB;
-	if (data) {
-		switch (nrChannels) {
-		case 1:
-			format = GL_RED;
-			break;
-		case 3:
-			format = GL_RGB;
-			break;
-		case 4:
-			format = GL_RGBA;
-			break;
-		default:
+// mask rectangle of the hole of the batch quad, in texture coordinates, an empty rectangle if the batch has no hole
+static void setHoleUniforms(stUserData *userData, const stDrawBatch *pBatch, GLint rectLoc, GLint alphaLoc)
+{
+	if (pBatch->holeTexIdx < 0) {
+		esStateUniform4f(rectLoc, 0.0f, 0.0f, 0.0f, 0.0f);
+		return;
+	}
+
+	stRect *pHole = &userData->holeRect[pBatch->layer][pBatch->holeTexIdx];
+	stRect *pTexArea = &userData->texArea[pBatch->layer][pBatch->holeTexIdx];
+	stTexSize *pPageSize = &userData->texPageSize[pBatch->layer][pBatch->holeTexIdx];
+	esStateUniform4f(rectLoc, (GLfloat)(pTexArea->left + pHole->left) / pPageSize->width,
+		(GLfloat)(pTexArea->top + pHole->top) / pPageSize->height,
+		(GLfloat)(pTexArea->left + pHole->left + pHole->width) / pPageSize->width,
+		(GLfloat)(pTexArea->top + pHole->top + pHole->height) / pPageSize->height);
+	esStateUniform1f(alphaLoc, userData->holeAlpha[pBatch->layer][pBatch->holeTexIdx] / 255.0f);
+}
+#else
+// black pixels of the given alpha, the buffer of the same size is reused and only its alpha is rewritten
+static GLubyte* getHoleBuffer(stUserData *userData, GLint width, GLint height, GLubyte alpha)
+{
+	stHoleBuffer *pBuffer = NULL;
+	GLuint i = 0;
+	for (i = 0; i < HOLE_BUFFER_MAX; i++) {
+		if ((userData->holeBuffers[i].width == width) && (userData->holeBuffers[i].height == height)) {
+			pBuffer = &userData->holeBuffers[i];
 			break;
 		}
+	}
 
-		esLogMessage("%s: nrChannels = %d\n", name, nrChannels);
-		if (outWidth) *outWidth = width;
-		if (outHeight) *outHeight = height;
+	if (pBuffer == NULL) {
+		pBuffer = &userData->holeBuffers[userData->holeBufferNext];
+		userData->holeBufferNext = (userData->holeBufferNext + 1) % HOLE_BUFFER_MAX;
+		free(pBuffer->pixels);
+		pBuffer->pixels = (GLubyte*)calloc(width * height, 4);
+		pBuffer->width = width;
+		pBuffer->height = height;
+		pBuffer->alpha = 0;
+	}
 
-		glBindTexture(GL_TEXTURE_2D, texture);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, (format == GL_RGBA) ? GL_CLAMP_TO_EDGE : GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, (format == GL_RGBA) ? GL_CLAMP_TO_EDGE : GL_REPEAT);
+	if (pBuffer->alpha != alpha) {
+		GLint j = 0;
+		for (j = 3; j < width * height * 4; j += 4) {
+			pBuffer->pixels[j] = alpha;
+		}
+		pBuffer->alpha = alpha;
+	}
+	return pBuffer->pixels;
+}
 
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+// texture must RGBA format, pRect is in image coordinates
+void digHoleInTexture(stUserData *userData, GLuint layer, GLuint texIdx, stRect *pRect, GLubyte alpha)
+{
+	GLubyte *pPixels = getHoleBuffer(userData, pRect->width, pRect->height, alpha);
+	esStateEditTexture(0, GL_TEXTURE_2D, userData->textureIds[layer][texIdx]);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, userData->texArea[layer][texIdx].left + pRect->left, userData->texArea[layer][texIdx].top + pRect->top,
+		pRect->width, pRect->height, GL_RGBA, GL_UNSIGNED_BYTE, pPixels);
+	markImageDirty(userData, layer, texIdx);
+}
+#endif
+
+#if TEXTURE_ATLAS_ENABLE
+// skyline of an atlas page: the top of the packed images seen from the bottom of the page
+typedef struct
+{
+	GLint x;
+	GLint y;
+	GLint width;
+}stSkylineNode;
+
+typedef struct
+{
+	GLint width;
+	GLint height;
+	GLint usedWidth;
+	GLint usedHeight;
+	GLuint nodeNum;
+	stSkylineNode nodes[2 * QUAD_MAX + 1];  // every insert adds one node and may split another
+}stAtlasPage;
 
-		glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-		//glGenerateMipmap(GL_TEXTURE_2D);
-		stbi_image_free(data);
+typedef struct
+{
+	GLuint layer;
+	GLuint texIdx;
+	GLint width;
+	GLint height;
+	GLubyte *pixels;  // RGBA
+	GLint page;       // -1 if the image does not fit in any page
+	GLint x;          // top left corner of the image (padding excluded) in the page
+	GLint y;
+}stAtlasImage;
+
+static void atlasPageInit(stAtlasPage *pPage, GLint width, GLint height)
+{
+	memset(pPage, 0, sizeof(stAtlasPage));
+	pPage->width = width;
+	pPage->height = height;
+	pPage->nodeNum = 1;
+	pPage->nodes[0].width = width;
+}
+
+// lowest y a width x height rectangle can be put at, with its left side on node idx; -1 if it does not fit
+static GLint skylineFit(stAtlasPage *pPage, GLuint idx, GLint width, GLint height)
+{
+	GLint y = 0;
+	GLint widthLeft = width;
+	if (pPage->nodes[idx].x + width > pPage->width) return -1;
+	while (widthLeft > 0) {
+		if (idx >= pPage->nodeNum) return -1;
+		y = (pPage->nodes[idx].y > y) ? pPage->nodes[idx].y : y;
+		if (y + height > pPage->height) return -1;
+		widthLeft -= pPage->nodes[idx].width;
+		idx++;
 	}
-	else {
-		esLogMessage("Failed to load texture: %s\n", name);
+	return y;
+}
+
+// bottom-left skyline packing: put the rectangle where its bottom is the lowest
+static GLboolean skylineInsert(stAtlasPage *pPage, GLint width, GLint height, GLint *pX, GLint *pY)
+{
+	GLint bestBottom = 0x7fffffff, bestWidth = 0x7fffffff, bestIdx = -1, bestY = 0;
+	GLuint i = 0;
+	for (i = 0; i < pPage->nodeNum; i++) {
+		GLint y = skylineFit(pPage, i, width, height);
+		if (y < 0) continue;
+		if ((y + height < bestBottom) || ((y + height == bestBottom) && (pPage->nodes[i].width < bestWidth))) {
+			bestBottom = y + height;
+			bestWidth = pPage->nodes[i].width;
+			bestIdx = i;
+			bestY = y;
+		}
+	}
+	if (bestIdx < 0) return GL_FALSE;
+
+	*pX = pPage->nodes[bestIdx].x;
+	*pY = bestY;
+
+	// the new node covers the rectangle top, the nodes below it are cut away
+	memmove(&pPage->nodes[bestIdx + 1], &pPage->nodes[bestIdx], (pPage->nodeNum - bestIdx) * sizeof(stSkylineNode));
+	pPage->nodes[bestIdx].x = *pX;
+	pPage->nodes[bestIdx].y = bestY + height;
+	pPage->nodes[bestIdx].width = width;
+	pPage->nodeNum++;
+
+	for (i = bestIdx + 1; i < pPage->nodeNum; ) {
+		GLint prevRight = pPage->nodes[i - 1].x + pPage->nodes[i - 1].width;
+		if (pPage->nodes[i].x >= prevRight) break;
+		GLint shrink = prevRight - pPage->nodes[i].x;
+		pPage->nodes[i].x += shrink;
+		pPage->nodes[i].width -= shrink;
+		if (pPage->nodes[i].width > 0) break;
+		memmove(&pPage->nodes[i], &pPage->nodes[i + 1], (pPage->nodeNum - i - 1) * sizeof(stSkylineNode));
+		pPage->nodeNum--;
+	}
+
+	// merge neighbours of the same height
+	for (i = 0; i + 1 < pPage->nodeNum; ) {
+		if (pPage->nodes[i].y == pPage->nodes[i + 1].y) {
+			pPage->nodes[i].width += pPage->nodes[i + 1].width;
+			memmove(&pPage->nodes[i + 1], &pPage->nodes[i + 2], (pPage->nodeNum - i - 2) * sizeof(stSkylineNode));
+			pPage->nodeNum--;
+		}
+		else {
+			i++;
+		}
 	}
 
-	return texture;
+	pPage->usedWidth = (*pX + width > pPage->usedWidth) ? (*pX + width) : pPage->usedWidth;
+	pPage->usedHeight = (bestY + height > pPage->usedHeight) ? (bestY + height) : pPage->usedHeight;
+	return GL_TRUE;
 }
 
-// texture must RGBA format 
-void digHoleInTexture(stUserData *userData, GLint texture, stRect *pRect, GLubyte alpha)
+// copy an image into the page and repeat its border pixels into the padding around it,
+// so linear filtering at the image edge reads the same texels as GL_CLAMP_TO_EDGE would
+static void atlasBlit(GLubyte *pPage, GLint pageWidth, stAtlasImage *pImage)
 {
-	GLint i = 0;
-	for (i = 3; i < userData->winWidth * userData->winHeight * 4; i += 4) {
-		userData->holePixes[i] = alpha;
+	GLint row = 0;
+	for (row = -ATLAS_PADDING; row < pImage->height + ATLAS_PADDING; row++) {
+		GLint srcRow = (row < 0) ? 0 : ((row >= pImage->height) ? (pImage->height - 1) : row);
+		const GLubyte *pSrc = pImage->pixels + srcRow * pImage->width * 4;
+		GLubyte *pDst = pPage + ((pImage->y + row) * pageWidth + pImage->x) * 4;
+		GLint col = 0;
+		memcpy(pDst, pSrc, pImage->width * 4);
+		for (col = 1; col <= ATLAS_PADDING; col++) {
+			memcpy(pDst - col * 4, pSrc, 4);
+			memcpy(pDst + (pImage->width - 1 + col) * 4, pSrc + (pImage->width - 1) * 4, 4);
+		}
+	}
+}
+
+static int atlasImageCompare(const void *a, const void *b)
+{
+	// tallest first gives the flattest skyline
+	return ((const stAtlasImage*)b)->height - ((const stAtlasImage*)a)->height;
+}
+
+// load every layer image and pack them into as few textures as possible,
+// images that are too big or do not fit any more are left to loadLayerTextures()
+static void buildTextureAtlas(stUserData *pUser)
+{
+	stAtlasImage images[QUAD_MAX];
+	stAtlasPage *pages = (stAtlasPage*)malloc(ATLAS_PAGE_MAX * sizeof(stAtlasPage));
+	GLuint imageNum = 0, pageNum = 0;
+	GLint maxSize = 0;
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+	maxSize = (maxSize > ATLAS_SIZE_MAX) ? ATLAS_SIZE_MAX : maxSize;
+
+	// every different image is decoded once, all of them at the same time on the job pool
+	const char *fileNames[QUAD_MAX];
+	GLuint fileLayers[QUAD_MAX], fileTexIdxs[QUAD_MAX];
+	ESImage decoded[QUAD_MAX];
+	GLuint fileNum = 0, f = 0;
+	GLuint layer = LAYER_ID_0;
+	for (layer = LAYER_ID_0; layer < LAYER_MAX; layer++) {
+		GLuint texIdx = 0;
+		for (texIdx = 0; texIdx < pUser->textureNumPerLayer[layer]; texIdx++) {
+			for (f = 0; f < fileNum; f++) {
+				if (strcmp(fileNames[f], s_images[layer][texIdx]) == 0) break;
+			}
+			if (f < fileNum) continue;  // same image, shares the texture later
+			fileNames[fileNum] = s_images[layer][texIdx];
+			fileLayers[fileNum] = layer;
+			fileTexIdxs[fileNum] = texIdx;
+			fileNum++;
+		}
+	}
+	esImageLoadBatch(esGetJobPool(), fileNames, fileNum, 4, decoded);
+
+	for (f = 0; f < fileNum; f++) {
+		stAtlasImage *pImage = &images[imageNum];
+		if (decoded[f].pixels == NULL) continue;
+		if ((decoded[f].width + 2 * ATLAS_PADDING > maxSize) || (decoded[f].height + 2 * ATLAS_PADDING > maxSize)) {
+			esImageFree(&decoded[f]);
+			continue;
+		}
+		pImage->pixels = decoded[f].pixels;
+		pImage->width = decoded[f].width;
+		pImage->height = decoded[f].height;
+		pImage->layer = fileLayers[f];
+		pImage->texIdx = fileTexIdxs[f];
+		pImage->page = -1;
+		imageNum++;
 	}
-	glBindTexture(GL_TEXTURE_2D, texture);
-	glTexSubImage2D(GL_TEXTURE_2D, 0, pRect->left, pRect->top, pRect->width, pRect->height, GL_RGBA, GL_UNSIGNED_BYTE, userData->holePixes);
+
+	qsort(images, imageNum, sizeof(stAtlasImage), atlasImageCompare);
+
+	GLuint i = 0;
+	for (i = 0; i < imageNum; i++) {
+		stAtlasImage *pImage = &images[i];
+		GLint width = pImage->width + 2 * ATLAS_PADDING;
+		GLint height = pImage->height + 2 * ATLAS_PADDING;
+		GLuint page = 0;
+		for (page = 0; page < pageNum; page++) {
+			if (skylineInsert(&pages[page], width, height, &pImage->x, &pImage->y)) break;
+		}
+		if ((page == pageNum) && (pageNum < ATLAS_PAGE_MAX)) {
+			atlasPageInit(&pages[pageNum++], maxSize, maxSize);
+			if (!skylineInsert(&pages[page], width, height, &pImage->x, &pImage->y)) page = ATLAS_PAGE_MAX;
+		}
+		if (page < pageNum) {
+			pImage->page = page;
+			pImage->x += ATLAS_PADDING;
+			pImage->y += ATLAS_PADDING;
+		}
+	}
+
+	GLuint page = 0;
+	for (page = 0; page < pageNum; page++) {
+		// the page is cut to the packed area, which is often far below the maximum size
+		GLint width = pages[page].usedWidth;
+		GLint height = pages[page].usedHeight;
+		GLubyte *pPixels = (GLubyte*)calloc(width * height, 4);
+		GLuint texture = 0, packed = 0;
+		for (i = 0; i < imageNum; i++) {
+			if (images[i].page != page) continue;
+			atlasBlit(pPixels, width, &images[i]);
+			packed++;
+		}
+
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pPixels);
+		free(pPixels);
+		esLogMessage("Atlas page %d: size [%d, %d], %d images\n", page, width, height, packed);
+
+		for (i = 0; i < imageNum; i++) {
+			if (images[i].page != page) continue;
+			GLuint l = images[i].layer, t = images[i].texIdx;
+			pUser->textureIds[l][t] = texture;
+			pUser->texSize[l][t].width = images[i].width;
+			pUser->texSize[l][t].height = images[i].height;
+			pUser->texArea[l][t].left = images[i].x;
+			pUser->texArea[l][t].top = images[i].y;
+			pUser->texArea[l][t].width = images[i].width;
+			pUser->texArea[l][t].height = images[i].height;
+			pUser->texPageSize[l][t].width = width;
+			pUser->texPageSize[l][t].height = height;
+		}
+	}
+
+	for (f = 0; f < fileNum; f++) {
+		esImageFree(&decoded[f]);
+	}
+	free(pages);
 }
+#endif
+
 
 static GLfloat coordinateTrans(GLfloat coord, enTRANS_TYPE type)
 {
@@ -223,11 +575,13 @@ static void setVertexData(stUserData *pUser, GLuint layer, GLuint texIdx, enVERT
 	}break;
 	case RESET_CLIP_AREA:
 	{
+		// clip area is in image coordinates, the texture coordinates are in the texture holding the image
 		stRect *pClipArea = &pUser->clipArea[layer][texIdx];
-		GLfloat left = (GLfloat)pClipArea->left / pUser->texSize[layer][texIdx].width;
-		GLfloat top = (GLfloat)pClipArea->top / pUser->texSize[layer][texIdx].height;
-		GLfloat right = (GLfloat)(pClipArea->left + pClipArea->width) / pUser->texSize[layer][texIdx].width;
-		GLfloat bottom = (GLfloat)(pClipArea->top + pClipArea->height) / pUser->texSize[layer][texIdx].height;
+		stRect *pTexArea = &pUser->texArea[layer][texIdx];
+		GLfloat left = (GLfloat)(pTexArea->left + pClipArea->left) / pUser->texPageSize[layer][texIdx].width;
+		GLfloat top = (GLfloat)(pTexArea->top + pClipArea->top) / pUser->texPageSize[layer][texIdx].height;
+		GLfloat right = (GLfloat)(pTexArea->left + pClipArea->left + pClipArea->width) / pUser->texPageSize[layer][texIdx].width;
+		GLfloat bottom = (GLfloat)(pTexArea->top + pClipArea->top + pClipArea->height) / pUser->texPageSize[layer][texIdx].height;
 
 		//printf("[%f, %f] - [%f, %f] \n", left, top, right, bottom);
 
@@ -308,6 +662,7 @@ static void setVertexData(stUserData *pUser, GLuint layer, GLuint texIdx, enVERT
 		// do nothing
 		break;
 	}
+	markQuadDirty(pUser, layer, texIdx);
 }
 
 void initDispArea(stUserData *pUser, GLuint layer, GLint x, GLint y, GLint width, GLint height)
@@ -435,6 +790,7 @@ void setRotateArea(stUserData *pUser, GLuint layer, GLuint texIdx, GLfloat angle
 	// x2, y1
 	pUser->vertices[layer][texIdx][RIGHT_TOP_X] = (x2 * cosAngle - y1 * sinAngle) * ratio_x + center_x;
 	pUser->vertices[layer][texIdx][RIGHT_TOP_Y] = (x2 * sinAngle + y1 * cosAngle) * ratio_y + center_y;
+	markQuadDirty(pUser, layer, texIdx);
 
 	//esLogMessage("center: x = %f, y = %f\n", center_x, center_y);
 	//esLogMessage("	left = %f, top = %f\n", pUser->vertices[layer][texIdx][LEFT_TOP_X], pUser->vertices[layer][texIdx][LEFT_TOP_Y]);
@@ -473,76 +829,305 @@ void rotateTextureCoord(stUserData *pUser, GLuint layer, GLuint texIdx, GLfloat
 	// (1, 0) -> 0.5, -0.5
 	pUser->vertices[layer][texIdx][RIGHT_TOP_X] = 0.5 * cosAngle + 0.5 * sinAngle + 0.5;
 	pUser->vertices[layer][texIdx][RIGHT_TOP_Y] = 0.5 * sinAngle - 0.5 * cosAngle + 0.5;
+
+	// [0, 1] of the image -> area of the image in its texture
+	GLuint i = 0;
+	for (i = 0; i < QUAD_VERTEX_NUM; i++) {
+		GLfloat *pTexCoord = &pUser->vertices[layer][texIdx][i * VERTEX_FLOAT_NUM + 3];
+		pTexCoord[0] = (pUser->texArea[layer][texIdx].left + pTexCoord[0] * pUser->texArea[layer][texIdx].width) / pUser->texPageSize[layer][texIdx].width;
+		pTexCoord[1] = (pUser->texArea[layer][texIdx].top + pTexCoord[1] * pUser->texArea[layer][texIdx].height) / pUser->texPageSize[layer][texIdx].height;
+	}
+	markQuadDirty(pUser, layer, texIdx);
 }
 
 
 void setLayerAlpha(stUserData *userData, GLuint layer, GLfloat alpha)
 {
+	if (userData->alphas[layer] != alpha) {
+		GLuint texIdx = 0;
+		for (texIdx = 0; texIdx < userData->textureNumPerLayer[layer]; texIdx++) {
+			markQuadDirty(userData, layer, texIdx);
+		}
+	}
 	userData->alphas[layer] = alpha;
 }
 
-void updateVAO(stUserData *pUser, GLuint layer, GLuint texId)
+static GLboolean isQuadVisible(stUserData *pUser, GLuint layer, GLuint texIdx)
 {
-	if ((layer >= LAYER_MAX) || (texId >= MAX_TEXTURE_PER_LAYER)) {
+#if !MUTI_PROGRAM_ENABLE
+	if (pUser->alphas[layer] == 0) return GL_FALSE; // this layer not show
+#endif
+	return pUser->texVisable[layer][texIdx];
+}
+
+#if DIRTY_RECT_ENABLE
+static void unionRect(stRect *pDst, const stRect *pSrc)
+{
+	if ((pSrc->width <= 0) || (pSrc->height <= 0)) return;
+	if ((pDst->width <= 0) || (pDst->height <= 0)) {
+		*pDst = *pSrc;
 		return;
 	}
-	else {
-		glBindBuffer(GL_ARRAY_BUFFER, pUser->vboIds[layer][texId]);
-		glBufferData(GL_ARRAY_BUFFER, pUser->verticeSize, pUser->vertices[layer][texId], GL_STATIC_DRAW);
+	GLint right = (pDst->left + pDst->width > pSrc->left + pSrc->width) ? (pDst->left + pDst->width) : (pSrc->left + pSrc->width);
+	GLint bottom = (pDst->top + pDst->height > pSrc->top + pSrc->height) ? (pDst->top + pDst->height) : (pSrc->top + pSrc->height);
+	pDst->left = (pDst->left < pSrc->left) ? pDst->left : pSrc->left;
+	pDst->top = (pDst->top < pSrc->top) ? pDst->top : pSrc->top;
+	pDst->width = right - pDst->left;
+	pDst->height = bottom - pDst->top;
+}
 
-		// Bind the VAO and then setup the vertex
-		glBindVertexArray(pUser->vaoIds[layer][texId]);
-		// Load the vertex position
-		glBindBuffer(GL_ARRAY_BUFFER, pUser->vboIds[layer][texId]);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), (const void*)0);
-		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), (const void*)(3 * sizeof(GLfloat)));
+// screen area covered by the quad vertices, origin at the window left top
+static void getQuadBounds(stUserData *pUser, GLuint layer, GLuint texIdx, stRect *pBounds)
+{
+	GLfloat minX = 1.0f, maxX = -1.0f, minY = 1.0f, maxY = -1.0f;
+	GLuint i = 0;
+	for (i = 0; i < QUAD_VERTEX_NUM; i++) {
+		GLfloat x = pUser->vertices[layer][texIdx][i * VERTEX_FLOAT_NUM];
+		GLfloat y = pUser->vertices[layer][texIdx][i * VERTEX_FLOAT_NUM + 1];
+		minX = (x < minX) ? x : minX;
+		maxX = (x > maxX) ? x : maxX;
+		minY = (y < minY) ? y : minY;
+		maxY = (y > maxY) ? y : maxY;
+	}
 
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, pUser->vboIndiceId);
-		glEnableVertexAttribArray(0);
-		glEnableVertexAttribArray(1);
+	// one more pixel on each side, so rounding never leaves an edge pixel out
+	GLint left = (GLint)floorf(coordinateTrans(minX, SCREEN_TO_TEXTURE) * pUser->winWidth) - 1;
+	GLint right = (GLint)ceilf(coordinateTrans(maxX, SCREEN_TO_TEXTURE) * pUser->winWidth) + 1;
+	GLint top = (GLint)floorf(coordinateTrans(-maxY, SCREEN_TO_TEXTURE) * pUser->winHeight) - 1;
+	GLint bottom = (GLint)ceilf(coordinateTrans(-minY, SCREEN_TO_TEXTURE) * pUser->winHeight) + 1;
+	pBounds->left = (left < 0) ? 0 : left;
+	pBounds->top = (top < 0) ? 0 : top;
+	pBounds->width = ((right > (GLint)pUser->winWidth) ? (GLint)pUser->winWidth : right) - pBounds->left;
+	pBounds->height = ((bottom > (GLint)pUser->winHeight) ? (GLint)pUser->winHeight : bottom) - pBounds->top;
+}
 
-		// Reset to the default VAO
-		glBindVertexArray(0);
+// collect the damage of this frame from the dirty quads, and get the area of the back buffer to redraw:
+// the damage of every frame since the back buffer was last drawn. returns GL_FALSE if nothing is to redraw
+static GLboolean getRedrawArea(ESContext *esContext, stUserData *pUser, stRect *pRedraw)
+{
+	stRect damage = { 0, 0, 0, 0 };
+	GLuint layer = LAYER_ID_0;
+	for (layer = LAYER_ID_0; layer < LAYER_MAX; layer++) {
+		GLuint texIdx = 0;
+		for (texIdx = 0; texIdx < pUser->textureNumPerLayer[layer]; texIdx++) {
+			// visibility is also changed by writing texVisable directly, so it is compared instead of marked
+			GLboolean visible = isQuadVisible(pUser, layer, texIdx);
+			if (!pUser->quadDirty[layer][texIdx] && (visible == pUser->quadDrawn[layer][texIdx])) continue;
+
+			stRect *pBounds = &pUser->quadBounds[layer][texIdx];
+			unionRect(&damage, pBounds);
+			if (visible) {
+				getQuadBounds(pUser, layer, texIdx, pBounds);
+			}
+			else {
+				memset(pBounds, 0, sizeof(stRect));
+			}
+			unionRect(&damage, pBounds);
+			pUser->quadDirty[layer][texIdx] = GL_FALSE;
+			pUser->quadDrawn[layer][texIdx] = visible;
+		}
+	}
+
+	memmove(&pUser->damages[1], &pUser->damages[0], (DAMAGE_HISTORY_NUM - 1) * sizeof(stRect));
+	pUser->damages[0] = damage;
+
+	// the compositor is told what changed since the last frame, whatever the buffer age is
+	if ((damage.width > 0) && (damage.height > 0)) {
+		GLint rect[4] = { damage.left, pUser->winHeight - damage.top - damage.height, damage.width, damage.height };
+		esSetSwapDamage(esContext, rect, 1);
+	}
+
+	GLint age = esGetBufferAge(esContext);
+	if ((age <= 0) || (age > DAMAGE_HISTORY_NUM)) {
+		// contents of the back buffer unknown
+		pRedraw->left = 0;
+		pRedraw->top = 0;
+		pRedraw->width = pUser->winWidth;
+		pRedraw->height = pUser->winHeight;
+		return GL_TRUE;
 	}
+
+	memset(pRedraw, 0, sizeof(stRect));
+	GLint i = 0;
+	for (i = 0; i < age; i++) {
+		unionRect(pRedraw, &pUser->damages[i]);
+	}
+	return (pRedraw->width > 0) && (pRedraw->height > 0);
 }
+#endif
 
+// create the vertex stream and the only VAO, the attribute pointers never change after this.
+// every quad has its own 6 indices, so a quad is drawn from any stream position by an index offset
 void createVAOs(stUserData *pUser)
 {
 	stUserData *userData = pUser;
+	GLushort *indices = (GLushort*)malloc(STREAM_REGION_NUM * QUAD_MAX * QUAD_INDICE_NUM * sizeof(GLushort));
+	GLuint quad = 0;
+	for (quad = 0; quad < STREAM_REGION_NUM * QUAD_MAX; quad++) {
+		GLuint i = 0;
+		for (i = 0; i < QUAD_INDICE_NUM; i++) {
+			indices[quad * QUAD_INDICE_NUM + i] = (GLushort)(quad * QUAD_VERTEX_NUM + userData->indices[i]);
+		}
+	}
+
 	glGenBuffers(1, &userData->vboIndiceId);
 	// VBO of indice
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, userData->vboIndiceId);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, userData->indiceNum * sizeof(GLushort), userData->indices, GL_STATIC_DRAW);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, STREAM_REGION_NUM * QUAD_MAX * QUAD_INDICE_NUM * sizeof(GLushort), indices, GL_STATIC_DRAW);
+	free(indices);
+
+	// VBO of the vertex stream, written every frame
+	glGenBuffers(1, &userData->streamVboId);
+	glBindBuffer(GL_ARRAY_BUFFER, userData->streamVboId);
+	glBufferData(GL_ARRAY_BUFFER, STREAM_REGION_NUM * QUAD_MAX * userData->verticeSize, NULL, GL_DYNAMIC_DRAW);
+
+	// Generate VAO Id
+	glGenVertexArrays(1, &userData->streamVaoId);
+	// Bind the VAO and then setup the vertex
+	glBindVertexArray(userData->streamVaoId);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, VERTEX_FLOAT_NUM * sizeof(GLfloat), (const void*)0);
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, VERTEX_FLOAT_NUM * sizeof(GLfloat), (const void*)(3 * sizeof(GLfloat)));
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, userData->vboIndiceId);
+	glEnableVertexAttribArray(0);
+	glEnableVertexAttribArray(1);
 
+	// Reset to the default VAO
+	glBindVertexArray(0);
+
+	userData->streamRegion = 0;
+	memset(userData->streamFences, 0, sizeof(userData->streamFences));
+}
+
+// copy the vertices of all the visible quads into the next stream region, in layer order,
+// and merge neighbour quads sharing the same state into one draw batch; a quad with a
+// shader hole is a batch of its own, the hole uniforms are set per batch.
+// the region is mapped unsynchronized, its fence tells when the GPU stopped reading it
+void streamQuads(stUserData *pUser)
+{
+	pUser->batchNum = 0;
+
+	GLuint quadNum = 0;
 	GLuint layer = LAYER_ID_0;
-	/********* BIND VBOs *********/
 	for (layer = LAYER_ID_0; layer < LAYER_MAX; layer++) {
-		glGenBuffers(userData->textureNumPerLayer[layer], userData->vboIds[layer]);
-		esLogMessage("layer: %d, VBO cnt = %d\n", layer, userData->textureNumPerLayer[layer]);
+		GLuint texIdx = 0;
+		for (texIdx = 0; texIdx < pUser->textureNumPerLayer[layer]; texIdx++) {
+			if (isQuadVisible(pUser, layer, texIdx)) quadNum++;
+		}
+	}
+	if (quadNum == 0) return;
 
-		// Generate VAO Id
-		glGenVertexArrays(userData->textureNumPerLayer[layer], userData->vaoIds[layer]);
-		GLuint text_idx = 0;
-		for (; text_idx < userData->textureNumPerLayer[layer]; text_idx++) {
-			glBindBuffer(GL_ARRAY_BUFFER, userData->vboIds[layer][text_idx]);
-			glBufferData(GL_ARRAY_BUFFER, userData->verticeSize, userData->vertices[layer][text_idx], GL_STATIC_DRAW);
+	pUser->streamRegion = (pUser->streamRegion + 1) % STREAM_REGION_NUM;
+	if (pUser->streamFences[pUser->streamRegion]) {
+		glClientWaitSync(pUser->streamFences[pUser->streamRegion], GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+		glDeleteSync(pUser->streamFences[pUser->streamRegion]);
+		pUser->streamFences[pUser->streamRegion] = 0;
+	}
 
-			// Bind the VAO and then setup the vertex
-			glBindVertexArray(userData->vaoIds[layer][text_idx]);
-			// Load the vertex position
-			glBindBuffer(GL_ARRAY_BUFFER, userData->vboIds[layer][text_idx]);
-			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), (const void*)0);
-			glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), (const void*)(3 * sizeof(GLfloat)));
+	GLuint firstQuad = pUser->streamRegion * QUAD_MAX;
+	glBindBuffer(GL_ARRAY_BUFFER, pUser->streamVboId);
+	GLubyte *pStream = (GLubyte*)glMapBufferRange(GL_ARRAY_BUFFER, firstQuad * pUser->verticeSize, quadNum * pUser->verticeSize,
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	if (pStream == NULL) {
+		esLogMessage("Map vertex stream failed\n");
+		return;
+	}
 
-			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, userData->vboIndiceId);
-			glEnableVertexAttribArray(0);
-			glEnableVertexAttribArray(1);
+	GLuint quad = 0;
+	for (layer = LAYER_ID_0; layer < LAYER_MAX; layer++) {
+		GLuint texIdx = 0;
+		for (texIdx = 0; texIdx < pUser->textureNumPerLayer[layer]; texIdx++) {
+			if (!isQuadVisible(pUser, layer, texIdx)) continue;
+			memcpy(pStream + quad * pUser->verticeSize, pUser->vertices[layer][texIdx], pUser->verticeSize);
 
-			// Reset to the default VAO
-			glBindVertexArray(0);
+			stDrawBatch *pBatch = (pUser->batchNum > 0) ? &pUser->batches[pUser->batchNum - 1] : NULL;
+			if ((pBatch == NULL) || (pBatch->texture != pUser->textureIds[layer][texIdx])
+#if MUTI_PROGRAM_ENABLE
+				|| (pBatch->layer != layer)
+#endif
+#if HOLE_SHADER_ENABLE
+				|| (pBatch->holeTexIdx >= 0) || (pUser->holeRect[layer][texIdx].width != 0)
+#endif
+				) {
+				pBatch = &pUser->batches[pUser->batchNum++];
+				pBatch->texture = pUser->textureIds[layer][texIdx];
+				pBatch->layer = layer;
+				pBatch->firstQuad = firstQuad + quad;
+				pBatch->quadNum = 0;
+#if HOLE_SHADER_ENABLE
+				pBatch->holeTexIdx = (pUser->holeRect[layer][texIdx].width != 0) ? (GLint)texIdx : -1;
+#endif
+			}
+			pBatch->quadNum++;
+			quad++;
 		}
 	}
+	glUnmapBuffer(GL_ARRAY_BUFFER);
 }
+// reuse the texture of an image already loaded by a previous quad
+static GLboolean findLoadedTexture(stUserData *pUser, GLuint layer, GLuint texIdx)
+{
+	GLuint l = LAYER_ID_0;
+	for (l = LAYER_ID_0; l <= layer; l++) {
+		GLuint i = 0;
+		GLuint num = (l == layer) ? texIdx : pUser->textureNumPerLayer[l];
+		for (i = 0; i < num; i++) {
+			if (strcmp(s_images[l][i], s_images[layer][texIdx]) == 0) {
+				pUser->textureIds[layer][texIdx] = pUser->textureIds[l][i];
+				pUser->texSize[layer][texIdx] = pUser->texSize[l][i];
+				pUser->texArea[layer][texIdx] = pUser->texArea[l][i];
+				pUser->texPageSize[layer][texIdx] = pUser->texPageSize[l][i];
+				return GL_TRUE;
+			}
+		}
+	}
+	return GL_FALSE;
+}
+
+// load the images that have no texture yet, they are decoded at the same time on the job pool
+// and uploaded when all are decoded, an image used by several quads is loaded once so that they can be batched
+static void loadLayerTextures(stUserData *pUser)
+{
+	ESTextureRequest requests[LAYER_MAX][MAX_TEXTURE_PER_LAYER];
+	ESTextureLoader *pLoader = esTextureLoaderCreate(esGetJobPool());
+	GLuint layer = LAYER_ID_0;
+	if (pLoader == NULL) return;
+
+	memset(requests, 0, sizeof(requests));
+	for (layer = LAYER_ID_0; layer < LAYER_MAX; layer++) {
+		GLuint texIdx = 0;
+		for (texIdx = 0; texIdx < pUser->textureNumPerLayer[layer]; texIdx++) {
+			if (pUser->textureIds[layer][texIdx] != 0 || findLoadedTexture(pUser, layer, texIdx)) continue;
+			pUser->textureIds[layer][texIdx] = esTextureLoaderRequest(pLoader, s_images[layer][texIdx], GL_FALSE, &requests[layer][texIdx]);
+		}
+	}
+	esTextureLoaderFinish(pLoader);
+	esTextureLoaderDestroy(pLoader);
+
+	for (layer = LAYER_ID_0; layer < LAYER_MAX; layer++) {
+		GLuint texIdx = 0;
+		for (texIdx = 0; texIdx < pUser->textureNumPerLayer[layer]; texIdx++) {
+			ESTextureRequest *pRequest = &requests[layer][texIdx];
+			if (pRequest->texture == 0) {
+				// packed in the atlas or shared, the quad it is shared with is complete now
+				findLoadedTexture(pUser, layer, texIdx);
+				continue;
+			}
+			if (pRequest->failed) {
+				glDeleteTextures(1, &pRequest->texture);
+				pUser->textureIds[layer][texIdx] = 0;
+				continue;
+			}
+			pUser->texSize[layer][texIdx].width = pRequest->width;
+			pUser->texSize[layer][texIdx].height = pRequest->height;
+			pUser->texArea[layer][texIdx].left = 0;
+			pUser->texArea[layer][texIdx].top = 0;
+			pUser->texArea[layer][texIdx].width = pRequest->width;
+			pUser->texArea[layer][texIdx].height = pRequest->height;
+			pUser->texPageSize[layer][texIdx] = pUser->texSize[layer][texIdx];
+		}
+	}
+}
+
 ///
 // Initialize the shader and program object
 //
@@ -553,8 +1138,20 @@ int Init(ESContext *esContext)
 
 	userData->dumpPixels = (GLubyte*)malloc(userData->winWidth * userData->winHeight * 4 * sizeof(GLubyte));
 
-	userData->holePixes = (GLubyte*)malloc(sizeof(GLubyte) * userData->winWidth * userData->winHeight * 4);
-	memset(userData->holePixes, 0, sizeof(GLubyte) * userData->winWidth * userData->winHeight * 4);
+#if HOLE_SHADER_ENABLE
+	memset(userData->holeRect, 0, sizeof(userData->holeRect));
+#else
+	memset(userData->holeBuffers, 0, sizeof(userData->holeBuffers));
+	userData->holeBufferNext = 0;
+#endif
+	// setLayerAlpha only marks a layer dirty when its alpha changes, every layer starts from 0
+	memset(userData->alphas, 0, sizeof(userData->alphas));
+#if DIRTY_RECT_ENABLE
+	memset(userData->quadDirty, 0, sizeof(userData->quadDirty));
+	memset(userData->quadDrawn, 0, sizeof(userData->quadDrawn));
+	memset(userData->quadBounds, 0, sizeof(userData->quadBounds));
+	memset(userData->damages, 0, sizeof(userData->damages));
+#endif
 
 	// layer0 have 3 texture
 	initDispArea(userData, LAYER_ID_0, 0, 0, userData->winWidth, userData->winHeight);
@@ -580,8 +1177,8 @@ int Init(ESContext *esContext)
 	initDispArea(userData, LAYER_ID_3, 160, 691, 90, 29);
 	initDispArea(userData, LAYER_ID_3, 160, 691, 90, 29);
 
-	char vShaderStr[] =
-		"#version 300 es                            \n"
+	// shader chunks, the version line and the feature defines are added by esAcquireProgramVariant
+	const char vShaderStr[] =
 		"layout(location = 0) in vec4 a_position;   \n"
 		"layout(location = 1) in vec2 a_texCoord;   \n"
 		"out vec2 v_texCoord;                       \n"
@@ -591,49 +1188,95 @@ int Init(ESContext *esContext)
 		"   v_texCoord = a_texCoord;                \n"
 		"}                                          \n";
 
-	char fShaderStr[] =
-		"#version 300 es                                     \n"
+	const char fShaderStr[] =
 		"precision mediump float;                            \n"
 		"in vec2 v_texCoord;                                 \n"
 		"layout(location = 0) out vec4 outColor;             \n"
 		"uniform sampler2D s_sampler;                       \n"
+		"#ifdef CTL_ALPHA                                    \n"
 		"uniform float ctl_alpha;                              \n"
+		"#endif                                              \n"
+		"#ifdef HOLE_MASK                                    \n"
+		"uniform vec4 u_holeRect;                            \n"
+		"uniform float u_holeAlpha;                          \n"
+		"#endif                                              \n"
 		"void main()                                         \n"
 		"{                                                   \n"
 		"  outColor = texture( s_sampler, v_texCoord );   \n"
-#if MUTI_PROGRAM_ENABLE 
+		"#ifdef HOLE_MASK                                    \n"
+		"  if (all(greaterThanEqual(v_texCoord, u_holeRect.xy)) && all(lessThan(v_texCoord, u_holeRect.zw)))\n"
+		"    outColor = vec4(0.0, 0.0, 0.0, u_holeAlpha);   \n"
+		"#endif                                              \n"
+		"#ifdef CTL_ALPHA                                    \n"
 		"  outColor.a = outColor.a * ctl_alpha;             \n"
-#endif
+		"#endif                                              \n"
 		"}                                                   \n";
+	const char *vShaderChunks[] = { vShaderStr, NULL };
+	const char *fShaderChunks[] = { fShaderStr, NULL };
+
+	// features of the program variant, only what is enabled is compiled in
+	const char *shaderDefines[] = {
+#if MUTI_PROGRAM_ENABLE
+		"CTL_ALPHA",
+#endif
+#if HOLE_SHADER_ENABLE
+		"HOLE_MASK",
+#endif
+		NULL
+	};
 
 #if !MUTI_PROGRAM_ENABLE
 	// Load the shaders and get a linked program object
-	userData->programObject = esLoadProgram(vShaderStr, fShaderStr);
+	userData->programObject = esAcquireProgramVariant(vShaderChunks, fShaderChunks, shaderDefines);
+	if (!esFinishProgram(userData->programObject)) {
+		return GL_FALSE;
+	}
 	// Get the sampler location
-	userData->samplerLoc = glGetUniformLocation(userData->programObject, "s_sampler");
+	userData->samplerLoc = esGetUniformLocation(userData->programObject, "s_sampler");
+#if HOLE_SHADER_ENABLE
+	userData->holeRectLoc = esGetUniformLocation(userData->programObject, "u_holeRect");
+	userData->holeAlphaLoc = esGetUniformLocation(userData->programObject, "u_holeAlpha");
+#endif
 #endif	
 
+	memset(userData->textureIds, 0, sizeof(userData->textureIds));
+	// the images are looked up in the asset pack before the disk
+	userData->assetPack = esPackMount(esContext->platformData, ASSET_PACK_FILE);
+#if TEXTURE_ATLAS_ENABLE
+	buildTextureAtlas(userData);
+#endif
+	loadLayerTextures(userData);
+
 	GLint layer = LAYER_ID_0;
 	for (; layer < LAYER_MAX; layer++) {
 #if MUTI_PROGRAM_ENABLE
-		// Load the shaders and get a linked program object
-		userData->programObjects[layer] = esLoadProgram(vShaderStr, fShaderStr);
+		// Same variant for every layer, only the first layer links the program, the others share it
+		userData->programObjects[layer] = esAcquireProgramVariant(vShaderChunks, fShaderChunks, shaderDefines);
+		if (!esFinishProgram(userData->programObjects[layer])) {
+			return GL_FALSE;
+		}
 
 		// Get the sampler location
-		userData->samplerLocs[layer] = glGetUniformLocation(userData->programObjects[layer], "s_sampler");
-		userData->ctlAlphaLocs[layer] = glGetUniformLocation(userData->programObjects[layer], "ctl_alpha");
+		userData->samplerLocs[layer] = esGetUniformLocation(userData->programObjects[layer], "s_sampler");
+		userData->ctlAlphaLocs[layer] = esGetUniformLocation(userData->programObjects[layer], "ctl_alpha");
+#if HOLE_SHADER_ENABLE
+		userData->holeRectLocs[layer] = esGetUniformLocation(userData->programObjects[layer], "u_holeRect");
+		userData->holeAlphaLocs[layer] = esGetUniformLocation(userData->programObjects[layer], "u_holeAlpha");
+#endif
 #endif
 
 		GLint texIdx = 0;
 		for (; texIdx < userData->textureNumPerLayer[layer]; texIdx++) {
-			// Load the textures
-			userData->textureIds[layer][texIdx] = loadTexture(s_images[layer][texIdx], &userData->texSize[layer][texIdx].width, &userData->texSize[layer][texIdx].height);
 			if (userData->textureIds[layer][texIdx] == 0) {
 				return FALSE;
 			}
 
 			userData->texVisable[layer][texIdx] = GL_TRUE;
 			esLogMessage("Texture: %s size [%d, %d]\n", s_images[layer][texIdx], userData->texSize[layer][texIdx].width, userData->texSize[layer][texIdx].height);
+
+			// show the whole image until a clip area is set
+			stRect clipArea = { 0, 0, userData->texSize[layer][texIdx].width, userData->texSize[layer][texIdx].height };
+			setClipArea(userData, layer, texIdx, &clipArea);
 		}
 
 		setLayerAlpha(userData, layer, 1.0f);
@@ -654,7 +1297,7 @@ int Init(ESContext *esContext)
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
 	stRect hole = { 64, 64, 128, 128 };
-	digHoleInTexture(userData, userData->textureIds[LAYER_ID_1][0], &hole, 0xff);
+	digHoleInTexture(userData, LAYER_ID_1, 0, &hole, 0xff);
 	return TRUE;
 }
 
@@ -676,7 +1319,6 @@ void Update(ESContext *esContext, float deltaTime)
 		clipArea.width = (1280 - x) * pUserData->texSize[LAYER_ID_3][0].width / 200;
 	}
 	setClipArea(pUserData, LAYER_ID_3, 0, &clipArea);
-	updateVAO(pUserData, LAYER_ID_3, 0);
 	x = (x++ > pUserData->winWidth) ? 0 : x;
 
 	static GLint cnt = 1;
@@ -688,7 +1330,6 @@ void Update(ESContext *esContext, float deltaTime)
 		dispArea.height = delta;
 		delta = (delta++ > 300) ? 1 : delta;
 		setDispArea(pUserData, LAYER_ID_2, 3, &dispArea);
-		updateVAO(pUserData, LAYER_ID_2, 3);
 	}
 	cnt++;
 
@@ -702,7 +1343,6 @@ void Update(ESContext *esContext, float deltaTime)
 		dispArea.width = userData->winWidth;
 		dispArea.height = userData->winHeight;
 		setDispArea(userData, LAYER_ID_0, 1, &dispArea);
-		updateVAO(userData, LAYER_ID_0, 1);
 #endif
 	}
 	else {
@@ -711,7 +1351,6 @@ void Update(ESContext *esContext, float deltaTime)
 #else
 		memset(&dispArea, 0, sizeof(dispArea));
 		setDispArea(userData, LAYER_ID_0, 1, &dispArea);
-		updateVAO(userData, LAYER_ID_0, 1);
 #endif
 	}
 #else
@@ -727,13 +1366,12 @@ void Update(ESContext *esContext, float deltaTime)
 	dispArea.width = pUserData->winWidth;
 	dispArea.height = h * pUserData->winHeight / pUserData->texSize[LAYER_ID_0][1].height;
 	setDispArea(pUserData, LAYER_ID_0, 1, &dispArea);
-	updateVAO(pUserData, LAYER_ID_0, 1);
 
 #endif
 
 	static GLubyte alpha = 0xff;
 	stRect hole = { 64, 64, 128, 128 };
-	digHoleInTexture(pUserData, pUserData->textureIds[LAYER_ID_1][0], &hole, alpha);
+	digHoleInTexture(pUserData, LAYER_ID_1, 0, &hole, alpha);
 	alpha = alpha > 0 ? --alpha : 0xff;
 
 	// rotate test
@@ -743,17 +1381,14 @@ void Update(ESContext *esContext, float deltaTime)
 	stPos rotateCenter = { 0.0 };
 	rotateCenter.x = pUserData->dispArea[LAYER_ID_1][2].left;
 	rotateCenter.y = pUserData->dispArea[LAYER_ID_1][2].top + pUserData->dispArea[LAYER_ID_1][2].height / 2;
-	updateVAO(pUserData, LAYER_ID_0, 2);
 
 	setRotateArea(pUserData, LAYER_ID_1, 2, angle, &rotateCenter);
 	//rotateTextureCoord(pUserData, LAYER_ID_1, 2, angle);
-	updateVAO(pUserData, LAYER_ID_1, 2);
 
 	angle += 0.5;
 	angle = (angle > 360.0) ? 0.0 : angle;
 
 	//rotateTextureCoord(pUserData, LAYER_ID_2, 1, 90);
-	//updateVAO(pUserData, LAYER_ID_2, 1);
 
 	// update FC_level image
 	memset(&pUserData->texVisable[LAYER_ID_3][1], GL_FALSE, sizeof(GLboolean) * 5);
@@ -773,48 +1408,74 @@ void Draw(ESContext *esContext)
 {
 	stUserData *userData = esContext->userData;
 
+#if DIRTY_RECT_ENABLE
+	// the back buffer is still right outside the redraw area, nothing is drawn if it is empty
+	stRect redraw;
+	if (!getRedrawArea(esContext, userData, &redraw)) return;
+	glEnable(GL_SCISSOR_TEST);
+	glScissor(redraw.left, userData->winHeight - redraw.top - redraw.height, redraw.width, redraw.height);
+#endif
+
 	// Set the viewport
 	glViewport(0, 0, esContext->width, esContext->height);
 
 	// Clear the color buffer
 	glClear(GL_COLOR_BUFFER_BIT);
 
+	// vertices changed by Update() are picked up here, no VAO needs to be updated
+	streamQuads(userData);
+	esStateBindVertexArray(userData->streamVaoId);
+
+	// Set the base map sampler to texture unit to 0, the tracker drops the
+	// program, sampler and alpha calls that repeat the previous frame
 #if !MUTI_PROGRAM_ENABLE
-	glUseProgram(userData->programObject);
-	// Set the base map sampler to texture unit to 0
-	glUniform1i(userData->samplerLoc, 0);
+	esStateUseProgram(userData->programObject);
+	esStateUniform1i(userData->samplerLoc, 0);
 #endif
 
-	GLint layer = LAYER_ID_0;
-	for (; layer < LAYER_MAX; layer++) {
+	// one draw per batch, a batch only breaks where the texture (or the layer program) changes, or around a quad with a shader hole
+	GLuint texture = 0;
 #if MUTI_PROGRAM_ENABLE
-		glUseProgram(userData->programObjects[layer]);
-		// Set the base map sampler to texture unit to 0
-		glUniform1i(userData->samplerLocs[layer], 0);
+	GLuint layer = LAYER_MAX;
 #endif
-
-		glActiveTexture(GL_TEXTURE0);
-
+	GLuint b = 0;
+	for (b = 0; b < userData->batchNum; b++) {
+		stDrawBatch *pBatch = &userData->batches[b];
 #if MUTI_PROGRAM_ENABLE
-		glUniform1f(userData->ctlAlphaLocs[layer], userData->alphas[layer]);
-#else
-		if (userData->alphas[layer] == 0) continue; // this layer not show
+		if (pBatch->layer != layer) {
+			layer = pBatch->layer;
+			// layers sharing a program only change their alpha
+			esStateUseProgram(userData->programObjects[layer]);
+			esStateUniform1i(userData->samplerLocs[layer], 0);
+			esStateUniform1f(userData->ctlAlphaLocs[layer], userData->alphas[layer]);
+		}
 #endif
-
-		GLint texIdx = 0;
-		for (; texIdx < userData->textureNumPerLayer[layer]; texIdx++) {
-			if (userData->texVisable[layer][texIdx] == GL_FALSE) continue;
-			// Bind the VAO
-			glBindVertexArray(userData->vaoIds[layer][texIdx]);
+		if (pBatch->texture != texture) {
+			texture = pBatch->texture;
 			// Bind the base map
-			glBindTexture(GL_TEXTURE_2D, userData->textureIds[layer][texIdx]);
-
-			glDrawElements(GL_TRIANGLES, userData->indiceNum, GL_UNSIGNED_SHORT, (const void *)0);
+			esStateBindTexture(0, GL_TEXTURE_2D, texture);
 		}
+#if HOLE_SHADER_ENABLE
+		// the tracker drops the calls while consecutive batches have no hole
+#if MUTI_PROGRAM_ENABLE
+		setHoleUniforms(userData, pBatch, userData->holeRectLocs[layer], userData->holeAlphaLocs[layer]);
+#else
+		setHoleUniforms(userData, pBatch, userData->holeRectLoc, userData->holeAlphaLoc);
+#endif
+#endif
+
+		glDrawElements(GL_TRIANGLES, pBatch->quadNum * userData->indiceNum, GL_UNSIGNED_SHORT,
+			(const void *)(pBatch->firstQuad * QUAD_INDICE_NUM * sizeof(GLushort)));
 	}
 
-	// Reset to the default VAO
-	glBindVertexArray(0);
+#if DIRTY_RECT_ENABLE
+	glDisable(GL_SCISSOR_TEST);
+#endif
+
+	// the region can be written again once the GPU passed this point
+	if (userData->batchNum > 0) {
+		userData->streamFences[userData->streamRegion] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
 
 #if 0
 	if (userData->dumpPixels) {
@@ -834,14 +1495,14 @@ void ShutDown(ESContext *esContext)
 {
 	stUserData *userData = esContext->userData;
 #if !MUTI_PROGRAM_ENABLE
-	glDeleteProgram(userData->programObject);
+	esReleaseProgram(userData->programObject);
 #endif
 
 	GLint i = 0;
 	for (i = 0; i < LAYER_MAX; i++) {
 #if MUTI_PROGRAM_ENABLE
-		// Delete program object
-		glDeleteProgram(userData->programObjects[i]);
+		// Release program object, deleted with the last layer using it
+		esReleaseProgram(userData->programObjects[i]);
 #endif
 
 		// Delete texture object
@@ -860,13 +1521,26 @@ void ShutDown(ESContext *esContext)
 		userData->indices = NULL;
 	}
 
+	for (i = 0; i < STREAM_REGION_NUM; i++) {
+		if (userData->streamFences[i]) glDeleteSync(userData->streamFences[i]);
+	}
+	glDeleteVertexArrays(1, &userData->streamVaoId);
+	glDeleteBuffers(1, &userData->streamVboId);
+	glDeleteBuffers(1, &userData->vboIndiceId);
+
 	if (userData->dumpPixels) {
 		free(userData->dumpPixels);
 		userData->dumpPixels = NULL;
 	}
+	esPackUnmount(userData->assetPack);
+	userData->assetPack = NULL;
 
-	free(userData->holePixes);
-	userData->holePixes = NULL;
+#if !HOLE_SHADER_ENABLE
+	for (i = 0; i < HOLE_BUFFER_MAX; i++) {
+		free(userData->holeBuffers[i].pixels);
+		userData->holeBuffers[i].pixels = NULL;
+	}
+#endif
 }
 
 int esMain(ESContext *esContext)
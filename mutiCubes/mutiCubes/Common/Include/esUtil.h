@@ -78,6 +78,28 @@ extern "C" {
 #define ES_WINDOW_STENCIL       4
 /// esCreateWindow flat - multi-sample buffer
 #define ES_WINDOW_MULTISAMPLE   8
+/// esCreateWindow flag - render offscreen to an EGL pbuffer, no native window (also set by the ES_HEADLESS environment variable)
+#define ES_WINDOW_HEADLESS      16
+
+/// Maximum number of rectangles passed to esSetSwapDamage
+#define ES_DAMAGE_RECT_MAX      8
+
+/// Texture container written by the esTexConv tool, "ESTX" in the file
+#define ES_TEXTURE_FILE_MAGIC      0x58545345
+#define ES_TEXTURE_FILE_VERSION    1
+#define ES_TEXTURE_FILE_EXT        ".estex"
+#define ES_TEXTURE_FILE_ALIGN      4096     // every level starts on a page boundary of the file
+#define ES_TEXTURE_FILE_LEVEL_MAX  16
+#define ES_TEXTURE_FILE_SIZE_MAX   16384    // widest and highest texture a container holds
+/// Texture container flag - the color channels are multiplied by alpha
+#define ES_TEXTURE_FILE_PREMULTIPLIED  1
+
+/// Asset pack written by the esPacker tool, "ESPK" in the file
+#define ES_PACK_FILE_MAGIC         0x4b505345
+#define ES_PACK_FILE_VERSION       1
+#define ES_PACK_FILE_ALIGN         4096     // every entry starts on a page boundary of the file
+/// Asset pack entry flag - the entry is an LZ4 block
+#define ES_PACK_ENTRY_LZ4          1
 
 
 ///
@@ -95,6 +117,156 @@ typedef struct
    GLfloat   m[4][4];
 } ESMatrix;
 
+typedef struct
+{
+   GLfloat   m[3][3];
+} ESMatrix3;
+
+/// Structure-of-arrays input of esMatrixBuildTRSBatch, element i of every array
+/// describes object i
+typedef struct
+{
+   /// Translation
+   const GLfloat *posX, *posY, *posZ;
+
+   /// Rotation axis, does not need to be normalized, NULL for no rotation
+   const GLfloat *axisX, *axisY, *axisZ;
+
+   /// Rotation angle in degrees, NULL to use defaultAngle for every object
+   const GLfloat *angle;
+   GLfloat        defaultAngle;
+
+   /// Uniform scale, NULL for no scaling
+   const GLfloat *scale;
+} ESTRSArrays;
+
+typedef struct ESThread ESThread;
+typedef struct ESMutex ESMutex;
+typedef struct ESCond ESCond;
+typedef struct ESJobPool ESJobPool;
+
+/// Set of jobs submitted to a job pool that can be waited on together,
+/// must be zero initialized
+typedef struct
+{
+   int       pending;
+} ESJobGroup;
+
+/// Guard for esOnce, must be initialized with ES_ONCE_INIT
+typedef struct
+{
+   volatile long state;
+} ESOnce;
+
+#define ES_ONCE_INIT { 0 }
+
+typedef struct ESFrameStates ESFrameStates;
+
+/// Calls of the state tracker passed to GL and dropped as redundant
+typedef struct
+{
+   unsigned int issued;
+   unsigned int elided;
+} ESStateCounter;
+
+typedef struct
+{
+   ESStateCounter programs;
+   ESStateCounter vertexArrays;
+   ESStateCounter textures;      // glActiveTexture and glBindTexture
+   ESStateCounter uniforms;
+} ESStateStats;
+
+/// Read-only view of a whole file made by esFileMap
+typedef struct
+{
+   const unsigned char *data;     // NULL for an empty file
+   size_t               size;
+   void                *handle;   // the asset on Android, the inflated copy of a packed file
+   GLboolean            packed;   // the data is in a mounted pack
+} ESFileMap;
+
+typedef struct ESPack ESPack;
+
+/// Header of an asset pack, little endian, followed by the table of contents,
+/// the names and the entries
+typedef struct
+{
+   unsigned int magic;            // ES_PACK_FILE_MAGIC
+   unsigned int version;          // ES_PACK_FILE_VERSION
+   unsigned int entryCount;
+   unsigned int slotCount;        // slots of the table of contents, a power of two
+   unsigned int namesOffset;      // names of the entries, each ends with a 0
+   unsigned int namesSize;
+   unsigned int reserved[2];
+} ESPackHeader;
+
+/// Slot of the table of contents of an asset pack, the name of an entry is looked up
+/// from the slot its hash falls in to the next empty slot
+typedef struct
+{
+   unsigned int hash;             // FNV-1a of the name
+   unsigned int nameOffset;       // into the names
+   unsigned int nameLength;       // 0 for an empty slot
+   unsigned int flags;            // ES_PACK_ENTRY_LZ4
+   unsigned int offset;           // from the start of the file
+   unsigned int size;             // bytes in the file
+   unsigned int originalSize;     // bytes once inflated
+   unsigned int reserved;
+} ESPackEntry;
+
+/// Image decoded by esImageLoad, 8 bits per channel with rows top to bottom
+typedef struct
+{
+   unsigned char *pixels;     // NULL if the file could not be decoded
+   int            width;
+   int            height;
+   int            channels;   // channels in the file
+} ESImage;
+
+typedef struct ESTextureLoader ESTextureLoader;
+
+/// Texture loaded by an ESTextureLoader, owned by the caller and written by the
+/// GL thread when the texture is uploaded
+typedef struct
+{
+   GLuint    texture;        // named at request time, its storage comes with the upload
+   GLint     width;
+   GLint     height;
+   GLint     channels;
+   GLboolean ready;          // the upload is done or the file failed
+   GLboolean failed;
+   GLboolean premultiplied;  // loaded from a container with premultiplied alpha
+} ESTextureRequest;
+
+/// Header of a texture container, little endian, followed by the mip levels from the
+/// largest one.  Rows are tightly packed, compressed levels are ETC2 or EAC blocks.
+typedef struct
+{
+   unsigned int magic;            // ES_TEXTURE_FILE_MAGIC
+   unsigned int version;          // ES_TEXTURE_FILE_VERSION
+   unsigned int internalFormat;   // sized or compressed GL internal format
+   unsigned int format;           // GL format and type of the pixels, 0 if compressed
+   unsigned int type;
+   unsigned int width;
+   unsigned int height;
+   unsigned int levelCount;
+   unsigned int flags;            // ES_TEXTURE_FILE_PREMULTIPLIED
+   unsigned int reserved[3];
+   struct
+   {
+      unsigned int offset;        // from the start of the file
+      unsigned int size;
+   } levels[ES_TEXTURE_FILE_LEVEL_MAX];
+} ESTextureFileHeader;
+
+/// Texture container read by esTextureFileLoad
+typedef struct
+{
+   ESTextureFileHeader  header;
+   ESFileMap            map;      // the whole file, the levels are uploaded from it
+} ESTextureFile;
+
 typedef struct ESContext ESContext;
 
 struct ESContext
@@ -126,8 +298,31 @@ struct ESContext
 
    /// EGL surface
    EGLSurface  eglSurface;
+
+   /// Damage of the frame being drawn, x, y, width, height of each rectangle
+   EGLint      damageRects[4 * ES_DAMAGE_RECT_MAX];
+
+   /// Number of damage rectangles, 0 if the whole surface changed
+   EGLint      numDamageRects;
+
+   /// GL_TRUE if the surface is an offscreen pbuffer, see ES_WINDOW_HEADLESS
+   GLboolean   headless;
 #endif
 
+   /// Seconds between two frames, 0 if frames are not paced, see esSetFrameRate
+   double      frameInterval;
+
+   /// Time step of the update callback, 0 for the time elapsed since the last frame, see esSetFixedTimeStep
+   double      fixedTimeStep;
+
+   /// Frame clock state of the platform loop
+   double      lastFrameTime;
+   double      nextFrameTime;
+   double      updateTimeLeft;
+
+   /// Frame states handed from the update to the draw callback, see esRegisterFrameState
+   ESFrameStates *frameStates;
+
    /// Callbacks
    void ( ESCALLBACK *drawFunc ) ( ESContext * );
    void ( ESCALLBACK *shutdownFunc ) ( ESContext * );
@@ -152,6 +347,7 @@ struct ESContext
 ///         ES_WINDOW_DEPTH   - specifies that a depth buffer should be created
 ///         ES_WINDOW_STENCIL - specifies that a stencil buffer should be created
 ///         ES_WINDOW_MULTISAMPLE - specifies that a multi-sample buffer should be created
+///         ES_WINDOW_HEADLESS - specifies that no window is created, rendering goes to an EGL pbuffer
 /// \return GL_TRUE if window creation is succesful, GL_FALSE otherwise
 GLboolean ESUTIL_API esCreateWindow ( ESContext *esContext, const char *title, GLint width, GLint height, GLuint flags );
 
@@ -183,6 +379,75 @@ void ESUTIL_API esRegisterUpdateFunc ( ESContext *esContext, void ( ESCALLBACK *
 //
 void ESUTIL_API esRegisterKeyFunc ( ESContext *esContext,
                                     void ( ESCALLBACK *drawFunc ) ( ESContext *, unsigned char, int, int ) );
+//
+/// \brief Pace the frames of the platform loop: it sleeps, then spins, until the next frame is due
+/// \param esContext Application context
+/// \param framesPerSecond Target frame rate, 0 to run as fast as the swap allows
+///        (the default, also set by the ES_FRAME_RATE environment variable)
+//
+void ESUTIL_API esSetFrameRate ( ESContext *esContext, float framesPerSecond );
+
+//
+/// \brief Call the update callback with a fixed time step.  The elapsed time is accumulated and
+///        the callback runs as many times as whole steps fit, zero or more per frame.
+/// \param esContext Application context
+/// \param timeStep Update time step in seconds, 0 to pass the time elapsed since the last frame
+///        (the default, also set by the ES_FIXED_TIME_STEP environment variable)
+//
+void ESUTIL_API esSetFixedTimeStep ( ESContext *esContext, float timeStep );
+
+//
+/// \brief Keep what the update callback computes for a frame in a frame state, so that it can run
+///        on its own thread while the draw callback reads the previous state.  The update callback
+///        writes esGetUpdateState, the draw callback reads esGetDrawState.  With the update thread
+///        the states are triple buffered and handed over one at a time: the update thread publishes
+///        a state and waits until the draw side took it, then computes the next state while that
+///        one is drawn, so it runs at most one frame ahead.  The draw side of the platform loop
+///        does not wait and draws the last state again when no new one is ready; the headless and
+///        benchmark loops wait for the state of every step.
+/// \param esContext Application context
+/// \param initialState State drawn until the first update finishes, copied
+/// \param stateSize Size of the state in bytes
+/// \param updateThread GL_TRUE to run the update callback on its own thread, it must not call GL then.
+///        GL_FALSE keeps one state updated and drawn on the main thread.
+/// \return GL_TRUE if the states could be created
+//
+GLboolean ESUTIL_API esRegisterFrameState ( ESContext *esContext, const void *initialState, size_t stateSize, GLboolean updateThread );
+
+//
+/// \brief Frame state written by the update callback, NULL if esRegisterFrameState was not called
+//
+void *ESUTIL_API esGetUpdateState ( ESContext *esContext );
+
+//
+/// \brief Frame state read by the draw callback, NULL if esRegisterFrameState was not called
+//
+const void *ESUTIL_API esGetDrawState ( ESContext *esContext );
+
+//
+/// \brief Age of the back buffer contents (EGL_EXT_buffer_age)
+/// \param esContext Application context
+/// \return Number of frames since the back buffer contents were drawn, 0 if they are undefined
+///         or the extension is not supported, in which case the whole frame has to be drawn
+//
+GLint ESUTIL_API esGetBufferAge ( ESContext *esContext );
+
+//
+/// \brief Set the region changed by the frame being drawn, used by the next esSwapBuffers
+/// \param esContext Application context
+/// \param rects x, y, width, height of each rectangle, origin at the bottom left of the surface
+/// \param numRects Number of rectangles, 0 (or more than ES_DAMAGE_RECT_MAX) if the whole surface changed
+//
+void ESUTIL_API esSetSwapDamage ( ESContext *esContext, const GLint *rects, GLint numRects );
+
+//
+/// \brief Post the back buffer.  Only the damage set by esSetSwapDamage is posted when
+///        EGL_KHR_swap_buffers_with_damage or EGL_EXT_swap_buffers_with_damage is supported.
+///        The damage is reset to the whole surface afterwards.
+/// \param esContext Application context
+//
+void ESUTIL_API esSwapBuffers ( ESContext *esContext );
+
 //
 /// \brief Log a message to the debug output for the platform
 /// \param formatStr Format string for error log.
@@ -201,13 +466,101 @@ GLuint ESUTIL_API esLoadShader ( GLenum type, const char *shaderSrc );
 //
 ///
 /// \brief Load a vertex and fragment shader, create a program object, link program.
-///        Errors output to log.
+///        Errors output to log.  The linked program is kept in the program binary cache,
+///        the next load with the same sources on the same driver skips compiling.
 /// \param vertShaderSrc Vertex shader source code
 /// \param fragShaderSrc Fragment shader source code
 /// \return A new program object linked with the vertex/fragment shader pair, 0 on failure
 //
 GLuint ESUTIL_API esLoadProgram ( const char *vertShaderSrc, const char *fragShaderSrc );
 
+//
+///
+/// \brief Set the directory of the program binary cache used by esLoadProgram.  By default it is
+///        $ES_PROGRAM_CACHE or the working directory, on Android the internal data path.
+/// \param dir Existing directory, NULL or "" turns the cache off
+//
+void ESUTIL_API esSetProgramCacheDir ( const char *dir );
+
+//
+///
+/// \brief Start loading a program without waiting for the compiler.  Where GL_KHR_parallel_shader_compile
+///        is supported the driver compiles and links in the background, so several programs and the
+///        rest of the loading overlap.
+/// \param vertShaderSrc Vertex shader source code
+/// \param fragShaderSrc Fragment shader source code
+/// \return The program object, 0 on failure.  Call esFinishProgram before its first use.
+//
+GLuint ESUTIL_API esLoadProgramAsync ( const char *vertShaderSrc, const char *fragShaderSrc );
+
+//
+///
+/// \brief Check without blocking whether a program of esLoadProgramAsync is compiled and linked,
+///        always GL_TRUE without GL_KHR_parallel_shader_compile
+/// \param programObject Program object
+/// \return GL_TRUE if esFinishProgram does not wait for the driver
+//
+GLboolean ESUTIL_API esProgramReady ( GLuint programObject );
+
+//
+///
+/// \brief Wait for a program of esLoadProgramAsync or esAcquireProgram, print compile and link errors to the log
+/// \param programObject Program object
+/// \return GL_TRUE if the program is linked.  GL_FALSE if it failed, it is deleted then, except a
+///         registry program which is deleted by its last esReleaseProgram.
+//
+GLboolean ESUTIL_API esFinishProgram ( GLuint programObject );
+
+//
+///
+/// \brief Get a program from the program registry: sources that were already linked give the same
+///        program object with its reference count increased instead of a new program.  A new program
+///        is loaded like with esLoadProgramAsync, call esFinishProgram before its first use.
+/// \param vertShaderSrc Vertex shader source code
+/// \param fragShaderSrc Fragment shader source code
+/// \return The shared program object, 0 on failure.  Give it back with esReleaseProgram.
+//
+GLuint ESUTIL_API esAcquireProgram ( const char *vertShaderSrc, const char *fragShaderSrc );
+
+//
+///
+/// \brief Give back a program of esAcquireProgram, it is deleted with its last reference
+/// \param programObject Program object
+//
+void ESUTIL_API esReleaseProgram ( GLuint programObject );
+
+//
+///
+/// \brief glGetUniformLocation with the locations of registry programs cached
+/// \param programObject Program object
+/// \param name Uniform name
+/// \return Uniform location, -1 if the program has no such active uniform
+//
+GLint ESUTIL_API esGetUniformLocation ( GLuint programObject, const char *name );
+
+//
+///
+/// \brief Compose a shader source: the version line, a #define line for each feature, then the chunks.
+///        Chunks are shared pieces of GLSL without a version line, they select code with #ifdef.
+/// \param chunks NULL terminated list of source chunks
+/// \param defines NULL terminated list of defines like "GRASS" or "LIGHT_NUM 4", may be NULL
+/// \return The source, free it with free(), NULL if out of memory
+//
+char *ESUTIL_API esComposeShader ( const char *const *chunks, const char *const *defines );
+
+//
+///
+/// \brief Get the program of a shader variant from the program registry, both sources are composed
+///        with esComposeShader from the same defines.  A variant is compiled the first time it is asked
+///        for and shared afterwards.  Call esFinishProgram before its first use, give it back with esReleaseProgram.
+/// \param vertChunks NULL terminated list of vertex shader chunks
+/// \param fragChunks NULL terminated list of fragment shader chunks
+/// \param defines NULL terminated list of defines selecting the variant, may be NULL
+/// \return The shared program object, 0 on failure
+//
+GLuint ESUTIL_API esAcquireProgramVariant ( const char *const *vertChunks, const char *const *fragChunks,
+                                            const char *const *defines );
+
 
 //
 /// \brief Generates geometry for a sphere.  Allocates memory for the vertex data and stores
@@ -258,6 +611,54 @@ int ESUTIL_API esGenSquareGrid ( int size, GLfloat **vertices, GLuint **indices
 //
 char *ESUTIL_API esLoadTGA ( void *ioContext, const char *fileName, int *width, int *height );
 
+//
+/// \brief Maps a 8-bit, 24-bit or 32-bit TGA image, the pixels can be uploaded without a copy
+/// \param ioContext Context related to IO facility on the platform
+/// \param fileName Name of the file on disk
+/// \param map Receives the mapping, release it with esFileUnmap once the pixels are used
+/// \param width Width of loaded image in pixels
+/// \param height Height of loaded image in pixels
+/// \param bitsPerPixel Receives 8, 24 or 32
+///  \return Pointer to the pixels in the mapping.  NULL on failure, nothing is mapped then.
+//
+const char *ESUTIL_API esLoadTGAMapped ( void *ioContext, const char *fileName, ESFileMap *map,
+                                         int *width, int *height, int *bitsPerPixel );
+
+//
+/// \brief Map a whole file read-only: mmap on Linux, MapViewOfFile on Windows and the asset
+///        buffer on Android, so the pages come from the page cache without a copy
+/// \param ioContext Context related to IO facility on the platform, the asset manager on Android
+/// \param fileName Name of the file on disk
+/// \param map Receives the view of the file
+/// \return GL_FALSE if the file cannot be opened
+//
+GLboolean ESUTIL_API esFileMap ( void *ioContext, const char *fileName, ESFileMap *map );
+
+//
+/// \brief Release a view made by esFileMap
+//
+void ESUTIL_API esFileUnmap ( ESFileMap *map );
+
+//
+/// \brief Mount an asset pack, esFileMap looks files up in the packs mounted last first and
+///        then on disk.  Mount and unmount while no file is being mapped.
+/// \param ioContext Context related to IO facility on the platform
+/// \param fileName Name of the pack on disk
+/// \return NULL if the pack is missing or not valid
+//
+ESPack *ESUTIL_API esPackMount ( void *ioContext, const char *fileName );
+
+//
+/// \brief Unmount an asset pack, the files mapped from it must be unmapped first
+//
+void ESUTIL_API esPackUnmount ( ESPack *pack );
+
+//
+/// \brief Map a file from the mounted packs, stored entries are not copied
+/// \return GL_FALSE if no mounted pack has the file
+//
+GLboolean ESUTIL_API esPackMap ( const char *fileName, ESFileMap *map );
+
 
 //
 /// \brief Multiply matrix specified by result with a scaling matrix and return new matrix in result
@@ -316,6 +717,115 @@ void ESUTIL_API esOrtho ( ESMatrix *result, float left, float right, float botto
 //
 void ESUTIL_API esMatrixMultiply ( ESMatrix *result, ESMatrix *srcA, ESMatrix *srcB );
 
+//
+/// \brief Perform result matrix = srcA matrix * srcB matrix for affine matrices, the last column
+///        of both inputs must be ( 0, 0, 0, 1 ), which is the case for any mix of esTranslate,
+///        esRotate and esScale.  Cheaper than esMatrixMultiply.
+/// \param result Returns multiplied matrix
+/// \param srcA, srcB Input affine matrices to be multiplied
+//
+void ESUTIL_API esMatrixMultiplyAffine ( ESMatrix *result, ESMatrix *srcA, ESMatrix *srcB );
+
+//
+/// \brief Transpose a matrix
+/// \param result Returns transposed matrix, may be the same as src
+/// \param src Input matrix
+//
+void ESUTIL_API esMatrixTranspose ( ESMatrix *result, ESMatrix *src );
+
+//
+/// \brief Transform a vector by a matrix, the same way the shader computes matrix * vec
+/// \param result Returns the transformed vector (4 floats), may be the same as vec
+/// \param matrix Transformation matrix
+/// \param vec Input vector (4 floats)
+//
+void ESUTIL_API esMatrixTransformVec4 ( GLfloat *result, ESMatrix *matrix, const GLfloat *vec );
+
+//
+/// \brief Perform result[i] = srcA[i] * srcB for count matrices, e.g. all the model matrices
+///        of a scene by one view-projection matrix
+/// \param result Returns the multiplied matrices, may be the same as srcA
+/// \param resultStride Bytes between two result matrices, 0 for tightly packed.  Lets the
+///        results go straight into an interleaved (mapped) instance buffer
+/// \param srcA Input matrices
+/// \param srcStride Bytes between two input matrices, 0 for tightly packed
+/// \param srcB Matrix every input is multiplied by
+/// \param count Number of matrices
+//
+void ESUTIL_API esMatrixMultiplyBatch ( void *result, GLsizei resultStride, const void *srcA, GLsizei srcStride,
+                                        ESMatrix *srcB, int count );
+
+//
+/// \brief Same as esMatrixMultiplyBatch, large batches are split over the threads of esGetJobPool
+//
+void ESUTIL_API esMatrixMultiplyBatchParallel ( void *result, GLsizei resultStride, const void *srcA,
+                                                GLsizei srcStride, ESMatrix *srcB, int count );
+
+//
+/// \brief Build count model matrices from translation, axis-angle rotation and scale arrays,
+///        each matrix is the same as esMatrixLoadIdentity, esTranslate, esRotate and esScale
+/// \param result Returns the model matrices
+/// \param resultStride Bytes between two result matrices, 0 for tightly packed
+/// \param src Structure-of-arrays transforms
+/// \param count Number of matrices
+//
+void ESUTIL_API esMatrixBuildTRSBatch ( void *result, GLsizei resultStride, const ESTRSArrays *src, int count );
+
+//
+/// \brief Same as esMatrixBuildTRSBatch, large batches are split over the threads of esGetJobPool
+//
+void ESUTIL_API esMatrixBuildTRSBatchParallel ( void *result, GLsizei resultStride, const ESTRSArrays *src,
+                                                int count );
+
+//
+/// \brief Invert a matrix
+/// \param result Returns the inverse, may be the same as src
+/// \param src Input matrix
+/// \return GL_FALSE and result left unchanged if src is singular
+//
+GLboolean ESUTIL_API esMatrixInverse ( ESMatrix *result, ESMatrix *src );
+
+//
+/// \brief Invert an affine matrix, the last column must be ( 0, 0, 0, 1 ) which is the case
+///        for any mix of esTranslate, esRotate and esScale.  Much cheaper than esMatrixInverse.
+/// \return GL_FALSE and result left unchanged if src is singular
+//
+GLboolean ESUTIL_API esMatrixInverseAffine ( ESMatrix *result, ESMatrix *src );
+
+//
+/// \brief Compute the normal matrix transpose ( inverse ( mat3 ( src ) ) ) on the CPU, upload it
+///        with glUniformMatrix3fv ( loc, 1, GL_FALSE, &result->m[0][0] ) or as a mat3 attribute
+/// \param result Returns the normal matrix
+/// \param src Model or model-view matrix, only the upper 3x3 part is used
+//
+void ESUTIL_API esMatrixNormalMatrix ( ESMatrix3 *result, const ESMatrix *src );
+
+//
+/// \brief Fast path of esMatrixNormalMatrix for rigid transforms (rotation and translation),
+///        the normal matrix is then the upper 3x3 part itself.  Also right for a uniform scale
+///        as long as the shader normalizes the normals.
+//
+void ESUTIL_API esMatrixNormalMatrixRigid ( ESMatrix3 *result, const ESMatrix *src );
+
+//
+/// \brief Normal matrices of count matrices
+/// \param result Returns the normal matrices
+/// \param resultStride Bytes between two results, 0 for tightly packed
+/// \param src Input matrices
+/// \param srcStride Bytes between two input matrices, 0 for tightly packed
+/// \param count Number of matrices
+/// \param rigid GL_TRUE if every input is rigid, see esMatrixNormalMatrixRigid
+//
+void ESUTIL_API esMatrixNormalMatrixBatch ( void *result, GLsizei resultStride, const void *src, GLsizei srcStride,
+                                            int count, GLboolean rigid );
+
+//
+/// \brief Name of the matrix kernels selected for this CPU ("avx", "sse", "neon" or "scalar").
+///        The SIMD kernels give bit-identical results to the scalar ones, set the environment
+///        variable ES_MATRIX_SCALAR=1 to force the scalar kernels.
+//
+const char *ESUTIL_API esMatrixKernelName ( void );
+
 //
 //// \brief Return an identity matrix
 //// \param result Returns identity matrix
@@ -335,6 +845,197 @@ esMatrixLookAt ( ESMatrix *result,
                  float lookAtX, float lookAtY, float lookAtZ,
                  float upX,     float upY,     float upZ );
 
+//
+/// \brief Monotonic clock, not affected by changes of the system time
+/// \return Seconds since an unspecified point in the past
+//
+double ESUTIL_API esGetTime ( void );
+
+//
+/// \brief Sleep, then spin for the last part of the wait, until esGetTime() reaches time
+//
+void ESUTIL_API esWaitUntil ( double time );
+
+//
+/// \brief Number of CPU cores available to the process
+//
+int ESUTIL_API esGetCpuCount ( void );
+
+//
+/// \brief Start a thread running func ( arg )
+/// \return The thread, or NULL if it could not be created
+//
+ESThread *ESUTIL_API esThreadCreate ( void ( *func ) ( void * ), void *arg );
+
+//
+/// \brief Wait for a thread to return and free it
+//
+void ESUTIL_API esThreadJoin ( ESThread *thread );
+
+//
+/// \brief Mutex and condition variable, esCondWait must be called with the mutex locked
+//
+ESMutex *ESUTIL_API esMutexCreate ( void );
+void ESUTIL_API esMutexDestroy ( ESMutex *mutex );
+void ESUTIL_API esMutexLock ( ESMutex *mutex );
+void ESUTIL_API esMutexUnlock ( ESMutex *mutex );
+ESCond *ESUTIL_API esCondCreate ( void );
+void ESUTIL_API esCondDestroy ( ESCond *cond );
+void ESUTIL_API esCondWait ( ESCond *cond, ESMutex *mutex );
+void ESUTIL_API esCondSignal ( ESCond *cond );
+void ESUTIL_API esCondBroadcast ( ESCond *cond );
+
+//
+/// \brief Atomic pointer exchange, esAtomicCompareExchangePointer stores desired only if the
+///        target holds expected
+/// \return The previous value of the target
+//
+void *ESUTIL_API esAtomicExchangePointer ( void *volatile *target, void *value );
+void *ESUTIL_API esAtomicCompareExchangePointer ( void *volatile *target, void *expected, void *desired );
+
+//
+/// \brief Call func ( ) exactly once per guard, other threads calling esOnce on the same guard
+///        meanwhile wait until it returned
+//
+void ESUTIL_API esOnce ( ESOnce *once, void ( *func ) ( void ) );
+
+//
+/// \brief Create a pool of worker threads running submitted jobs in order
+/// \param numThreads Number of workers, 0 for one less than the number of cores
+//
+ESJobPool *ESUTIL_API esJobPoolCreate ( int numThreads );
+
+//
+/// \brief Run the jobs still queued, stop the workers and free the pool.  Threads waiting in
+///        esJobPoolWait are let out before the pool is freed, nothing may be submitted afterwards.
+//
+void ESUTIL_API esJobPoolDestroy ( ESJobPool *pool );
+
+//
+/// \brief Queue func ( arg ) on the pool
+/// \param group Group the job is counted in for esJobPoolWait, may be NULL
+//
+void ESUTIL_API esJobPoolSubmit ( ESJobPool *pool, ESJobGroup *group, void ( *func ) ( void * ), void *arg );
+
+//
+/// \brief Wait for every job of the group, the calling thread runs queued jobs meanwhile
+//
+void ESUTIL_API esJobPoolWait ( ESJobPool *pool, ESJobGroup *group );
+
+//
+/// \brief Pool shared by the library and the samples, created on the first call
+/// \return The pool, or NULL if it could not be created
+//
+ESJobPool *ESUTIL_API esGetJobPool ( void );
+
+//
+/// \brief Destroy the shared pool, called by the framework after the shutdown callback
+//
+void ESUTIL_API esShutdownJobPool ( void );
+
+//
+/// \brief State tracker: glUseProgram, glBindVertexArray, glActiveTexture + glBindTexture and glUniform
+///        that skip the call when the value is already set.  Uniforms are shadowed per program for
+///        locations below 32.  The tracker only knows what went through it, call esStateInvalidate
+///        after changing the same state with plain GL calls.
+//
+void ESUTIL_API esStateUseProgram ( GLuint programObject );
+void ESUTIL_API esStateBindVertexArray ( GLuint vertexArray );
+void ESUTIL_API esStateBindTexture ( GLuint unit, GLenum target, GLuint texture );
+void ESUTIL_API esStateUniform1i ( GLint location, GLint v0 );
+void ESUTIL_API esStateUniform1f ( GLint location, GLfloat v0 );
+void ESUTIL_API esStateUniform3f ( GLint location, GLfloat v0, GLfloat v1, GLfloat v2 );
+void ESUTIL_API esStateUniform4f ( GLint location, GLfloat v0, GLfloat v1, GLfloat v2, GLfloat v3 );
+
+//
+/// \brief Bind a texture and leave its unit active, for glTexImage2D and the other calls that
+///        change the texture bound to the active unit.  esStateBindTexture does not change the
+///        active unit when the texture is already bound.
+//
+void ESUTIL_API esStateEditTexture ( GLuint unit, GLenum target, GLuint texture );
+
+//
+/// \brief Drop the uniform shadows of a program that is deleted, its name may be reused
+//
+void ESUTIL_API esStateForgetProgram ( GLuint programObject );
+
+//
+/// \brief Forget all the tracked state, the next call of each kind goes to GL
+//
+void ESUTIL_API esStateInvalidate ( void );
+
+//
+/// \brief Counters of the calls passed to GL and dropped since the last esStateResetStats
+//
+void ESUTIL_API esStateGetStats ( ESStateStats *stats );
+void ESUTIL_API esStateResetStats ( void );
+
+//
+/// \brief Decode an image file, or take the first level of its container fileName + ES_TEXTURE_FILE_EXT
+/// \param forceChannels Channels of the returned pixels, 0 to keep the channels of the file
+/// \return GL_FALSE if the file could not be decoded, the image pixels are then NULL
+//
+GLboolean ESUTIL_API esImageLoad ( const char *fileName, int forceChannels, ESImage *image );
+
+//
+/// \brief Decode several image files at once on the job pool, returns when all are decoded
+//
+void ESUTIL_API esImageLoadBatch ( ESJobPool *pool, const char *const *fileNames, int count, int forceChannels, ESImage *images );
+
+//
+/// \brief Free the pixels of an image
+//
+void ESUTIL_API esImageFree ( ESImage *image );
+
+//
+/// \brief Read and check a texture container
+/// \return GL_FALSE if the file is missing or not a valid container
+//
+GLboolean ESUTIL_API esTextureFileLoad ( const char *fileName, ESTextureFile *file );
+
+//
+/// \brief Free the data of a texture container
+//
+void ESUTIL_API esTextureFileFree ( ESTextureFile *file );
+
+//
+/// \brief Upload every level of a texture container to the GL_TEXTURE_2D bound to the active unit
+/// \return GL_FALSE if the texture is above GL_MAX_TEXTURE_SIZE or GL raised an error on the upload
+//
+GLboolean ESUTIL_API esTextureFileUpload ( const ESTextureFile *file );
+
+//
+/// \brief Loader decoding texture files on a job pool and uploading them on the GL thread,
+///        every function must be called from the GL thread
+/// \param pool Pool running the decodes, NULL to decode in esTextureLoaderRequest
+//
+ESTextureLoader *ESUTIL_API esTextureLoaderCreate ( ESJobPool *pool );
+
+//
+/// \brief Wait for the decodes in flight and free the loader, textures not uploaded yet keep no storage
+//
+void ESUTIL_API esTextureLoaderDestroy ( ESTextureLoader *loader );
+
+//
+/// \brief Queue the decode of a texture file, RGBA textures clamp to edge and the others repeat.
+///        The container fileName + ES_TEXTURE_FILE_EXT is read instead of the file when there
+///        is one, its mip levels replace the generated ones.
+/// \param request Filled at once with the texture name, the rest when the texture is uploaded
+/// \return The texture name
+//
+GLuint ESUTIL_API esTextureLoaderRequest ( ESTextureLoader *loader, const char *fileName, GLboolean mipmap, ESTextureRequest *request );
+
+//
+/// \brief Upload the decoded textures until budget seconds are spent, at least one if any is decoded
+/// \return Number of requested textures not uploaded yet
+//
+int ESUTIL_API esTextureLoaderUpload ( ESTextureLoader *loader, double budget );
+
+//
+/// \brief Wait for every requested texture and upload them all
+//
+void ESUTIL_API esTextureLoaderFinish ( ESTextureLoader *loader );
+
 #ifdef __cplusplus
 }
 #endif
@@ -65,6 +65,43 @@ extern "C" {
 //
 GLboolean WinCreate ( ESContext *esContext, const char *title );
 
+///
+//  HeadlessLoop()
+//
+//      Frame loop used instead of the platform loop when esContext->headless is set
+//
+void HeadlessLoop ( ESContext *esContext );
+
+///
+//  RunFrame()
+//
+//      Wait until the frame is due, call the update callback (once with the elapsed time,
+//      or in fixed steps), draw and swap.  Called by the platform loops once per frame.
+//
+void RunFrame ( ESContext *esContext );
+
+///
+//  FrameStatesDestroy()
+//
+//      Stop the update thread and free the frame states, called before the shutdown callback
+//
+void FrameStatesDestroy ( ESContext *esContext );
+
+///
+//  BenchmarkRequested()
+//
+//      GL_TRUE if the ES_BENCHMARK environment variable asks for a benchmark run
+//
+GLboolean BenchmarkRequested ( void );
+
+///
+//  BenchmarkLoop()
+//
+//      Frame loop timing a fixed number of frames, used instead of the platform loop
+//      when BenchmarkRequested() is GL_TRUE
+//
+void BenchmarkLoop ( ESContext *esContext );
+
 #ifdef __cplusplus
 }
 #endif
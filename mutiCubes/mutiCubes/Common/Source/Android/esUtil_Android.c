@@ -39,8 +39,8 @@
 //
 #include <android/log.h>
 #include <android_native_app_glue.h>
-#include <time.h>
 #include "esUtil.h"
+#include "esUtil_win.h"
 
 #define LOGI(...) ((void)__android_log_print(ANDROID_LOG_INFO, "esUtil", __VA_ARGS__))
 
@@ -51,17 +51,6 @@
 //
 //
 
-///
-// GetCurrentTime()
-//
-static float GetCurrentTime()
-{
-   struct timespec clockRealTime;
-   clock_gettime ( CLOCK_MONOTONIC, &clockRealTime );
-   double curTimeInSeconds = clockRealTime.tv_sec + ( double ) clockRealTime.tv_nsec / 1e9;
-   return ( float ) curTimeInSeconds;
-}
-
 ///
 // HandleCommand()
 //
@@ -93,11 +82,15 @@ static void HandleCommand ( struct android_app *pApp, int32_t cmd )
       case APP_CMD_TERM_WINDOW:
 
          // Cleanup on shutdown
+         FrameStatesDestroy ( esContext );
+
          if ( esContext->shutdownFunc != NULL )
          {
             esContext->shutdownFunc ( esContext );
          }
 
+         esShutdownJobPool ();
+
          if ( esContext->userData != NULL )
          {
             free ( esContext->userData );
@@ -136,7 +129,6 @@ extern int esMain ( ESContext *esContext );
 void android_main ( struct android_app *pApp )
 {
    ESContext esContext;
-   float lastTime;
 
    // Make sure glue isn't stripped.
    app_dummy();
@@ -146,11 +138,12 @@ void android_main ( struct android_app *pApp )
 
    esContext.platformData = ( void * ) pApp->activity->assetManager;
 
+   // the working directory is not writable, keep the program binaries with the app data
+   esSetProgramCacheDir ( pApp->activity->internalDataPath );
+
    pApp->onAppCmd = HandleCommand;
    pApp->userData = &esContext;
 
-   lastTime = GetCurrentTime();
-
    while ( 1 )
    {
       int ident;
@@ -177,20 +170,8 @@ void android_main ( struct android_app *pApp )
          continue;
       }
 
-      // Call app update function
-      if ( esContext.updateFunc != NULL )
-      {
-         float curTime = GetCurrentTime();
-         float deltaTime =  ( curTime - lastTime );
-         lastTime = curTime;
-         esContext.updateFunc ( &esContext, deltaTime );
-      }
-
-      if ( esContext.drawFunc != NULL )
-      {
-         esContext.drawFunc ( &esContext );
-         eglSwapBuffers ( esContext.eglDisplay, esContext.eglSurface );
-      }
+      // update, draw and swap once the frame is due
+      RunFrame ( &esContext );
    }
 }
 
@@ -41,6 +41,7 @@
 #include <windows.h>
 #include <stdlib.h>
 #include "esUtil.h"
+#include "esUtil_win.h"
 
 #ifdef _WIN64
 #define GWL_USERDATA GWLP_USERDATA
@@ -73,7 +74,7 @@ LRESULT WINAPI ESWindowProc ( HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam
          if ( esContext && esContext->drawFunc )
          {
             esContext->drawFunc ( esContext );
-            eglSwapBuffers ( esContext->eglDisplay, esContext->eglSurface );
+            esSwapBuffers ( esContext );
          }
 
 
@@ -191,14 +192,10 @@ void WinLoop ( ESContext *esContext )
 {
    MSG msg = { 0 };
    int done = 0;
-   DWORD lastTime = GetTickCount();
 
    while ( !done )
    {
       int gotMsg = ( PeekMessage ( &msg, NULL, 0, 0, PM_REMOVE ) != 0 );
-      DWORD curTime = GetTickCount();
-      float deltaTime = ( float ) ( curTime - lastTime ) / 1000.0f;
-      lastTime = curTime;
 
       if ( gotMsg )
       {
@@ -214,13 +211,8 @@ void WinLoop ( ESContext *esContext )
       }
       else
       {
-         SendMessage ( esContext->eglNativeWindow, WM_PAINT, 0, 0 );
-      }
-
-      // Call update function if registered
-      if ( esContext->updateFunc != NULL )
-      {
-         esContext->updateFunc ( esContext, deltaTime );
+         // update, draw and swap once the frame is due
+         RunFrame ( esContext );
       }
    }
 }
@@ -247,13 +239,28 @@ int main ( int argc, char *argv[] )
       return 1;
    }
 
-   WinLoop ( &esContext );
+   if ( BenchmarkRequested () )
+   {
+      BenchmarkLoop ( &esContext );
+   }
+   else if ( esContext.headless )
+   {
+      HeadlessLoop ( &esContext );
+   }
+   else
+   {
+      WinLoop ( &esContext );
+   }
+
+   FrameStatesDestroy ( &esContext );
 
    if ( esContext.shutdownFunc != NULL )
    {
       esContext.shutdownFunc ( &esContext );
    }
 
+   esShutdownJobPool ();
+
    if ( esContext.userData != NULL )
    {
       free ( esContext.userData );
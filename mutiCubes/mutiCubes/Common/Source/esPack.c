@@ -0,0 +1,380 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2013 Dan Ginsburg, Budirijanto Purnomo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+//
+// Book:      OpenGL(R) ES 3.0 Programming Guide, 2nd Edition
+// Authors:   Dan Ginsburg, Budirijanto Purnomo, Dave Shreiner, Aaftab Munshi
+// ISBN-10:   0-321-93388-5
+// ISBN-13:   978-0-321-93388-1
+// Publisher: Addison-Wesley Professional
+// URLs:      http://www.opengles-book.com
+//            http://my.safaribooksonline.com/book/animation-and-3d/9780133440133
+//
+//
+// ESPack.c
+//
+//    Asset packs written by the esPacker tool.  A pack is mapped once
+//    when it is mounted, esFileMap then finds the files in its hashed
+//    table of contents and hands out views of the pack instead of
+//    opening them one by one.  Entries compressed by the packer are
+//    inflated into their own buffer.
+//
+
+///
+//  Includes
+//
+#include <stdlib.h>
+#include <string.h>
+#include "esUtil.h"
+
+///
+//  Types
+//
+struct ESPack
+{
+   ESFileMap          map;
+   const ESPackEntry *slots;
+   const char        *names;
+   unsigned int       slotCount;
+   ESPack            *next;
+};
+
+///
+//  Variables
+//
+
+// mounted packs, the one mounted last first
+static ESPack *s_packs = NULL;
+
+///
+// Private Functions
+//
+
+///
+//  Hash()
+//
+//    FNV-1a, the esPacker tool hashes the names the same way
+//
+static unsigned int Hash ( const char *name, size_t length )
+{
+   unsigned int hash = 2166136261u;
+   size_t i;
+
+   for ( i = 0; i < length; i++ )
+   {
+      hash = ( hash ^ ( unsigned char ) name[i] ) * 16777619u;
+   }
+
+   return hash;
+}
+
+///
+//  Lz4Decompress()
+//
+//    Decode an LZ4 block, GL_FALSE unless it fills the destination exactly
+//
+static GLboolean Lz4Decompress ( const unsigned char *src, size_t srcSize, unsigned char *dst, size_t dstSize )
+{
+   const unsigned char *srcEnd = src + srcSize;
+   unsigned char *out = dst;
+   unsigned char *outEnd = dst + dstSize;
+
+   while ( src < srcEnd )
+   {
+      unsigned int token = *src++;
+      size_t length = token >> 4;
+      size_t offset;
+
+      // literals
+      if ( length == 15 )
+      {
+         unsigned int extra;
+
+         do
+         {
+            if ( src >= srcEnd )
+            {
+               return GL_FALSE;
+            }
+            extra = *src++;
+            length += extra;
+         }
+         while ( extra == 255 );
+      }
+
+      if ( length > ( size_t ) ( srcEnd - src ) || length > ( size_t ) ( outEnd - out ) )
+      {
+         return GL_FALSE;
+      }
+
+      memcpy ( out, src, length );
+      src += length;
+      out += length;
+
+      // the last sequence has no match
+      if ( src == srcEnd )
+      {
+         break;
+      }
+
+      if ( srcEnd - src < 2 )
+      {
+         return GL_FALSE;
+      }
+
+      offset = src[0] | ( src[1] << 8 );
+      src += 2;
+
+      if ( offset == 0 || offset > ( size_t ) ( out - dst ) )
+      {
+         return GL_FALSE;
+      }
+
+      // match, it may overlap the bytes it writes
+      length = token & 15;
+
+      if ( length == 15 )
+      {
+         unsigned int extra;
+
+         do
+         {
+            if ( src >= srcEnd )
+            {
+               return GL_FALSE;
+            }
+            extra = *src++;
+            length += extra;
+         }
+         while ( extra == 255 );
+      }
+
+      length += 4;
+
+      if ( length > ( size_t ) ( outEnd - out ) )
+      {
+         return GL_FALSE;
+      }
+
+      while ( length-- > 0 )
+      {
+         *out = *( out - offset );
+         out++;
+      }
+   }
+
+   return ( out == outEnd ) ? GL_TRUE : GL_FALSE;
+}
+
+///
+//  ValidPack()
+//
+//    Every slot and name has to lie in the file, the lookups read them
+//    without checking
+//
+static GLboolean ValidPack ( const ESFileMap *map )
+{
+   const ESPackHeader *header = ( const ESPackHeader * ) map->data;
+   const ESPackEntry *slots = ( const ESPackEntry * ) ( header + 1 );
+   const char *names;
+   unsigned int entryCount = 0;
+   unsigned int i;
+
+   if ( map->size < sizeof ( ESPackHeader ) ||
+         header->magic != ES_PACK_FILE_MAGIC || header->version != ES_PACK_FILE_VERSION ||
+         header->slotCount == 0 || ( header->slotCount & ( header->slotCount - 1 ) ) != 0 ||
+         header->entryCount >= header->slotCount ||
+         header->slotCount > ( map->size - sizeof ( ESPackHeader ) ) / sizeof ( ESPackEntry ) ||
+         header->namesOffset > map->size || header->namesSize > map->size - header->namesOffset )
+   {
+      return GL_FALSE;
+   }
+
+   names = ( const char * ) map->data + header->namesOffset;
+
+   for ( i = 0; i < header->slotCount; i++ )
+   {
+      const ESPackEntry *entry = &slots[i];
+
+      if ( entry->nameLength == 0 )
+      {
+         continue;
+      }
+
+      if ( entry->nameOffset >= header->namesSize || entry->nameLength >= header->namesSize - entry->nameOffset ||
+            names[entry->nameOffset + entry->nameLength] != '\0' ||
+            entry->offset > map->size || entry->size > map->size - entry->offset ||
+            ( !( entry->flags & ES_PACK_ENTRY_LZ4 ) && entry->size != entry->originalSize ) )
+      {
+         return GL_FALSE;
+      }
+
+      entryCount++;
+   }
+
+   return ( entryCount == header->entryCount ) ? GL_TRUE : GL_FALSE;
+}
+
+///
+//  FindEntry()
+//
+static const ESPackEntry *FindEntry ( const ESPack *pack, const char *fileName, size_t length, unsigned int hash )
+{
+   unsigned int mask = pack->slotCount - 1;
+   unsigned int slot = hash & mask;
+
+   // the pack always has an empty slot, which ends the probing
+   while ( pack->slots[slot].nameLength != 0 )
+   {
+      const ESPackEntry *entry = &pack->slots[slot];
+
+      if ( entry->hash == hash && entry->nameLength == length &&
+            memcmp ( pack->names + entry->nameOffset, fileName, length ) == 0 )
+      {
+         return entry;
+      }
+
+      slot = ( slot + 1 ) & mask;
+   }
+
+   return NULL;
+}
+
+///
+// Public Functions
+//
+
+///
+//  esPackMount()
+//
+ESPack *ESUTIL_API esPackMount ( void *ioContext, const char *fileName )
+{
+   ESPack *pack = ( ESPack * ) calloc ( 1, sizeof ( ESPack ) );
+   const ESPackHeader *header;
+
+   if ( pack == NULL )
+   {
+      return NULL;
+   }
+
+   // packs inside packs are not mounted, they would be unmapped with their parent
+   if ( !esFileMap ( ioContext, fileName, &pack->map ) || pack->map.packed )
+   {
+      esFileUnmap ( &pack->map );
+      free ( pack );
+      return NULL;
+   }
+
+   if ( !ValidPack ( &pack->map ) )
+   {
+      esLogMessage ( "esPackMount: %s is not an asset pack\n", fileName );
+      esFileUnmap ( &pack->map );
+      free ( pack );
+      return NULL;
+   }
+
+   header = ( const ESPackHeader * ) pack->map.data;
+   pack->slots = ( const ESPackEntry * ) ( header + 1 );
+   pack->names = ( const char * ) pack->map.data + header->namesOffset;
+   pack->slotCount = header->slotCount;
+   pack->next = s_packs;
+   s_packs = pack;
+
+   esLogMessage ( "esPackMount: %s, %u files\n", fileName, header->entryCount );
+   return pack;
+}
+
+///
+//  esPackUnmount()
+//
+void ESUTIL_API esPackUnmount ( ESPack *pack )
+{
+   ESPack **link = &s_packs;
+
+   if ( pack == NULL )
+   {
+      return;
+   }
+
+   while ( *link != NULL && *link != pack )
+   {
+      link = &( *link )->next;
+   }
+
+   if ( *link == pack )
+   {
+      *link = pack->next;
+   }
+
+   esFileUnmap ( &pack->map );
+   free ( pack );
+}
+
+///
+//  esPackMap()
+//
+GLboolean ESUTIL_API esPackMap ( const char *fileName, ESFileMap *map )
+{
+   size_t length = strlen ( fileName );
+   unsigned int hash = Hash ( fileName, length );
+   ESPack *pack;
+
+   memset ( map, 0, sizeof ( ESFileMap ) );
+
+   for ( pack = s_packs; pack != NULL; pack = pack->next )
+   {
+      const ESPackEntry *entry = FindEntry ( pack, fileName, length, hash );
+      unsigned char *buffer;
+
+      if ( entry == NULL )
+      {
+         continue;
+      }
+
+      map->packed = GL_TRUE;
+
+      // an empty file has no data, like on disk
+      if ( !( entry->flags & ES_PACK_ENTRY_LZ4 ) )
+      {
+         map->data = ( entry->size != 0 ) ? pack->map.data + entry->offset : NULL;
+         map->size = entry->size;
+         return GL_TRUE;
+      }
+
+      buffer = ( unsigned char * ) malloc ( entry->originalSize != 0 ? entry->originalSize : 1 );
+
+      if ( buffer == NULL || !Lz4Decompress ( pack->map.data + entry->offset, entry->size, buffer, entry->originalSize ) )
+      {
+         esLogMessage ( "esPackMap: %s is corrupt in its pack\n", fileName );
+         free ( buffer );
+         memset ( map, 0, sizeof ( ESFileMap ) );
+         return GL_FALSE;
+      }
+
+      map->data = ( entry->originalSize != 0 ) ? buffer : NULL;
+      map->size = entry->originalSize;
+      map->handle = buffer;
+      return GL_TRUE;
+   }
+
+   return GL_FALSE;
+}
@@ -0,0 +1,397 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2013 Dan Ginsburg, Budirijanto Purnomo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+//
+// Book:      OpenGL(R) ES 3.0 Programming Guide, 2nd Edition
+// Authors:   Dan Ginsburg, Budirijanto Purnomo, Dave Shreiner, Aaftab Munshi
+// ISBN-10:   0-321-93388-5
+// ISBN-13:   978-0-321-93388-1
+// Publisher: Addison-Wesley Professional
+// URLs:      http://www.opengles-book.com
+//            http://my.safaribooksonline.com/book/animation-and-3d/9780133440133
+//
+// ESState.c
+//
+//    Shadow of the GL state the samples change every frame: current program,
+//    bound VAO, texture bindings and uniform values.  Calls that would set
+//    what is already set are not passed to GL, and counted.
+//
+
+///
+//  Includes
+//
+#include <string.h>
+#include "esUtil.h"
+
+///
+//  Macros
+//
+#define ES_STATE_UNKNOWN          0xFFFFFFFF   // not a valid GL name, the state is unknown until set
+#define ES_STATE_TEXTURE_UNIT_MAX 16
+#define ES_STATE_PROGRAM_MAX      16           // programs with shadowed uniforms
+#define ES_STATE_UNIFORM_MAX      32           // locations below this are shadowed
+
+///
+//  Types
+//
+enum
+{
+   ES_TEXTURE_TARGET_2D = 0,
+   ES_TEXTURE_TARGET_2D_ARRAY,
+   ES_TEXTURE_TARGET_3D,
+   ES_TEXTURE_TARGET_CUBE_MAP,
+   ES_TEXTURE_TARGET_MAX
+};
+
+typedef struct
+{
+   GLenum  type;      // GL_INT or GL_FLOAT, 0 if not known
+   GLint   count;     // components
+   union
+   {
+      GLint   i[4];
+      GLfloat f[4];
+   } value;
+} ESUniformShadow;
+
+typedef struct
+{
+   GLuint          programObject;   // 0 for a free entry
+   ESUniformShadow uniforms[ES_STATE_UNIFORM_MAX];
+} ESProgramShadow;
+
+///
+//  Globals
+//
+static GLuint s_program = ES_STATE_UNKNOWN;
+static GLuint s_vertexArray = ES_STATE_UNKNOWN;
+static GLuint s_activeTexture = ES_STATE_UNKNOWN;
+static GLuint s_textures[ES_STATE_TEXTURE_UNIT_MAX][ES_TEXTURE_TARGET_MAX];
+static GLboolean s_texturesKnown = GL_FALSE;
+static ESProgramShadow s_programs[ES_STATE_PROGRAM_MAX];
+static ESProgramShadow *s_programShadow = NULL;   // shadow of s_program
+static int s_nextEvict = 0;
+static ESStateStats s_stats;
+
+//////////////////////////////////////////////////////////////////
+//
+//  Private Functions
+//
+//
+
+///
+//  TextureTargetIndex()
+//
+static int TextureTargetIndex ( GLenum target )
+{
+   switch ( target )
+   {
+      case GL_TEXTURE_2D:
+         return ES_TEXTURE_TARGET_2D;
+      case GL_TEXTURE_2D_ARRAY:
+         return ES_TEXTURE_TARGET_2D_ARRAY;
+      case GL_TEXTURE_3D:
+         return ES_TEXTURE_TARGET_3D;
+      case GL_TEXTURE_CUBE_MAP:
+         return ES_TEXTURE_TARGET_CUBE_MAP;
+      default:
+         return -1;
+   }
+}
+
+///
+//  ForgetTextures()
+//
+static void ForgetTextures ( void )
+{
+   int unit, target;
+
+   for ( unit = 0; unit < ES_STATE_TEXTURE_UNIT_MAX; unit++ )
+   {
+      for ( target = 0; target < ES_TEXTURE_TARGET_MAX; target++ )
+      {
+         s_textures[unit][target] = ES_STATE_UNKNOWN;
+      }
+   }
+   s_texturesKnown = GL_TRUE;
+}
+
+///
+//  FindProgramShadow()
+//
+//    Uniform shadow of a program, a new one evicts the oldest when all are in use
+//
+static ESProgramShadow *FindProgramShadow ( GLuint programObject )
+{
+   ESProgramShadow *shadow = NULL;
+   int i;
+
+   for ( i = 0; i < ES_STATE_PROGRAM_MAX; i++ )
+   {
+      if ( s_programs[i].programObject == programObject )
+      {
+         return &s_programs[i];
+      }
+      if ( shadow == NULL && s_programs[i].programObject == 0 )
+      {
+         shadow = &s_programs[i];
+      }
+   }
+
+   if ( shadow == NULL )
+   {
+      shadow = &s_programs[s_nextEvict];
+      s_nextEvict = ( s_nextEvict + 1 ) % ES_STATE_PROGRAM_MAX;
+   }
+
+   memset ( shadow, 0, sizeof ( ESProgramShadow ) );
+   shadow->programObject = programObject;
+   return shadow;
+}
+
+///
+//  UniformChanged()
+//
+//    Compare a uniform with its shadow and update the shadow, GL_TRUE if it must be set
+//
+static GLboolean UniformChanged ( GLint location, GLenum type, GLint count, const void *value )
+{
+   ESUniformShadow *uniform;
+
+   if ( s_programShadow == NULL || location < 0 || location >= ES_STATE_UNIFORM_MAX )
+   {
+      // no current program known, or not shadowed: set, and count as issued
+      s_stats.uniforms.issued++;
+      return GL_TRUE;
+   }
+
+   uniform = &s_programShadow->uniforms[location];
+   if ( uniform->type == type && uniform->count == count &&
+         memcmp ( &uniform->value, value, count * sizeof ( GLint ) ) == 0 )
+   {
+      s_stats.uniforms.elided++;
+      return GL_FALSE;
+   }
+
+   uniform->type = type;
+   uniform->count = count;
+   memcpy ( &uniform->value, value, count * sizeof ( GLint ) );
+   s_stats.uniforms.issued++;
+   return GL_TRUE;
+}
+
+//////////////////////////////////////////////////////////////////
+//
+//  Public Functions
+//
+//
+
+///
+//  esStateUseProgram()
+//
+void ESUTIL_API esStateUseProgram ( GLuint programObject )
+{
+   if ( programObject == s_program )
+   {
+      s_stats.programs.elided++;
+      return;
+   }
+
+   glUseProgram ( programObject );
+   s_program = programObject;
+   s_programShadow = ( programObject != 0 ) ? FindProgramShadow ( programObject ) : NULL;
+   s_stats.programs.issued++;
+}
+
+///
+//  esStateBindVertexArray()
+//
+void ESUTIL_API esStateBindVertexArray ( GLuint vertexArray )
+{
+   if ( vertexArray == s_vertexArray )
+   {
+      s_stats.vertexArrays.elided++;
+      return;
+   }
+
+   glBindVertexArray ( vertexArray );
+   s_vertexArray = vertexArray;
+   s_stats.vertexArrays.issued++;
+}
+
+///
+//  esStateBindTexture()
+//
+void ESUTIL_API esStateBindTexture ( GLuint unit, GLenum target, GLuint texture )
+{
+   int targetIdx = TextureTargetIndex ( target );
+
+   if ( !s_texturesKnown )
+   {
+      ForgetTextures ( );
+   }
+
+   if ( unit < ES_STATE_TEXTURE_UNIT_MAX && targetIdx >= 0 && s_textures[unit][targetIdx] == texture )
+   {
+      s_stats.textures.elided++;
+      return;
+   }
+
+   if ( unit != s_activeTexture )
+   {
+      glActiveTexture ( GL_TEXTURE0 + unit );
+      s_activeTexture = unit;
+      s_stats.textures.issued++;
+   }
+
+   glBindTexture ( target, texture );
+   if ( unit < ES_STATE_TEXTURE_UNIT_MAX && targetIdx >= 0 )
+   {
+      s_textures[unit][targetIdx] = texture;
+   }
+   s_stats.textures.issued++;
+}
+
+///
+//  esStateEditTexture()
+//
+//    A bind that is dropped leaves the active unit as it was, the
+//    texture calls that follow need the unit of the texture active
+//
+void ESUTIL_API esStateEditTexture ( GLuint unit, GLenum target, GLuint texture )
+{
+   esStateBindTexture ( unit, target, texture );
+
+   if ( unit != s_activeTexture )
+   {
+      glActiveTexture ( GL_TEXTURE0 + unit );
+      s_activeTexture = unit;
+      s_stats.textures.issued++;
+   }
+}
+
+///
+//  esStateUniform1i()
+//
+void ESUTIL_API esStateUniform1i ( GLint location, GLint v0 )
+{
+   if ( UniformChanged ( location, GL_INT, 1, &v0 ) )
+   {
+      glUniform1i ( location, v0 );
+   }
+}
+
+///
+//  esStateUniform1f()
+//
+void ESUTIL_API esStateUniform1f ( GLint location, GLfloat v0 )
+{
+   if ( UniformChanged ( location, GL_FLOAT, 1, &v0 ) )
+   {
+      glUniform1f ( location, v0 );
+   }
+}
+
+///
+//  esStateUniform3f()
+//
+void ESUTIL_API esStateUniform3f ( GLint location, GLfloat v0, GLfloat v1, GLfloat v2 )
+{
+   GLfloat value[3];
+
+   value[0] = v0;
+   value[1] = v1;
+   value[2] = v2;
+   if ( UniformChanged ( location, GL_FLOAT, 3, value ) )
+   {
+      glUniform3f ( location, v0, v1, v2 );
+   }
+}
+
+///
+//  esStateUniform4f()
+//
+void ESUTIL_API esStateUniform4f ( GLint location, GLfloat v0, GLfloat v1, GLfloat v2, GLfloat v3 )
+{
+   GLfloat value[4];
+
+   value[0] = v0;
+   value[1] = v1;
+   value[2] = v2;
+   value[3] = v3;
+   if ( UniformChanged ( location, GL_FLOAT, 4, value ) )
+   {
+      glUniform4f ( location, v0, v1, v2, v3 );
+   }
+}
+
+///
+//  esStateForgetProgram()
+//
+void ESUTIL_API esStateForgetProgram ( GLuint programObject )
+{
+   int i;
+
+   for ( i = 0; programObject != 0 && i < ES_STATE_PROGRAM_MAX; i++ )
+   {
+      if ( s_programs[i].programObject == programObject )
+      {
+         memset ( &s_programs[i], 0, sizeof ( ESProgramShadow ) );
+      }
+   }
+
+   // the name may come back for another program
+   if ( s_program == programObject )
+   {
+      s_program = ES_STATE_UNKNOWN;
+      s_programShadow = NULL;
+   }
+}
+
+///
+//  esStateInvalidate()
+//
+void ESUTIL_API esStateInvalidate ( void )
+{
+   s_program = ES_STATE_UNKNOWN;
+   s_programShadow = NULL;
+   s_vertexArray = ES_STATE_UNKNOWN;
+   s_activeTexture = ES_STATE_UNKNOWN;
+   s_texturesKnown = GL_FALSE;
+   memset ( s_programs, 0, sizeof ( s_programs ) );
+}
+
+///
+//  esStateGetStats()
+//
+void ESUTIL_API esStateGetStats ( ESStateStats *stats )
+{
+   *stats = s_stats;
+}
+
+///
+//  esStateResetStats()
+//
+void ESUTIL_API esStateResetStats ( void )
+{
+   memset ( &s_stats, 0, sizeof ( s_stats ) );
+}
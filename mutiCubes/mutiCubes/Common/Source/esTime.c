@@ -0,0 +1,127 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2013 Dan Ginsburg, Budirijanto Purnomo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+//
+// Book:      OpenGL(R) ES 3.0 Programming Guide, 2nd Edition
+// Authors:   Dan Ginsburg, Budirijanto Purnomo, Dave Shreiner, Aaftab Munshi
+// ISBN-10:   0-321-93388-5
+// ISBN-13:   978-0-321-93388-1
+// Publisher: Addison-Wesley Professional
+// URLs:      http://www.opengles-book.com
+//            http://my.safaribooksonline.com/book/animation-and-3d/9780133440133
+//
+// ESTime.c
+//
+//    Monotonic high resolution clock, not affected by changes of the
+//    system time.
+//
+
+///
+//  Includes
+//
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <mmsystem.h>
+#ifdef _MSC_VER
+#pragma comment ( lib, "winmm.lib" )
+#endif
+#else
+#include <time.h>
+#endif
+#include "esUtil.h"
+
+///
+//  Macros
+//
+// the sleep may overshoot by the scheduler period, the rest of the wait is spun
+#ifdef _WIN32
+#define ES_SPIN_TIME   0.002
+#else
+#define ES_SPIN_TIME   0.001
+#endif
+
+//////////////////////////////////////////////////////////////////
+//
+//  Public Functions
+//
+//
+
+///
+//  esGetTime()
+//
+//    Seconds since an unspecified point in the past
+//
+double ESUTIL_API esGetTime ( void )
+{
+#ifdef _WIN32
+   static LARGE_INTEGER frequency;
+   LARGE_INTEGER counter;
+
+   if ( frequency.QuadPart == 0 )
+   {
+      QueryPerformanceFrequency ( &frequency );
+   }
+   QueryPerformanceCounter ( &counter );
+   return ( double ) counter.QuadPart / ( double ) frequency.QuadPart;
+#else
+   struct timespec now;
+
+   clock_gettime ( CLOCK_MONOTONIC, &now );
+   return ( double ) now.tv_sec + ( double ) now.tv_nsec * 1e-9;
+#endif
+}
+
+///
+//  esWaitUntil()
+//
+void ESUTIL_API esWaitUntil ( double time )
+{
+   double wait = time - esGetTime ();
+
+   if ( wait > ES_SPIN_TIME )
+   {
+#ifdef _WIN32
+      static int periodSet = 0;
+
+      // Sleep() has a 15.6 ms resolution unless the timer period is lowered
+      if ( !periodSet )
+      {
+         timeBeginPeriod ( 1 );
+         periodSet = 1;
+      }
+      Sleep ( ( DWORD ) ( ( wait - ES_SPIN_TIME ) * 1000.0 ) );
+#else
+      struct timespec sleepTime;
+
+      wait -= ES_SPIN_TIME;
+      sleepTime.tv_sec = ( time_t ) wait;
+      sleepTime.tv_nsec = ( long ) ( ( wait - ( double ) sleepTime.tv_sec ) * 1e9 );
+      nanosleep ( &sleepTime, NULL );
+#endif
+   }
+
+   while ( esGetTime () < time )
+   {
+      // spin
+   }
+}
@@ -118,6 +118,8 @@ extern void esMain( ESContext *esContext );
     {
         _esContext.shutdownFunc( &_esContext );
     }
+
+    esShutdownJobPool();
 }
 
 
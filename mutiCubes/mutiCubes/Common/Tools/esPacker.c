@@ -0,0 +1,487 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2013 Dan Ginsburg, Budirijanto Purnomo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+//
+// Book:      OpenGL(R) ES 3.0 Programming Guide, 2nd Edition
+// Authors:   Dan Ginsburg, Budirijanto Purnomo, Dave Shreiner, Aaftab Munshi
+// ISBN-10:   0-321-93388-5
+// ISBN-13:   978-0-321-93388-1
+// Publisher: Addison-Wesley Professional
+// URLs:      http://www.opengles-book.com
+//            http://my.safaribooksonline.com/book/animation-and-3d/9780133440133
+//
+//
+// esPacker.c
+//
+//    Offline packer of the files a sample loads into the asset pack
+//    mounted by esPackMount, so that the sample maps one file instead of
+//    opening every image on its own.
+//
+//    esPacker [-z] output input...
+//       -z  store the files as LZ4 blocks when that saves an eighth of them
+//
+//    The files are found in the pack under the names they are given here,
+//    which have to be the names the sample opens: run the packer from the
+//    directory of the sample.  Compressed images gain little and are
+//    better stored, they are then mapped without a copy.
+//
+//    The header is written in the byte order of the host, which has to be
+//    little endian like the targets.
+//
+
+///
+//  Includes
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esUtil.h"
+
+///
+//  Macros
+//
+#define LZ4_HASH_BITS     12
+#define LZ4_MIN_MATCH     4
+#define LZ4_LAST_LITERALS 5      // the block ends with literals
+#define LZ4_MATCH_LIMIT   12     // no match starts in the last bytes
+#define LZ4_MAX_OFFSET    65535
+
+///
+//  Types
+//
+typedef struct
+{
+   char          *name;
+   unsigned char *data;
+   unsigned int   size;
+   unsigned int   originalSize;
+   unsigned int   flags;
+} Input;
+
+///
+//  Hash()
+//
+//    FNV-1a, like the lookups of esPack.c
+//
+static unsigned int Hash ( const char *name, size_t length )
+{
+   unsigned int hash = 2166136261u;
+   size_t i;
+
+   for ( i = 0; i < length; i++ )
+   {
+      hash = ( hash ^ ( unsigned char ) name[i] ) * 16777619u;
+   }
+
+   return hash;
+}
+
+///
+//  Read32()
+//
+static unsigned int Read32 ( const unsigned char *bytes )
+{
+   unsigned int value;
+
+   memcpy ( &value, bytes, sizeof ( value ) );
+   return value;
+}
+
+///
+//  WriteLength()
+//
+//    Length past the 15 of a token, in bytes of 255 and the remainder
+//
+static unsigned char *WriteLength ( unsigned char *out, size_t length )
+{
+   while ( length >= 255 )
+   {
+      *out++ = 255;
+      length -= 255;
+   }
+
+   *out++ = ( unsigned char ) length;
+   return out;
+}
+
+///
+//  WriteSequence()
+//
+//    Literals followed by a match, or the last literals when the match is empty
+//
+static unsigned char *WriteSequence ( unsigned char *out, const unsigned char *literals, size_t literalLength,
+                                      size_t offset, size_t matchLength )
+{
+   size_t matchCode = ( matchLength != 0 ) ? matchLength - LZ4_MIN_MATCH : 0;
+
+   *out++ = ( unsigned char ) ( ( ( literalLength < 15 ) ? literalLength : 15 ) << 4 |
+                                ( ( matchCode < 15 ) ? matchCode : 15 ) );
+
+   if ( literalLength >= 15 )
+   {
+      out = WriteLength ( out, literalLength - 15 );
+   }
+
+   memcpy ( out, literals, literalLength );
+   out += literalLength;
+
+   if ( matchLength != 0 )
+   {
+      *out++ = ( unsigned char ) offset;
+      *out++ = ( unsigned char ) ( offset >> 8 );
+
+      if ( matchCode >= 15 )
+      {
+         out = WriteLength ( out, matchCode - 15 );
+      }
+   }
+
+   return out;
+}
+
+///
+//  Lz4Compress()
+//
+//    Greedy LZ4 block with the last position of each hashed 4 bytes,
+//    dst holds size + size / 255 + 16 bytes
+//
+static size_t Lz4Compress ( const unsigned char *src, size_t size, unsigned char *dst )
+{
+   static size_t table[1 << LZ4_HASH_BITS];
+   unsigned char *out = dst;
+   size_t ip = 0, anchor = 0;
+
+   memset ( table, 0, sizeof ( table ) );
+
+   while ( size > LZ4_MATCH_LIMIT && ip < size - LZ4_MATCH_LIMIT )
+   {
+      unsigned int sequence = Read32 ( src + ip );
+      unsigned int hash = ( sequence * 2654435761u ) >> ( 32 - LZ4_HASH_BITS );
+      size_t ref = table[hash];
+
+      // positions are stored plus one, 0 is an empty entry
+      table[hash] = ip + 1;
+
+      if ( ref != 0 && ip - ( ref - 1 ) <= LZ4_MAX_OFFSET && Read32 ( src + ref - 1 ) == sequence )
+      {
+         size_t length = LZ4_MIN_MATCH;
+
+         ref--;
+         while ( ip + length < size - LZ4_LAST_LITERALS && src[ref + length] == src[ip + length] )
+         {
+            length++;
+         }
+
+         out = WriteSequence ( out, src + anchor, ip - anchor, ip - ref, length );
+         ip += length;
+         anchor = ip;
+      }
+      else
+      {
+         ip++;
+      }
+   }
+
+   out = WriteSequence ( out, src + anchor, size - anchor, 0, 0 );
+   return out - dst;
+}
+
+///
+//  ReadInput()
+//
+static int ReadInput ( const char *fileName, Input *input, int compress )
+{
+   FILE *fp = fopen ( fileName, "rb" );
+   long size;
+   char *c;
+
+   if ( fp == NULL )
+   {
+      fprintf ( stderr, "esPacker: cannot open %s\n", fileName );
+      return 0;
+   }
+
+   fseek ( fp, 0, SEEK_END );
+   size = ftell ( fp );
+   fseek ( fp, 0, SEEK_SET );
+
+   input->data = ( unsigned char * ) malloc ( size > 0 ? size : 1 );
+   if ( size < 0 || input->data == NULL || fread ( input->data, 1, size, fp ) != ( size_t ) size )
+   {
+      fprintf ( stderr, "esPacker: cannot read %s\n", fileName );
+      fclose ( fp );
+      return 0;
+   }
+
+   fclose ( fp );
+   input->size = ( unsigned int ) size;
+   input->originalSize = ( unsigned int ) size;
+
+   // the samples open the files with forward slashes and without "./"
+   while ( strncmp ( fileName, "./", 2 ) == 0 || strncmp ( fileName, ".\\", 2 ) == 0 )
+   {
+      fileName += 2;
+   }
+
+   input->name = ( char * ) malloc ( strlen ( fileName ) + 1 );
+   if ( input->name == NULL )
+   {
+      return 0;
+   }
+
+   strcpy ( input->name, fileName );
+   for ( c = input->name; *c != '\0'; c++ )
+   {
+      *c = ( *c == '\\' ) ? '/' : *c;
+   }
+
+   if ( compress && size > 0 )
+   {
+      unsigned char *packed = ( unsigned char * ) malloc ( size + size / 255 + 16 );
+      size_t packedSize;
+
+      if ( packed == NULL )
+      {
+         return 0;
+      }
+
+      packedSize = Lz4Compress ( input->data, size, packed );
+
+      if ( packedSize < ( size_t ) ( size - size / 8 ) )
+      {
+         free ( input->data );
+         input->data = packed;
+         input->size = ( unsigned int ) packedSize;
+         input->flags = ES_PACK_ENTRY_LZ4;
+      }
+      else
+      {
+         free ( packed );
+      }
+   }
+
+   return 1;
+}
+
+///
+//  WritePadding()
+//
+static int WritePadding ( FILE *fp, long offset )
+{
+   static const unsigned char zeros[64] = { 0 };
+
+   while ( ftell ( fp ) < offset )
+   {
+      long count = offset - ftell ( fp );
+
+      count = ( count > ( long ) sizeof ( zeros ) ) ? ( long ) sizeof ( zeros ) : count;
+      if ( fwrite ( zeros, 1, count, fp ) != ( size_t ) count )
+      {
+         return 0;
+      }
+   }
+
+   return 1;
+}
+
+///
+//  WritePack()
+//
+static int WritePack ( const char *fileName, const Input *inputs, unsigned int count )
+{
+   ESPackHeader header;
+   ESPackEntry *slots;
+   char *names;
+   unsigned int slotCount = 1;
+   unsigned int offset;
+   unsigned int i;
+   FILE *fp;
+   int ok;
+
+   // at most half full, the probing stays short and always meets an empty slot
+   while ( slotCount <= count * 2 )
+   {
+      slotCount *= 2;
+   }
+
+   memset ( &header, 0, sizeof ( ESPackHeader ) );
+   header.magic = ES_PACK_FILE_MAGIC;
+   header.version = ES_PACK_FILE_VERSION;
+   header.entryCount = count;
+   header.slotCount = slotCount;
+   header.namesOffset = sizeof ( ESPackHeader ) + slotCount * sizeof ( ESPackEntry );
+
+   for ( i = 0; i < count; i++ )
+   {
+      header.namesSize += ( unsigned int ) strlen ( inputs[i].name ) + 1;
+   }
+
+   slots = ( ESPackEntry * ) calloc ( slotCount, sizeof ( ESPackEntry ) );
+   names = ( char * ) malloc ( header.namesSize + 1 );
+
+   if ( slots == NULL || names == NULL )
+   {
+      free ( slots );
+      free ( names );
+      fprintf ( stderr, "esPacker: out of memory\n" );
+      return 0;
+   }
+
+   offset = header.namesOffset + header.namesSize;
+   header.namesSize = 0;
+
+   for ( i = 0; i < count; i++ )
+   {
+      unsigned int length = ( unsigned int ) strlen ( inputs[i].name );
+      unsigned int hash = Hash ( inputs[i].name, length );
+      unsigned int slot = hash & ( slotCount - 1 );
+      ESPackEntry *entry;
+
+      while ( slots[slot].nameLength != 0 )
+      {
+         if ( slots[slot].nameLength == length && memcmp ( names + slots[slot].nameOffset, inputs[i].name, length ) == 0 )
+         {
+            fprintf ( stderr, "esPacker: %s is given twice\n", inputs[i].name );
+            free ( slots );
+            free ( names );
+            return 0;
+         }
+         slot = ( slot + 1 ) & ( slotCount - 1 );
+      }
+
+      entry = &slots[slot];
+      entry->hash = hash;
+      entry->nameOffset = header.namesSize;
+      entry->nameLength = length;
+      entry->flags = inputs[i].flags;
+      entry->offset = ( offset + ES_PACK_FILE_ALIGN - 1 ) / ES_PACK_FILE_ALIGN * ES_PACK_FILE_ALIGN;
+      entry->size = inputs[i].size;
+      entry->originalSize = inputs[i].originalSize;
+
+      memcpy ( names + header.namesSize, inputs[i].name, length + 1 );
+      header.namesSize += length + 1;
+      offset = entry->offset + entry->size;
+   }
+
+   fp = fopen ( fileName, "wb" );
+   if ( fp == NULL )
+   {
+      fprintf ( stderr, "esPacker: cannot create %s\n", fileName );
+      free ( slots );
+      free ( names );
+      return 0;
+   }
+
+   ok = ( fwrite ( &header, sizeof ( ESPackHeader ), 1, fp ) == 1 ) &&
+        ( fwrite ( slots, sizeof ( ESPackEntry ), slotCount, fp ) == slotCount ) &&
+        ( fwrite ( names, 1, header.namesSize, fp ) == header.namesSize );
+
+   // the entries in the order they were given, a sample reading them in that order reads the pack forward
+   for ( i = 0; ok && i < count; i++ )
+   {
+      unsigned int length = ( unsigned int ) strlen ( inputs[i].name );
+      unsigned int slot = Hash ( inputs[i].name, length ) & ( slotCount - 1 );
+
+      while ( slots[slot].nameLength != length || memcmp ( names + slots[slot].nameOffset, inputs[i].name, length ) != 0 )
+      {
+         slot = ( slot + 1 ) & ( slotCount - 1 );
+      }
+
+      ok = WritePadding ( fp, slots[slot].offset ) &&
+           ( fwrite ( inputs[i].data, 1, inputs[i].size, fp ) == inputs[i].size );
+   }
+
+   free ( slots );
+   free ( names );
+
+   if ( fclose ( fp ) != 0 || !ok )
+   {
+      fprintf ( stderr, "esPacker: cannot write %s\n", fileName );
+      remove ( fileName );
+      return 0;
+   }
+
+   return 1;
+}
+
+int main ( int argc, char *argv[] )
+{
+   Input *inputs;
+   const char *output = NULL;
+   unsigned int count = 0;
+   unsigned int original = 0, stored = 0;
+   unsigned int i;
+   int compress = 0;
+   int arg, ok = 1;
+
+   inputs = ( Input * ) calloc ( argc, sizeof ( Input ) );
+   if ( inputs == NULL )
+   {
+      return 1;
+   }
+
+   for ( arg = 1; ok && arg < argc; arg++ )
+   {
+      if ( strcmp ( argv[arg], "-z" ) == 0 )
+      {
+         compress = 1;
+      }
+      else if ( output == NULL )
+      {
+         output = argv[arg];
+      }
+      else
+      {
+         ok = ReadInput ( argv[arg], &inputs[count++], compress );
+      }
+   }
+
+   if ( output == NULL || count == 0 )
+   {
+      fprintf ( stderr, "usage: esPacker [-z] output input...\n" );
+      free ( inputs );
+      return 1;
+   }
+
+   ok = ok && WritePack ( output, inputs, count );
+
+   for ( i = 0; i < count; i++ )
+   {
+      if ( ok )
+      {
+         printf ( "   %s: %u bytes%s\n", inputs[i].name, inputs[i].size,
+                  ( inputs[i].flags & ES_PACK_ENTRY_LZ4 ) ? ", LZ4" : "" );
+      }
+      original += inputs[i].originalSize;
+      stored += inputs[i].size;
+      free ( inputs[i].name );
+      free ( inputs[i].data );
+   }
+
+   if ( ok )
+   {
+      printf ( "%s: %u files, %u bytes stored of %u\n", output, count, stored, original );
+   }
+
+   free ( inputs );
+   return ok ? 0 : 1;
+}
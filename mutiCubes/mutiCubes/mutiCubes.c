@@ -35,13 +35,158 @@
 //    using a vertex shader to transform the object
 //
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include "esUtil.h"
-#define STB_IMAGE_IMPLEMENTATION
-#include "stb_image.h"
 
 #define PI 3.1415926535897932384626433832795f
 
+#define INSTANCED_DRAW_ENABLE   (1) // if enable all cubes of one program are drawn by one glDrawElementsInstanced
+#define CUBE_NUM                (10)
+#define UPDATE_THREAD_ENABLE    (1) // if enable Update() runs on its own thread and Draw() reads the finished frame states
+#define TEXTURE_STREAM_ENABLE   (1) // if enable Init() does not wait for the textures, Draw() uploads them as they are decoded
+#define TEXTURE_UPLOAD_BUDGET   (0.002) // seconds per frame Draw() may spend uploading textures
+#define ASSET_PACK_FILE         "assets.espak" // made by esPacker, the loose files are read when it is missing
+
+typedef enum
+{
+	MATERIAL_BOX = 0,    // container texture + face colors, drawn by programObject
+	MATERIAL_GRASS,      // bricks and grass texture, drawn by grassProgramObject
+	MATERIAL_MAX
+}enMATERIAL;
+
+// per-instance vertex data that never changes, one record per cube, attribute divisor is 1
+typedef struct
+{
+	GLfloat  rotateAxis[3];  // attribute location 8.xyz
+	GLfloat  material;       // attribute location 8.w
+}stCubeInstance;
+
+// per-instance vertex data that changes every frame, lives in its own VBO
+typedef struct
+{
+	ESMatrix  modelMatrix;   // attribute location 4 ~ 7
+	ESMatrix3 normalMatrix;  // attribute location 9 ~ 11, computed on the CPU instead of per vertex
+}stCubeTransform;
+
+typedef enum
+{
+	INSTANCE_VBO_MODEL = 0,  // stCubeTransform, rebuilt in place every frame
+	INSTANCE_VBO_PARAM,      // stCubeInstance, written once
+	INSTANCE_VBO_MAX
+}enINSTANCE_VBO;
+
+#define CAMERA_BLOCK_BINDING    (0) // uniform buffer binding point of CameraBlock
+#define LIGHT_BLOCK_BINDING     (1) // uniform buffer binding point of LightBlock
+#define LIGHT_MAX               (4) // size of the light array in LightBlock, only lightNum of them are lit
+#define TO_STR_(x)              #x
+#define TO_STR(x)               TO_STR_(x)
+
+// per-frame camera, computed once in Update() and shared by every object,
+// the layout matches the std140 CameraBlock in the shaders
+typedef struct
+{
+	ESMatrix view;
+	ESMatrix projection;
+	ESMatrix viewProjection;
+	GLfloat  eyePos[4];      // w is unused, keeps the vec4 alignment of std140
+}stCamera;
+
+#define CAMERA_BLOCK_STR \
+	"layout(std140) uniform CameraBlock                                         \n" \
+	"{                                                                                              \n" \
+	"	mat4 u_viewMatrix;                                                                \n" \
+	"	mat4 u_projMatrix;                                                                  \n" \
+	"	mat4 u_vpMatrix;                                                                     \n" \
+	"	vec4 u_eyePos;                                                                        \n" \
+	"};                                                                                             \n"
+
+// one point light, the layout matches the std140 Light in the shaders
+typedef struct
+{
+	GLfloat position[4];     // w is unused
+	GLfloat color[4];        // w is unused
+}stLight;
+
+// all the lights of a frame, shared by the cube programs through one uniform buffer,
+// the light count is padded to 16 bytes since std140 aligns the array of structs to a vec4
+typedef struct
+{
+	GLint    lightNum;
+	GLint    pad[3];
+	stLight  lights[LIGHT_MAX];
+}stLightBlock;
+
+#define LIGHT_BLOCK_STR \
+	"struct Light                                                                                 \n" \
+	"{                                                                                              \n" \
+	"	vec4 position;                                                                          \n" \
+	"	vec4 color;                                                                               \n" \
+	"};                                                                                             \n" \
+	"layout(std140) uniform LightBlock                                              \n" \
+	"{                                                                                              \n" \
+	"	int u_lightNum;                                                                         \n" \
+	"	Light u_lights[" TO_STR(LIGHT_MAX) "];                                     \n" \
+	"};                                                                                             \n"
+
+// everything Update() computes for a frame, Draw() only reads it,
+// with the update thread Draw() reads a finished copy while the next one is computed
+typedef struct
+{
+	// Rotation angle
+	GLfloat   angle;
+
+	// eyeZ moves between 0 and 10
+	GLfloat   eyeZ;
+	GLfloat   eyeDelta;
+	stCamera  camera;
+	stLightBlock lights;
+
+#if INSTANCED_DRAW_ENABLE
+	// model and normal matrix of every instance, copied to the instance VBO by Draw()
+	stCubeTransform transforms[CUBE_NUM];
+#else
+	// model, MVP and normal matrix of every cube, computed in one pass by Update()
+	ESMatrix  mvMatrices[CUBE_NUM];
+	ESMatrix  mvpMatrices[CUBE_NUM];
+	ESMatrix3 normalMatrices[CUBE_NUM];
+#endif
+
+	ESMatrix  lightMvpMatrix;
+}stFrameState;
+
+static const GLfloat s_cubePositions[CUBE_NUM * 3] = {
+	0.0f,  0.0f,  0.0f,
+	2.0f,  5.0f, -15.0f,
+	-1.5f, -2.2f, -2.5f,
+	-3.8f, -2.0f, -12.3f,
+	2.4f, -0.4f, -3.5f,
+	-1.7f,  3.0f, -7.5f,
+	1.3f, -2.0f, -2.5f,
+	1.5f,  2.0f, -2.5f,
+	0.0f,  0.0f, -2.0f,
+	-1.3f,  1.0f, -1.5f
+};
+
+static const GLfloat s_cubeRoateDir[CUBE_NUM * 3] = {
+	1.0f, 1.0f, 1.0f,
+	1.0f, 0.0f, 1.0f,
+	0.0f, 1.0f, 1.0f,
+	1.0f, 1.0f, 0.0f,
+	0.0f, 0.0f, 1.0f,
+	1.0f, 0.0f, 0.0f,
+	0.0f, 1.0f, 0.0f,
+	1.0f, 1.0f, 1.0f,
+	1.0f, 0.0f, 1.0f,
+	0.0f, 1.0f, 1.0f
+};
+
+// cube 0 ~ 4 are grass boxes, cube 5 ~ 9 are containers
+static const enMATERIAL s_cubeMaterials[CUBE_NUM] = {
+	MATERIAL_GRASS, MATERIAL_GRASS, MATERIAL_GRASS, MATERIAL_GRASS, MATERIAL_GRASS,
+	MATERIAL_BOX, MATERIAL_BOX, MATERIAL_BOX, MATERIAL_BOX, MATERIAL_BOX
+};
+
 typedef struct
 {
 	// Handle to a program object
@@ -50,22 +195,30 @@ typedef struct
 	// Uniform locations
 	GLint  mvpLoc;
 	GLint  mvLoc;
+	GLint  normalMatrixLoc;
+	GLint  grassMvpLoc;
+	GLint  grassMvLoc;
+	GLint  grassNormalMatrixLoc;
 
 	// Vertex daata
 	GLfloat  *vertices;
 	GLuint   *indices;
 	int       numIndices;
 
-	// Rotation angle
-	GLfloat   angle;
-
-	// MVP matrix
-	ESMatrix  mvpMatrix;
-	ESMatrix  mvMatrix;
+	// cube positions and rotation axes in structure-of-arrays layout for esMatrixBuildTRSBatch,
+	// in instance order when instanced draw is enabled, in cube order otherwise
+	GLfloat   cubePos[3][CUBE_NUM];
+	GLfloat   cubeAxis[3][CUBE_NUM];
+	ESTRSArrays cubeTransforms;
 
 	GLint textureID;
 	GLint textureIdGrass;
 	GLint textureIdBricks;
+
+	// the textures are decoded on the job pool, the loader is freed once all are uploaded
+	ESTextureLoader  *textureLoader;
+	ESTextureRequest textureRequests[3];
+	ESPack           *assetPack;
 	GLint samplerLoc;
 	GLint samplerLocGrass;
 	GLint samplerLocBricks;
@@ -76,58 +229,273 @@ typedef struct
 	// light source define
 	GLuint lightProgramObject;
 	GLint  lightMvpLoc;
-	ESMatrix  lightMvpMatrix;
 	GLuint lightVboIDs[2];
 	GLuint lightVaoID;
-	GLuint lightPosLoc;
-	GLuint lightColorLoc;
-	GLuint eyePosLoc;
+
+	// camera and light uniform buffers, their contents are part of the frame state
+	GLuint   cameraUboID;
+	GLuint   lightUboID;
 
 	GLuint grassProgramObject;
+
+#if INSTANCED_DRAW_ENABLE
+	// instanced draw, instances are sorted by material so each program draws a continuous range
+	GLuint instanceVboIDs[INSTANCE_VBO_MAX]; // per-instance VBOs
+	GLuint instanceVaoIDs[MATERIAL_MAX];     // VAO of each material, instance attributes start at its first instance
+	GLuint instanceCubeIdx[CUBE_NUM];        // instance index -> cube index
+	GLuint firstInstance[MATERIAL_MAX];
+	GLuint instanceNum[MATERIAL_MAX];
+	stCubeInstance instances[CUBE_NUM];
+#endif
 } UserData;
 
-GLint loadTexture(const char* name)
+///
+// Compute view, projection and view-projection matrices once per frame,
+// every object shares them instead of rebuilding its own
+//
+void cameraUpdate(ESContext *esContext, stFrameState *pState)
 {
-	unsigned int texture;
-	glGenTextures(1, &texture);
+	stCamera *pCamera = &pState->camera;
+	float    aspect;
 
-	int width, height, nrChannels;
-	unsigned char *data = stbi_load(name, &width, &height, &nrChannels, 0);
-	GLint format = GL_RGB;
-	if (data)
-	{
-		switch (nrChannels) {
-		case 1:
-			format = GL_RED;
-			break;
-		case 3:
-			format = GL_RGB;
-			break;
-		case 4:
-			format = GL_RGBA;
-			break;
-		default:
-			break;
+	// Compute the window aspect ratio
+	aspect = (GLfloat)esContext->width / (GLfloat)esContext->height;
+
+	// Generate a perspective matrix with a 60 degree FOV
+	esMatrixLoadIdentity(&pCamera->projection);
+	esPerspective(&pCamera->projection, 60.0f, aspect, 1.0f, 100.0f);
+
+	pCamera->eyePos[0] = 0.0f;
+	pCamera->eyePos[1] = 0.0f;
+	pCamera->eyePos[2] = pState->eyeZ;
+	pCamera->eyePos[3] = 1.0f;
+	//pCamera->eyePos[0] = 6.0f * cosf(pState->angle * PI / 180.0f);
+	//pCamera->eyePos[1] = 6.0f * sinf(pState->angle * PI / 180.0f);
+	//pCamera->eyePos[2] = 10.0f;
+
+	esMatrixLookAt(&pCamera->view,
+		pCamera->eyePos[0], pCamera->eyePos[1], pCamera->eyePos[2],    // eye position
+		0.0f, 0.0f, 0.0f,    // eye look at location
+		0.0f, 1.0f, 0.0f);   // up direction vec
+
+	esMatrixMultiply(&pCamera->viewProjection, &pCamera->view, &pCamera->projection);
+}
+
+///
+// Fill the structure-of-arrays transforms from the cube tables,
+// order[i] is the cube stored at index i
+//
+void cubeTransformsInit(UserData *userData, const GLuint *order)
+{
+	GLuint i = 0;
+	for (i = 0; i < CUBE_NUM; i++) {
+		GLuint axis = 0;
+		for (axis = 0; axis < 3; axis++) {
+			userData->cubePos[axis][i] = s_cubePositions[3 * order[i] + axis];
+			userData->cubeAxis[axis][i] = s_cubeRoateDir[3 * order[i] + axis];
 		}
+	}
 
-		esLogMessage("%s: nrChannels = %d\n", name, nrChannels);
+	memset(&userData->cubeTransforms, 0, sizeof(ESTRSArrays));
+	userData->cubeTransforms.posX = userData->cubePos[0];
+	userData->cubeTransforms.posY = userData->cubePos[1];
+	userData->cubeTransforms.posZ = userData->cubePos[2];
+	userData->cubeTransforms.axisX = userData->cubeAxis[0];
+	userData->cubeTransforms.axisY = userData->cubeAxis[1];
+	userData->cubeTransforms.axisZ = userData->cubeAxis[2];
+}
 
-		glBindTexture(GL_TEXTURE_2D, texture);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, (format == GL_RGBA) ? GL_CLAMP_TO_EDGE : GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, (format == GL_RGBA) ? GL_CLAMP_TO_EDGE : GL_REPEAT);
+///
+// Attach a uniform block of a program to a binding point, a block the program does not use is skipped
+//
+void bindUniformBlock(GLuint program, const char *blockName, GLuint binding)
+{
+	GLuint blockIdx = glGetUniformBlockIndex(program, blockName);
+	if (blockIdx != GL_INVALID_INDEX) {
+		glUniformBlockBinding(program, blockIdx, binding);
+	}
+}
 
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+#if INSTANCED_DRAW_ENABLE
+///
+// Create the per-instance VBO and one VAO per material, cubes are sorted by material
+// so that every program draws its cubes with a single glDrawElementsInstanced
+//
+void createInstanceVAOs(UserData *userData)
+{
+	GLuint material = MATERIAL_BOX;
+	GLuint instance = 0;
+	for (material = MATERIAL_BOX; material < MATERIAL_MAX; material++) {
+		userData->firstInstance[material] = instance;
+		GLuint i = 0;
+		for (i = 0; i < CUBE_NUM; i++) {
+			if (s_cubeMaterials[i] != material) continue;
+			stCubeInstance *pInstance = &userData->instances[instance];
+			pInstance->rotateAxis[0] = s_cubeRoateDir[3 * i];
+			pInstance->rotateAxis[1] = s_cubeRoateDir[3 * i + 1];
+			pInstance->rotateAxis[2] = s_cubeRoateDir[3 * i + 2];
+			pInstance->material = (GLfloat)material;
+			userData->instanceCubeIdx[instance] = i;
+			instance++;
+		}
+		userData->instanceNum[material] = instance - userData->firstInstance[material];
+	}
+
+	glGenBuffers(INSTANCE_VBO_MAX, userData->instanceVboIDs);
+	glBindBuffer(GL_ARRAY_BUFFER, userData->instanceVboIDs[INSTANCE_VBO_MODEL]);
+	glBufferData(GL_ARRAY_BUFFER, CUBE_NUM * sizeof(stCubeTransform), NULL, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, userData->instanceVboIDs[INSTANCE_VBO_PARAM]);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(userData->instances), userData->instances, GL_STATIC_DRAW);
+
+	glGenVertexArrays(MATERIAL_MAX, userData->instanceVaoIDs);
+	for (material = MATERIAL_BOX; material < MATERIAL_MAX; material++) {
+		glBindVertexArray(userData->instanceVaoIDs[material]);
+
+		// per-vertex data is shared with the cube VAO
+		glBindBuffer(GL_ARRAY_BUFFER, userData->vboIDs[0]);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (const void*)0);
+		glBindBuffer(GL_ARRAY_BUFFER, userData->vboIDs[1]);
+		glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), (const void*)0);
+		glBindBuffer(GL_ARRAY_BUFFER, userData->vboIDs[2]);
+		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), (const void*)0);
+		glBindBuffer(GL_ARRAY_BUFFER, userData->vboIDs[4]);
+		glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (const void*)0);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, userData->vboIDs[3]);
+
+		GLint attr = 0;
+		for (attr = 0; attr < 4; attr++) {
+			glEnableVertexAttribArray(attr);
+		}
 
-		glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-		glGenerateMipmap(GL_TEXTURE_2D);
+		// per-instance data, a mat4 attribute takes 4 locations and a mat3 3 locations (one column each)
+		const GLubyte *base = (const GLubyte*)0 + userData->firstInstance[material] * sizeof(stCubeTransform);
+		glBindBuffer(GL_ARRAY_BUFFER, userData->instanceVboIDs[INSTANCE_VBO_MODEL]);
+		for (attr = 0; attr < 4; attr++) {
+			glVertexAttribPointer(4 + attr, 4, GL_FLOAT, GL_FALSE, sizeof(stCubeTransform), base + attr * 4 * sizeof(GLfloat));
+			glVertexAttribDivisor(4 + attr, 1);
+			glEnableVertexAttribArray(4 + attr);
+		}
+		for (attr = 0; attr < 3; attr++) {
+			glVertexAttribPointer(9 + attr, 3, GL_FLOAT, GL_FALSE, sizeof(stCubeTransform),
+				base + sizeof(ESMatrix) + attr * 3 * sizeof(GLfloat));
+			glVertexAttribDivisor(9 + attr, 1);
+			glEnableVertexAttribArray(9 + attr);
+		}
+		base = (const GLubyte*)0 + userData->firstInstance[material] * sizeof(stCubeInstance);
+		glBindBuffer(GL_ARRAY_BUFFER, userData->instanceVboIDs[INSTANCE_VBO_PARAM]);
+		glVertexAttribPointer(8, 4, GL_FLOAT, GL_FALSE, sizeof(stCubeInstance), base);
+		glVertexAttribDivisor(8, 1);
+		glEnableVertexAttribArray(8);
 	}
-	else
-	{
-		esLogMessage("Failed to load texture\n");
+
+	// Reset to the default VAO
+	glBindVertexArray(0);
+}
+
+///
+// Build the model and normal matrix of every instance
+//
+void instanceModelSet(ESContext *esContext, stFrameState *pState)
+{
+	UserData *userData = esContext->userData;
+
+	// Translate away from the viewer and rotate the cube
+	userData->cubeTransforms.defaultAngle = pState->angle;
+	esMatrixBuildTRSBatch(&pState->transforms->modelMatrix, sizeof(stCubeTransform), &userData->cubeTransforms, CUBE_NUM);
+
+	// The cubes are only rotated and translated, so the rigid fast path is enough
+	esMatrixNormalMatrixBatch(&pState->transforms->normalMatrix, sizeof(stCubeTransform),
+		&pState->transforms->modelMatrix, sizeof(stCubeTransform), CUBE_NUM, GL_TRUE);
+}
+
+///
+// Copy the instance matrices of the frame state into the mapped instance VBO,
+// the whole buffer is invalidated so the driver does not wait for the previous frame
+//
+void instanceModelUpload(ESContext *esContext, const stFrameState *pState)
+{
+	UserData *userData = esContext->userData;
+	stCubeTransform *transforms = NULL;
+
+	glBindBuffer(GL_ARRAY_BUFFER, userData->instanceVboIDs[INSTANCE_VBO_MODEL]);
+	transforms = (stCubeTransform *)glMapBufferRange(GL_ARRAY_BUFFER, 0, CUBE_NUM * sizeof(stCubeTransform),
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	if (transforms == NULL) {
+		esLogMessage("instanceModelUpload: map instance VBO failed\n");
+		return;
 	}
-	stbi_image_free(data);
-	return texture;
+
+	memcpy(transforms, pState->transforms, CUBE_NUM * sizeof(stCubeTransform));
+
+	glUnmapBuffer(GL_ARRAY_BUFFER);
+}
+#else
+///
+// Compute the model and MVP matrices of all the cubes in one pass
+//
+void objectMvpSet(ESContext *esContext, stFrameState *pState)
+{
+	UserData *userData = esContext->userData;
+
+	// Generate the model matrices to rotate/translate the cubes
+	userData->cubeTransforms.defaultAngle = pState->angle;
+	esMatrixBuildTRSBatch(pState->mvMatrices, 0, &userData->cubeTransforms, CUBE_NUM);
+
+	// Compute the final MVPs by multiplying the
+	// model and view-projection matrices together
+	esMatrixMultiplyBatch(pState->mvpMatrices, 0, pState->mvMatrices, 0, &pState->camera.viewProjection, CUBE_NUM);
+
+	// The cubes are only rotated and translated, so the rigid fast path is enough
+	esMatrixNormalMatrixBatch(pState->normalMatrices, 0, pState->mvMatrices, 0, CUBE_NUM, GL_TRUE);
+}
+#endif
+
+void lightMvpSet(stFrameState *pState)
+{
+	const stLight *pLight = &pState->lights.lights[0];
+	ESMatrix model;
+
+	// Generate a model matrix to translate the light cube to the first light
+	esMatrixLoadIdentity(&model);
+	esTranslate(&model, pLight->position[0], pLight->position[1], pLight->position[2]);
+
+	// Compute the final MVP by multiplying the
+	// model and view-projection matrices together
+	esMatrixMultiply(&pState->lightMvpMatrix, &model, &pState->camera.viewProjection);
+}
+
+///
+// Place the lights of a frame, a white light on the upper right of the cubes
+//
+void lightSet(stFrameState *pState)
+{
+	stLight *pLight = &pState->lights.lights[0];
+
+	pState->lights.lightNum = 1;
+	pLight->position[0] = 6.0f;
+	pLight->position[1] = 6.0f;
+	pLight->position[2] = -1.0f;
+	//pLight->position[0] = 6.0f * cosf(pState->angle * PI / 180.0f);
+	//pLight->position[2] = 6.0f * sinf(pState->angle * PI / 180.0f);
+	pLight->color[0] = 1.0f;
+	pLight->color[1] = 1.0f;
+	pLight->color[2] = 1.0f;
+}
+
+///
+// Compute the camera and all the matrices of a frame state from its angle and eye position,
+// no GL calls so it can run on the update thread
+//
+void frameStateCompute(ESContext *esContext, stFrameState *pState)
+{
+	cameraUpdate(esContext, pState);
+#if INSTANCED_DRAW_ENABLE
+	instanceModelSet(esContext, pState);
+#else
+	objectMvpSet(esContext, pState);
+#endif
+	lightSet(pState);
+	lightMvpSet(pState);
 }
 
 ///
@@ -136,10 +504,17 @@ GLint loadTexture(const char* name)
 int Init(ESContext *esContext)
 {
 	UserData *userData = esContext->userData;
+	// shader chunks, the version line and the feature defines are added by esAcquireProgramVariant
 	const char vShaderStr[] =
-		"#version 300 es                                                                          \n"
+		"#ifdef INSTANCED_DRAW                                                               \n"
+		"layout(location = 4) in mat4 a_modelMatrix; // 每个实例的模型矩阵    \n"
+		"layout(location = 8) in vec4 a_instanceParam; // xyz: 旋转轴, w: 材质   \n"
+		"layout(location = 9) in mat3 a_normalMatrix; // CPU算好的法向量矩阵  \n"
+		"#else                                                                                          \n"
 		"uniform mat4 u_mvMatrix;               					          \n"
 		"uniform mat4 u_mvpMatrix;                                                         \n"
+		"uniform mat3 u_normalMatrix; // CPU算好的法向量矩阵                 \n"
+		"#endif                                                                                         \n"
 		"layout(location = 0) in vec4 a_position; // 立方体各个定点的坐标       \n"
 		"layout(location = 1) in vec4 a_color;   // 立方体各个面的颜色            \n"
 		"layout(location = 2) in vec2 vTexCoord; // 各个点对应的纹理坐标      \n"
@@ -151,86 +526,83 @@ int Init(ESContext *esContext)
 		"void main()                                                                                 \n"
 		"{                                                                                                \n"
 		"	v_color = a_color;                 						          \n"
+		"#ifdef INSTANCED_DRAW                                                               \n"
+		"	vec4 worldPos = a_modelMatrix * a_position;                            \n"
+		"	fragPos = vec3(worldPos);                                                        \n"
+		"	gl_Position = u_vpMatrix * worldPos;                                       \n"
+		"	v_texCoord = vTexCoord;                                                      \n"
+		"	v_normal = a_normalMatrix * vNormal;                                      \n"
+		"#else                                                                                          \n"
 		"	fragPos = vec3(u_mvMatrix * a_position);                              \n"
 		"	gl_Position = u_mvpMatrix * a_position;                                \n"
 		"	v_texCoord = vTexCoord;                                                      \n"
 		"	//v_normal = vec3(u_mvMatrix * vec4(vNormal, 0.0f)); // 矩形转动，法向量也要变化  \n"
-		"	v_normal = mat3(transpose(inverse(u_mvMatrix))) * vNormal;      \n"
+		"	v_normal = u_normalMatrix * vNormal;                                      \n"
+		"#endif                                                                                         \n"
 		"}                                           \n";
 
-	const char fShaderStr[] =
-		"#version 300 es												\n"
+	// declarations of both cube shaders, the grass variant samples two textures
+	const char fShaderHeadStr[] =
 		"precision mediump float;										\n"
 		"in vec4 v_color;												\n"
 		"in vec2 v_texCoord;											\n"
 		"in vec3 v_normal;								              			\n"
 		"in vec3 fragPos;                                                                                       \n"
 		"layout(location = 0) out vec4 outColor;					           	        \n"
+		"#ifdef GRASS                                                                                          \n"
+		"uniform sampler2D s_texture_bricks;	// 贴图2-砖头					\n"
+		"uniform sampler2D s_texture_grass;	// 贴图2-草					\n"
+		"#else                                                                                                   \n"
 		"uniform sampler2D s_texture;		// 贴图1-箱子					 \n"
-		"uniform vec3 lightPos;       // 光源位置                                                        \n"
-		"uniform vec3 lightColor;     // 光源颜色                                                       \n"
-		"uniform vec3 eyePos;     //  眼睛位置                                                          \n"
-		"void main()												        \n"
+		"#endif                                                                                                  \n";
+
+	// the lighting shared by both cube shaders, after CameraBlock for the eye position
+	// and LightBlock for the lights (光源位置和颜色)
+	const char fShaderMainStr[] =
+		"vec3 lighting()												        \n"
 		"{														        \n"
-		"    // ambient                                                                                            \n"
-		"    float ambientStrength = 0.1;                                                                 \n"
-		"    vec3 ambient = ambientStrength * lightColor;  // 计算光照下的环境颜色      \n"
-		"    // diffuse                                                                                               \n"
 		"    vec3 norm = normalize(v_normal);                                                         \n"
-		"    vec3 lightDir = normalize(lightPos - fragPos);                                          \n"
-		"    float diff = max(dot(norm, lightDir), 0.0);                                                \n"
-		"    vec3 diffuse = diff * lightColor;             // 计算光的漫反射颜色                     \n"
-		"    float specularStrength = 0.5;                                                                  \n"
-		"    vec3 eyeDir = normalize(eyePos - fragPos);   // 计算眼睛看frag的方向          \n"
-		"    vec3 reflectDir = reflect(-lightDir, norm);   // 计算光反射的方向                   \n"
-		"    float spec = pow(max(dot(eyeDir, reflectDir), 0.0), 32.0);                         \n"
-		"    vec3 specular = specularStrength * spec * lightColor;    // 计算反光度         \n"
-		"    vec4 color1 = vec4(0.0f, 0.0f, 0.0f, 0.0f);                                                 \n"
-		"    color1 = (texture(s_texture, v_texCoord) + v_color * 0.5);                       \n"
-		"    outColor = color1 * vec4((ambient + diffuse + specular), 1.0f);                 \n"
-		"}														      	   \n";
-
-	const char fShaderStr_grass[] =
-		"#version 300 es												\n"
-		"precision mediump float;										\n"
-		"in vec4 v_color;												\n"
-		"in vec2 v_texCoord;											\n"
-		"in vec3 v_normal;											       \n"
-		"in vec3 fragPos;                                                                                       \n"
-		"layout(location = 0) out vec4 outColor;						               \n"
-		"uniform sampler2D s_texture_bricks;	// 贴图2-砖头					\n"
-		"uniform sampler2D s_texture_grass;	// 贴图2-草					\n"
-		"uniform vec3 lightPos;       // 光源位置                                                        \n"
-		"uniform vec3 lightColor;     // 光源颜色                                                       \n"
-		"uniform vec3 eyePos;     //  眼睛位置                                                          \n"
+		"    vec3 eyeDir = normalize(u_eyePos.xyz - fragPos);   // 计算眼睛看frag的方向          \n"
+		"    vec3 result = vec3(0.0);                                                                        \n"
+		"    for (int i = 0; i < u_lightNum; i++) {                                                      \n"
+		"        vec3 lightPos = u_lights[i].position.xyz;                                            \n"
+		"        vec3 lightColor = u_lights[i].color.rgb;                                              \n"
+		"        // ambient                                                                                        \n"
+		"        float ambientStrength = 0.1;                                                             \n"
+		"        vec3 ambient = ambientStrength * lightColor;  // 计算光照下的环境颜色  \n"
+		"        // diffuse                                                                                           \n"
+		"        vec3 lightDir = normalize(lightPos - fragPos);                                      \n"
+		"        float diff = max(dot(norm, lightDir), 0.0);                                            \n"
+		"        vec3 diffuse = diff * lightColor;             // 计算光的漫反射颜色                 \n"
+		"        float specularStrength = 0.5;                                                              \n"
+		"        vec3 reflectDir = reflect(-lightDir, norm);   // 计算光反射的方向               \n"
+		"        float spec = pow(max(dot(eyeDir, reflectDir), 0.0), 32.0);                     \n"
+		"        vec3 specular = specularStrength * spec * lightColor;    // 计算反光度     \n"
+		"        result += ambient + diffuse + specular;                                                \n"
+		"    }                                                                                                    \n"
+		"    return result;                                                                                    \n"
+		"}														      	   \n"
 		"void main()												        \n"
 		"{														        \n"
-		"	// ambient                                                                                         \n"
-		"	float ambientStrength = 0.1;                                                               \n"
-		"	vec3 ambient = ambientStrength * lightColor;  // 计算光照下的环境颜色    \n"
-		"	// diffuse                                                                                             \n"
-		"	vec3 norm = normalize(v_normal);                                                      \n"
-		"	vec3 lightDir = normalize(lightPos - fragPos);                                        \n"
-		"	float diff = max(dot(norm, lightDir), 0.0);                                             \n"
-		"	vec3 diffuse = diff * lightColor;             // 计算光的漫反射颜色                  \n"
-		"	float specularStrength = 0.5;                                                               \n"
-		"	vec3 eyeDir = normalize(eyePos - fragPos);   // 计算眼睛看frag的方向       \n"
-		"	vec3 reflectDir = reflect(-lightDir, norm);   // 计算光反射的方向                \n"
-		"	float spec = pow(max(dot(eyeDir, reflectDir), 0.0), 32.0);                      \n"
-		" 	vec3 specular = specularStrength * spec * lightColor;    // 计算反光度      \n"
-		"	vec4 color1 = vec4(0.0f, 0.0f, 0.0f, 0.0f);                                              \n"
-		"	vec4 color2 = vec4(0.0f, 0.0f, 0.0f, 0.0f);                                              \n"
-		"	color1 = texture(s_texture_bricks, v_texCoord);                                    \n"
-		"	color2 = texture(s_texture_grass, v_texCoord);                                     \n"
-		"	if(color2.a < 0.1){                                                                               \n"
-		"		outColor = color1 * vec4((ambient + diffuse + specular), 1.0f);       \n"
-		"	}else{                                                                                                 \n"
-		"		outColor = color1 * color2 * vec4((ambient + diffuse + specular), 1.0f);      \n"
-		"	}                                                                                                      \n"
-		"	//outColor = (color1 + color2) * vec4((ambient + diffuse + specular), 1.0f);      \n"
-		"}															\n";
+		"#ifdef GRASS                                                                                          \n"
+		"	vec4 color1 = texture(s_texture_bricks, v_texCoord);                               \n"
+		"	vec4 color2 = texture(s_texture_grass, v_texCoord);                                \n"
+		"	// the grass only covers the bricks where it is not transparent, select without a branch  \n"
+		"	color2 = mix(vec4(1.0f), color2, step(0.1, color2.a));                            \n"
+		"	outColor = color1 * color2 * vec4(lighting(), 1.0f);                                \n"
+		"#else                                                                                                   \n"
+		"	vec4 color1 = texture(s_texture, v_texCoord) + v_color * 0.5;                   \n"
+		"	outColor = color1 * vec4(lighting(), 1.0f);                                             \n"
+		"#endif                                                                                                  \n"
+		"}														      	   \n";
+	const char vShaderStr_light[] =
+		"uniform mat4 u_mvpMatrix;                                                         \n"
+		"layout(location = 0) in vec4 a_position;                                        \n"
+		"void main()                                                                                 \n"
+		"{                                                                                                \n"
+		"	gl_Position = u_mvpMatrix * a_position;                                \n"
+		"}                                           \n";
 	const char fShaderStr_light[] =
-		"#version 300 es												\n"
 		"precision mediump float;									        \n"
 		"layout(location = 0) out vec4 outColor;				           		        \n"
 		"void main()												        \n"
@@ -238,34 +610,82 @@ int Init(ESContext *esContext)
 		"    outColor = vec4(1.0f, 1.0f, 1.0f, 1.0f);    //光的颜色为纯白                        \n"
 		"}															 \n";
 
-	// Load the shaders and get a linked program object
-	userData->programObject = esLoadProgram(vShaderStr, fShaderStr);
-	userData->lightProgramObject = esLoadProgram(vShaderStr, fShaderStr_light);
-	userData->grassProgramObject = esLoadProgram(vShaderStr, fShaderStr_grass);
+	const char *vShaderChunks[] = { CAMERA_BLOCK_STR, vShaderStr, NULL };
+	const char *fShaderChunks[] = { fShaderHeadStr, CAMERA_BLOCK_STR, LIGHT_BLOCK_STR, fShaderMainStr, NULL };
+	const char *vShaderChunks_light[] = { vShaderStr_light, NULL };
+	const char *fShaderChunks_light[] = { fShaderStr_light, NULL };
+#if INSTANCED_DRAW_ENABLE
+	const char *boxDefines[] = { "INSTANCED_DRAW", NULL };
+	const char *grassDefines[] = { "INSTANCED_DRAW", "GRASS", NULL };
+#else
+	const char *boxDefines[] = { NULL };
+	const char *grassDefines[] = { "GRASS", NULL };
+#endif
+
+	// Submit the program variants, the driver compiles them while the vertex data and textures are loaded
+	userData->programObject = esAcquireProgramVariant(vShaderChunks, fShaderChunks, boxDefines);
+	userData->lightProgramObject = esAcquireProgramVariant(vShaderChunks_light, fShaderChunks_light, NULL);
+	userData->grassProgramObject = esAcquireProgramVariant(vShaderChunks, fShaderChunks, grassDefines);
+
+	// Generate the vertex data
+	userData->numIndices = esGenCube(1.0, &userData->vertices,
+		NULL, NULL, &userData->indices);
+
+	// The camera is written by Draw() every frame
+	glGenBuffers(1, &userData->cameraUboID);
+	glBindBuffer(GL_UNIFORM_BUFFER, userData->cameraUboID);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(stCamera), NULL, GL_DYNAMIC_DRAW);
+	glBindBufferBase(GL_UNIFORM_BUFFER, CAMERA_BLOCK_BINDING, userData->cameraUboID);
+
+	// The lights are written by Draw() every frame as well
+	glGenBuffers(1, &userData->lightUboID);
+	glBindBuffer(GL_UNIFORM_BUFFER, userData->lightUboID);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(stLightBlock), NULL, GL_DYNAMIC_DRAW);
+	glBindBufferBase(GL_UNIFORM_BUFFER, LIGHT_BLOCK_BINDING, userData->lightUboID);
+
+	// The images are looked up in the asset pack before the disk
+	userData->assetPack = esPackMount(esContext->platformData, ASSET_PACK_FILE);
+
+	// The images are decoded by the job pool while the programs are compiled
+	userData->textureLoader = esTextureLoaderCreate(esGetJobPool());
+	if (userData->textureLoader == NULL) {
+		esLogMessage("Init: create texture loader failed\n");
+		return GL_FALSE;
+	}
+	userData->textureID = esTextureLoaderRequest(userData->textureLoader, "container.jpg", GL_TRUE, &userData->textureRequests[0]);
+	userData->textureIdGrass = esTextureLoaderRequest(userData->textureLoader, "grass.png", GL_TRUE, &userData->textureRequests[1]);
+	userData->textureIdBricks = esTextureLoaderRequest(userData->textureLoader, "bricks.jpg", GL_TRUE, &userData->textureRequests[2]);
+
+	// The uniform locations need the programs linked, wait for them here
+	if (!esFinishProgram(userData->programObject) ||
+		!esFinishProgram(userData->lightProgramObject) ||
+		!esFinishProgram(userData->grassProgramObject)) {
+		esLogMessage("Init: program link failed\n");
+		return GL_FALSE;
+	}
+#if !TEXTURE_STREAM_ENABLE
+	esTextureLoaderFinish(userData->textureLoader);
+	esTextureLoaderDestroy(userData->textureLoader);
+	userData->textureLoader = NULL;
+#endif
 
 	// Get the uniform locations
 	userData->mvpLoc = glGetUniformLocation(userData->programObject, "u_mvpMatrix");
 	userData->mvLoc = glGetUniformLocation(userData->programObject, "u_mvMatrix");
+	userData->normalMatrixLoc = glGetUniformLocation(userData->programObject, "u_normalMatrix");
+	userData->grassMvpLoc = glGetUniformLocation(userData->grassProgramObject, "u_mvpMatrix");
+	userData->grassMvLoc = glGetUniformLocation(userData->grassProgramObject, "u_mvMatrix");
+	userData->grassNormalMatrixLoc = glGetUniformLocation(userData->grassProgramObject, "u_normalMatrix");
 	userData->lightMvpLoc = glGetUniformLocation(userData->lightProgramObject, "u_mvpMatrix");
 
-	// Get light pos and color locations
-	userData->lightPosLoc = glGetUniformLocation(userData->programObject, "lightPos");
-	userData->lightColorLoc = glGetUniformLocation(userData->programObject, "lightColor");
-	userData->eyePosLoc = glGetUniformLocation(userData->programObject, "eyePos");
+	// All the cube programs read the camera and the lights from the same uniform buffers
+	bindUniformBlock(userData->programObject, "CameraBlock", CAMERA_BLOCK_BINDING);
+	bindUniformBlock(userData->grassProgramObject, "CameraBlock", CAMERA_BLOCK_BINDING);
+	bindUniformBlock(userData->programObject, "LightBlock", LIGHT_BLOCK_BINDING);
+	bindUniformBlock(userData->grassProgramObject, "LightBlock", LIGHT_BLOCK_BINDING);
 
-	// Generate the vertex data
-	userData->numIndices = esGenCube(1.0, &userData->vertices,
-		NULL, NULL, &userData->indices);
-
-	// Starting rotation angle for the cube
-	userData->angle = 45.0f;
-
-	userData->textureID = loadTexture("container.jpg");
 	userData->samplerLoc = glGetUniformLocation(userData->programObject, "s_texture");
-
-	userData->textureIdGrass = loadTexture("grass.png");
 	userData->samplerLocGrass = glGetUniformLocation(userData->grassProgramObject, "s_texture_grass");
-	userData->textureIdBricks = loadTexture("bricks.jpg");
 	userData->samplerLocBricks = glGetUniformLocation(userData->grassProgramObject, "s_texture_bricks");
 
 	// generate VBO IDs and load the VBOs with Data
@@ -437,6 +857,30 @@ int Init(ESContext *esContext)
 	// Reset to the default VAO
 	glBindVertexArray(0);
 
+#if INSTANCED_DRAW_ENABLE
+	createInstanceVAOs(userData);
+	cubeTransformsInit(userData, userData->instanceCubeIdx);
+#else
+	GLuint cubeOrder[CUBE_NUM];
+	GLuint cube = 0;
+	for (cube = 0; cube < CUBE_NUM; cube++) {
+		cubeOrder[cube] = cube;
+	}
+	cubeTransformsInit(userData, cubeOrder);
+#endif
+
+	// Starting rotation angle and eye position, the state is valid before the first Update()
+	stFrameState initialState;
+	memset(&initialState, 0, sizeof(stFrameState));
+	initialState.angle = 45.0f;
+	initialState.eyeZ = 10.0f;
+	initialState.eyeDelta = -0.005f;
+	frameStateCompute(esContext, &initialState);
+	if (!esRegisterFrameState(esContext, &initialState, sizeof(stFrameState), UPDATE_THREAD_ENABLE)) {
+		esLogMessage("Init: register frame state failed\n");
+		return GL_FALSE;
+	}
+
 	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
 
 	glEnable(GL_DEPTH_TEST); // must enable depth otherwise the cue look very strange
@@ -451,112 +895,24 @@ int Init(ESContext *esContext)
 //
 void Update(ESContext *esContext, float deltaTime)
 {
-	UserData *userData = esContext->userData;
+	// starts as a copy of the last finished state
+	stFrameState *pState = esGetUpdateState(esContext);
 
 	// Compute a rotation angle based on time to rotate the cube
-	userData->angle += (deltaTime * 40.0f);
+	pState->angle += (deltaTime * 40.0f);
 
-	if (userData->angle >= 360.0f)
+	if (pState->angle >= 360.0f)
 	{
-		userData->angle -= 360.0f;
+		pState->angle -= 360.0f;
 	}
-}
-
-void objectMvpSet(ESContext *esContext, GLint i, GLfloat eyeX, GLfloat eyeY, GLfloat eyeZ)
-{
-	UserData *userData = esContext->userData;
-	ESMatrix perspective;
-	ESMatrix modelview;
-	ESMatrix view;
-	float    aspect;
-
-	GLfloat cubePositions[] = {
-	  0.0f,  0.0f,  0.0f,
-	  2.0f,  5.0f, -15.0f,
-	  -1.5f, -2.2f, -2.5f,
-	  -3.8f, -2.0f, -12.3f,
-	  2.4f, -0.4f, -3.5f,
-	  -1.7f,  3.0f, -7.5f,
-	  1.3f, -2.0f, -2.5f,
-	  1.5f,  2.0f, -2.5f,
-	  0.0f,  0.0f, -2.0f,
-	  -1.3f,  1.0f, -1.5f
-	};
-
-	GLfloat cubeRoateDir[] = {
-		1.0f, 1.0f, 1.0f,
-		1.0f, 0.0f, 1.0f,
-		0.0f, 1.0f, 1.0f,
-		1.0f, 1.0f, 0.0f,
-		0.0f, 0.0f, 1.0f,
-		1.0f, 0.0f, 0.0f,
-		0.0f, 1.0f, 0.0f,
-		1.0f, 1.0f, 1.0f,
-		1.0f, 0.0f, 1.0f,
-		0.0f, 1.0f, 1.0f
-	};
-
-	// Compute the window aspect ratio
-	aspect = (GLfloat)esContext->width / (GLfloat)esContext->height;
-
-	// Generate a perspective matrix with a 60 degree FOV
-	esMatrixLoadIdentity(&perspective);
-	esPerspective(&perspective, 60.0f, aspect, 1.0f, 100.0f);
-
-	// Generate a model view matrix to rotate/translate the cube
-	esMatrixLoadIdentity(&modelview);
-
-	// Translate away from the viewer
-	esTranslate(&modelview, cubePositions[3 * i], cubePositions[3 * i + 1], cubePositions[3 * i + 2]);
-
-	// Rotate the cube
-	esRotate(&modelview, userData->angle, cubeRoateDir[3 * i], cubeRoateDir[3 * i + 1], cubeRoateDir[3 * i + 2]);
-	memcpy(&userData->mvMatrix, &modelview, sizeof(ESMatrix));
-
-	//esLogMessage("eyeZ = %f\n", eyeZ);
-
-	esMatrixLookAt(&view,
-		eyeX, eyeY, eyeZ,
-		0.0f, 0.0f, 0.0f,
-		0.0f, 1.0f, 0.0f);
-
-	esMatrixMultiply(&modelview, &modelview, &view);
-
-	// Compute the final MVP by multiplying the
-	// modevleiw and perspective matrices together
-	esMatrixMultiply(&userData->mvpMatrix, &modelview, &perspective);
-}
-
-void lightMvpSet(ESContext *esContext, GLfloat eyeX, GLfloat eyeY, GLfloat eyeZ)
-{
-	UserData *userData = esContext->userData;
-	ESMatrix perspective;
-	ESMatrix modelview;
-	ESMatrix view;
-	float    aspect;
-
-	// Compute the window aspect ratio
-	aspect = (GLfloat)esContext->width / (GLfloat)esContext->height;
-
-	// Generate a perspective matrix with a 60 degree FOV
-	esMatrixLoadIdentity(&perspective);
-	esPerspective(&perspective, 60.0f, aspect, 1.0f, 100.0f);
-
-	// Generate a model view matrix to rotate/translate the cube
-	esMatrixLoadIdentity(&modelview);
 
-	// Translate away from the viewer
-	esTranslate(&modelview, 6.0f, 6.0f, -1.0f);
-
-	esMatrixLookAt(&view,
-		eyeX, eyeY, eyeZ,    // eye position
-		0.0f, 0.0f, 0.0f,    // eye look at location
-		0.0f, 1.0f, 0.0f);   // up direction vec
+	//caculate eye position
+	if (pState->eyeZ > 10.0f || pState->eyeZ < 0.0f) {
+		pState->eyeDelta = -1 * pState->eyeDelta;
+	}
+	pState->eyeZ += pState->eyeDelta;
 
-	esMatrixMultiply(&modelview, &modelview, &view);
-	// Compute the final MVP by multiplying the
-	// modevleiw and perspective matrices together
-	esMatrixMultiply(&userData->lightMvpMatrix, &modelview, &perspective);
+	frameStateCompute(esContext, pState);
 }
 
 ///
@@ -565,6 +921,7 @@ void lightMvpSet(ESContext *esContext, GLfloat eyeX, GLfloat eyeY, GLfloat eyeZ)
 void Draw(ESContext *esContext)
 {
 	UserData *userData = esContext->userData;
+	const stFrameState *pState = esGetDrawState(esContext);
 
 	// Set the viewport
 	glViewport(0, 0, esContext->width, esContext->height);
@@ -572,106 +929,96 @@ void Draw(ESContext *esContext)
 	// Clear the color buffer
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-	//caculate eye position
-	static GLfloat delt = -0.005f;
-	static GLfloat eyeZ = 10.0f;
-	if (eyeZ > 10.0f || eyeZ < 0.0f) {
-		delt = -1 * delt;
+	// Upload the textures decoded so far, the cubes are drawn without the missing ones
+	if ((userData->textureLoader != NULL) &&
+		(esTextureLoaderUpload(userData->textureLoader, TEXTURE_UPLOAD_BUDGET) == 0)) {
+		esTextureLoaderDestroy(userData->textureLoader);
+		userData->textureLoader = NULL;
 	}
 
-	eyeZ += delt;
+	// Upload the camera once, all the programs read it from CameraBlock
+	glBindBuffer(GL_UNIFORM_BUFFER, userData->cameraUboID);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(stCamera), &pState->camera);
 
-	/********(1) 绘制1到5个箱子--贴图为箱子加不同的六面颜色 *********/
-	// Use the program object
-	glUseProgram(userData->programObject);
+	// Upload the lights once as well, no program has its own light uniforms
+	glBindBuffer(GL_UNIFORM_BUFFER, userData->lightUboID);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(stLightBlock), &pState->lights);
 
-	// Bind the VAO
-	glBindVertexArray(userData->vaoID);
+	/********(1) 绘制1到5个箱子--贴图为箱子加不同的六面颜色 *********/
+	// Use the program object, the state goes through the tracker so the
+	// samplers that never change are only sent on the first frame
+	esStateUseProgram(userData->programObject);
 
 	// Bind the texture
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, userData->textureID);
-	glUniform1i(userData->samplerLoc, 0);
-
-	glUniform3f(userData->lightColorLoc, 1.0f, 1.0f, 1.0f);
-
-	GLfloat sinAngle = sinf(userData->angle * PI / 180.0f);
-	GLfloat cosAngle = cosf(userData->angle * PI / 180.0f);
-	//GLfloat lightPosX = 6.0f * cosAngle;
-	//GLfloat lightPosZ = 6.0f * sinAngle;
-	GLfloat eyeX = 6.0f * cosAngle;
-	GLfloat eyeY = 6.0f * sinAngle;
-	glUniform3f(userData->lightPosLoc, 6.0f, 6.0f, -1.0f);
-	//glUniform3f(userData->lightPosLoc, lightPosX, 6.0f, lightPosZ);
-	glUniform3f(userData->eyePosLoc, 0.0f, 0.0f, eyeZ);
-	//glUniform3f(userData->eyePosLoc, eyeX, eyeY, 10.0f);
+	esStateBindTexture(0, GL_TEXTURE_2D, userData->textureID);
+	esStateUniform1i(userData->samplerLoc, 0);
+
+#if INSTANCED_DRAW_ENABLE
+	// Write all the model matrices, the VP matrix comes from CameraBlock
+	instanceModelUpload(esContext, pState);
+	esStateBindVertexArray(userData->instanceVaoIDs[MATERIAL_BOX]);
+
+	// Draw all the cubes
+	glDrawElementsInstanced(GL_TRIANGLES, userData->numIndices, GL_UNSIGNED_INT, (const void *)0, userData->instanceNum[MATERIAL_BOX]);
+#else
+	// Bind the VAO
+	esStateBindVertexArray(userData->vaoID);
 
 	GLint i = 0;
 	for (i = 5; i < 10; i++) {
-		objectMvpSet(esContext, i, 0.0f, 0.0f, eyeZ);
-		//objectMvpSet(esContext, i, eyeX, eyeY, 10.0f);
 		// Load the M matrix
-		glUniformMatrix4fv(userData->mvLoc, 1, GL_FALSE, (GLfloat *)&userData->mvMatrix.m[0][0]);
+		glUniformMatrix4fv(userData->mvLoc, 1, GL_FALSE, (GLfloat *)&pState->mvMatrices[i].m[0][0]);
 		// Load the MVP matrix
-		glUniformMatrix4fv(userData->mvpLoc, 1, GL_FALSE, (GLfloat *)&userData->mvpMatrix.m[0][0]);
+		glUniformMatrix4fv(userData->mvpLoc, 1, GL_FALSE, (GLfloat *)&pState->mvpMatrices[i].m[0][0]);
+		// Load the normal matrix
+		glUniformMatrix3fv(userData->normalMatrixLoc, 1, GL_FALSE, (GLfloat *)&pState->normalMatrices[i].m[0][0]);
 
 		// Draw the cube
 		glDrawElements(GL_TRIANGLES, userData->numIndices, GL_UNSIGNED_INT, (const void *)0);
 	}
+#endif
 
 	/********(2) 绘制6到10个箱子--贴图为草和砖头 *********/
 	// Use the program object
-	glUseProgram(userData->grassProgramObject);
-	// Bind the VAO
-	glBindVertexArray(userData->vaoID);
+	esStateUseProgram(userData->grassProgramObject);
 	// Bind the texture
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, userData->textureIdBricks);
-	glUniform1i(userData->samplerLocBricks, 1);
+	esStateBindTexture(1, GL_TEXTURE_2D, userData->textureIdBricks);
+	esStateUniform1i(userData->samplerLocBricks, 1);
 
-	glActiveTexture(GL_TEXTURE2);
-	glBindTexture(GL_TEXTURE_2D, userData->textureIdGrass);
-	glUniform1i(userData->samplerLocGrass, 2);
+	esStateBindTexture(2, GL_TEXTURE_2D, userData->textureIdGrass);
+	esStateUniform1i(userData->samplerLocGrass, 2);
 
-	glUniform3f(userData->lightColorLoc, 1.0f, 1.0f, 1.0f);
-	glUniform3f(userData->lightPosLoc, 6.0f, 6.0f, -1.0f);
-	glUniform3f(userData->eyePosLoc, 0.0f, 0.0f, eyeZ);
-	//glUniform3f(userData->eyePosLoc, eyeX, eyeY, 10.0f);
+#if INSTANCED_DRAW_ENABLE
+	esStateBindVertexArray(userData->instanceVaoIDs[MATERIAL_GRASS]);
 
+	// Draw all the cubes
+	glDrawElementsInstanced(GL_TRIANGLES, userData->numIndices, GL_UNSIGNED_INT, (const void *)0, userData->instanceNum[MATERIAL_GRASS]);
+#else
 	for (i = 0; i < 5; i++) {
-		objectMvpSet(esContext, i, 0.0f, 0.0f, eyeZ);
-		//objectMvpSet(esContext, i, eyeX, eyeY, 10.0f);
 		// Load the M matrix
-		glUniformMatrix4fv(userData->mvLoc, 1, GL_FALSE, (GLfloat *)&userData->mvMatrix.m[0][0]);
+		glUniformMatrix4fv(userData->grassMvLoc, 1, GL_FALSE, (GLfloat *)&pState->mvMatrices[i].m[0][0]);
 		// Load the MVP matrix
-		glUniformMatrix4fv(userData->mvpLoc, 1, GL_FALSE, (GLfloat *)&userData->mvpMatrix.m[0][0]);
+		glUniformMatrix4fv(userData->grassMvpLoc, 1, GL_FALSE, (GLfloat *)&pState->mvpMatrices[i].m[0][0]);
+		// Load the normal matrix
+		glUniformMatrix3fv(userData->grassNormalMatrixLoc, 1, GL_FALSE, (GLfloat *)&pState->normalMatrices[i].m[0][0]);
 
 		// Draw the cube
 		glDrawElements(GL_TRIANGLES, userData->numIndices, GL_UNSIGNED_INT, (const void *)0);
 	}
-
-	// Return to the default VAO
-	glBindVertexArray(0);
+#endif
 
 	/********(3) 绘制光源 *********/
 	// Use the program object
-	glUseProgram(userData->lightProgramObject);
+	esStateUseProgram(userData->lightProgramObject);
 
-	// Bind the VAO
-	glBindVertexArray(userData->lightVaoID);
-
-	lightMvpSet(esContext, 0.0f, 0.0f, eyeZ);
-	//lightMvpSet(esContext, eyeX, eyeY, 10.0f);
+	// Bind the VAO, it stays bound until the next frame binds the cube VAO
+	esStateBindVertexArray(userData->lightVaoID);
 
 	// Load the MVP matrix
-	glUniformMatrix4fv(userData->lightMvpLoc, 1, GL_FALSE, (GLfloat *)&userData->lightMvpMatrix.m[0][0]);
+	glUniformMatrix4fv(userData->lightMvpLoc, 1, GL_FALSE, (GLfloat *)&pState->lightMvpMatrix.m[0][0]);
 
 	// Draw the cube
 	glDrawElements(GL_TRIANGLES, userData->numIndices, GL_UNSIGNED_INT, (const void *)0);
-
-	// Return to the default VAO
-	glBindVertexArray(0);
-
 }
 
 ///
@@ -681,6 +1028,11 @@ void Shutdown(ESContext *esContext)
 {
 	UserData *userData = esContext->userData;
 
+	// the textures still decoding are dropped
+	esTextureLoaderDestroy(userData->textureLoader);
+	// no image is mapped from the pack any more
+	esPackUnmount(userData->assetPack);
+
 	if (userData->vertices != NULL)
 	{
 		free(userData->vertices);
@@ -692,8 +1044,16 @@ void Shutdown(ESContext *esContext)
 	}
 
 	glDeleteTextures(1, &userData->textureID);
-	// Delete program object
-	glDeleteProgram(userData->programObject);
+#if INSTANCED_DRAW_ENABLE
+	glDeleteBuffers(INSTANCE_VBO_MAX, userData->instanceVboIDs);
+	glDeleteVertexArrays(MATERIAL_MAX, userData->instanceVaoIDs);
+#endif
+	glDeleteBuffers(1, &userData->cameraUboID);
+	glDeleteBuffers(1, &userData->lightUboID);
+	// Release the program variants
+	esReleaseProgram(userData->programObject);
+	esReleaseProgram(userData->grassProgramObject);
+	esReleaseProgram(userData->lightProgramObject);
 }
 
 